@@ -10,6 +10,7 @@
 
 #include <mbedtls/aes.h>
 #include <mbedtls/md.h>
+#include <stdint.h>
 #include <string.h>
 
 char encryptAES_ECB(const char *, const char *, uint32_t, char *, uint32_t *);
@@ -9,11 +9,13 @@
 #ifndef COMPONENTS_FILE_MANAGER_FILE_MANAGER_H_
 #define COMPONENTS_FILE_MANAGER_FILE_MANAGER_H_
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/unistd.h>
 #include <sys/stat.h>
 
-#include "/Users/ashu/projects/esp/esp-idf/components/spiffs/include/esp_spiffs.h"
+#include "esp_spiffs.h"
 
 esp_err_t mount_spiffs(char *);
 
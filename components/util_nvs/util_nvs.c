@@ -1,12 +1,284 @@
 /*
- * @file: util_wifi.c
+ * @file: util_nvs.c
  *
- * @brief: This file contains various utility functions to interact with the WiFi
+ * @brief: This file contains various utility functions to interact with the NVS storage
  *
  * @author: Ashutosh Singh Parmar
  */
 #include "util_nvs.h"
 
+typedef struct nvs_cached_handle { char name[NVS_KEY_NAME_MAX_SIZE]; nvs_handle_t handle; nvs_open_mode_t mode; uint32_t last_used; uint8_t in_use; }nvs_cached_handle;
+
+/*
+ * @brief : Table of namespace handles that are kept open between API calls.
+ */
+static nvs_cached_handle handle_cache[NVS_MAX_CACHED_HANDLES];
+
+/*
+ * @brief : Monotonic counter used to find the least recently used cache entry.
+ */
+static uint32_t handle_cache_clock = 0;
+
+static nvs_handle_cache_stats handle_cache_stats;
+
+static StaticSemaphore_t nvs_lock_buffer;
+static SemaphoreHandle_t nvs_lock = NULL;
+
+/*
+ * @brief: This function creates the lock that guards the handle cache. It is called by the initialization APIs,
+ * before any other task can use util_nvs.
+ *
+ * @param:
+ * none
+ *
+ * @return:
+ * nothing
+ */
+static void nvs_lock_create(void)
+{
+	if( nvs_lock == NULL ) nvs_lock = xSemaphoreCreateMutexStatic(&nvs_lock_buffer);
+}
+
+/*
+ * @brief: This function acquires the lock that guards the handle cache. When the NVS flash was initialized without
+ * the util_nvs initialization APIs there is no lock, and the APIs must then be used from one task only.
+ *
+ * @param:
+ * none
+ *
+ * @return:
+ * nothing
+ */
+static void nvs_lock_take(void)
+{
+	if( nvs_lock != NULL ) xSemaphoreTake(nvs_lock, portMAX_DELAY);
+}
+
+/*
+ * @brief: This function releases the lock that guards the handle cache.
+ *
+ * @param:
+ * none
+ *
+ * @return:
+ * nothing
+ */
+static void nvs_lock_give(void)
+{
+	if( nvs_lock != NULL ) xSemaphoreGive(nvs_lock);
+}
+
+/*
+ * @brief: This function commits a handle and counts the commit.
+ *
+ * @param:
+ * 1. nvs_handle_t handle : The handle to commit.
+ *
+ * @return: esp_err_t
+ * Error code returned by nvs_commit.
+ */
+static esp_err_t nvs_cache_commit(nvs_handle_t handle)
+{
+	handle_cache_stats.commits++;
+	return nvs_commit(handle);
+}
+
+/*
+ * @brief: This function closes a cached handle, committing pending writes first if it was opened for writing.
+ *
+ * @param:
+ * 1. nvs_cached_handle * entry : The cache entry to close.
+ *
+ * @return:
+ * nothing
+ */
+static void nvs_cache_close_entry(nvs_cached_handle * entry)
+{
+	if( !entry->in_use ) return;
+
+	if( entry->mode == NVS_READWRITE )
+		nvs_cache_commit(entry->handle);
+	nvs_close(entry->handle);
+
+	memset(entry, 0, sizeof(nvs_cached_handle));
+}
+
+/*
+ * @brief: This function returns an open handle for a namespace, opening it only if no suitable handle is cached.
+ * A read-write handle also serves reads; a read-only handle is re-opened as read-write when a write needs it.
+ * Must be called with the cache lock held.
+ *
+ * @param:
+ * 1. const char * namespace : The NVS namespace.
+ * 2. nvs_open_mode_t mode : NVS_READONLY for read operations, NVS_READWRITE for write operations.
+ * 3. nvs_handle_t * handle : Pointer to variable where the handle will be stored.
+ *
+ * @return: esp_err_t
+ * ESP_OK : success
+ * Error code returned by nvs_open otherwise.
+ */
+static esp_err_t nvs_cache_get_handle(const char * namespace, nvs_open_mode_t mode, nvs_handle_t * handle)
+{
+	if( namespace == NULL || strlen(namespace) >= NVS_KEY_NAME_MAX_SIZE ) return ESP_ERR_INVALID_ARG;
+
+	nvs_cached_handle * slot = NULL;
+
+	for( uint8_t i=0; i<NVS_MAX_CACHED_HANDLES; i++ )
+	{
+		if( handle_cache[i].in_use && !strcmp(handle_cache[i].name, namespace) )
+		{
+			if( handle_cache[i].mode == NVS_READWRITE || mode == NVS_READONLY )
+			{
+				handle_cache[i].last_used = ++handle_cache_clock;
+				handle_cache_stats.hits++;
+				*handle = handle_cache[i].handle;
+				return ESP_OK;
+			}
+
+			// a read-only handle can not be used for writing, re-open the namespace in the same slot
+			nvs_cache_close_entry(&handle_cache[i]);
+			slot = &handle_cache[i];
+			break;
+		}
+	}
+
+	// look for a free slot, otherwise evict the least recently used handle
+	for( uint8_t i=0; slot == NULL && i<NVS_MAX_CACHED_HANDLES; i++ )
+	{
+		if( !handle_cache[i].in_use ) slot = &handle_cache[i];
+	}
+	if( slot == NULL )
+	{
+		slot = &handle_cache[0];
+		for( uint8_t i=1; i<NVS_MAX_CACHED_HANDLES; i++ )
+		{
+			if( handle_cache[i].last_used < slot->last_used ) slot = &handle_cache[i];
+		}
+		nvs_cache_close_entry(slot);
+		handle_cache_stats.evictions++;
+	}
+
+	esp_err_t _err = nvs_open(namespace, mode, &(slot->handle));
+	if( _err != ESP_OK ) return _err;
+
+	handle_cache_stats.opens++;
+	strcpy(slot->name, namespace);
+	slot->mode = mode;
+	slot->last_used = ++handle_cache_clock;
+	slot->in_use = 1;
+
+	*handle = slot->handle;
+	return ESP_OK;
+}
+
+/*
+ * @brief : Table of hot keys whose values are kept in RAM, indexed by a hash of namespace and key.
+ */
+static nvs_ram_cache_entry ram_cache[NVS_RAM_CACHE_SIZE];
+
+static nvs_ram_cache_stats ram_cache_stats;
+
+static portMUX_TYPE ram_cache_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/*
+ * @brief: This function computes the FNV-1a hash of a namespace and key pair.
+ *
+ * @param:
+ * 1. const char * namespace : The NVS namespace.
+ * 2. const char * key : The key string.
+ *
+ * @return: uint32_t
+ * The hash value.
+ */
+static uint32_t nvs_ram_cache_hash(const char * namespace, const char * key)
+{
+	uint32_t h = 2166136261u;
+
+	for( ; *namespace; namespace++ ) h = (h ^ (uint8_t)*namespace) * 16777619u;
+	h = (h ^ 0X00) * 16777619u;
+	for( ; *key; key++ ) h = (h ^ (uint8_t)*key) * 16777619u;
+
+	return h;
+}
+
+/*
+ * @brief: This function finds the slot of a key in the RAM cache. Must be called inside the cache critical section.
+ *
+ * @param:
+ * 1. const char * namespace : The NVS namespace.
+ * 2. const char * key : The key string.
+ * 3. uint8_t insert : If 1, an empty slot is returned when the key is not registered.
+ *
+ * @return: nvs_ram_cache_entry *
+ * Pointer to the slot, NULL if the key is not registered (and no slot is free when inserting).
+ */
+static nvs_ram_cache_entry * nvs_ram_cache_find(const char * namespace, const char * key, uint8_t insert)
+{
+	uint32_t index = nvs_ram_cache_hash(namespace, key) & (NVS_RAM_CACHE_SIZE - 1);
+
+	for( uint16_t probe=0; probe<NVS_RAM_CACHE_SIZE; probe++ )
+	{
+		nvs_ram_cache_entry * entry = &ram_cache[(index + probe) & (NVS_RAM_CACHE_SIZE - 1)];
+
+		if( !entry->registered ) return insert ? entry : NULL;
+		if( !strcmp(entry->key, key) && !strcmp(entry->namespace, namespace) ) return entry;
+	}
+	return NULL;
+}
+
+/*
+ * @brief: This function serves an integer from the RAM cache.
+ *
+ * @param:
+ * 1. const char * namespace : The NVS namespace.
+ * 2. const char * key : The key string.
+ * 3. int32_t * value : Pointer to variable where the cached value will be stored.
+ *
+ * @return: esp_err_t
+ * ESP_OK : the value was served from RAM
+ * ESP_FAIL : the key is not registered or its value is not loaded
+ */
+static esp_err_t nvs_ram_cache_get(const char * namespace, const char * key, int32_t * value)
+{
+	esp_err_t _err = ESP_FAIL;
+
+	portENTER_CRITICAL(&ram_cache_mux);
+	nvs_ram_cache_entry * entry = nvs_ram_cache_find(namespace, key, 0);
+	if( entry != NULL && entry->valid )
+	{
+		*value = entry->value;
+		ram_cache_stats.hits++;
+		_err = ESP_OK;
+	}
+	else ram_cache_stats.misses++;
+	portEXIT_CRITICAL(&ram_cache_mux);
+
+	return _err;
+}
+
+/*
+ * @brief: This function updates the cached value of a registered key. Unregistered keys are ignored.
+ *
+ * @param:
+ * 1. const char * namespace : The NVS namespace.
+ * 2. const char * key : The key string.
+ * 3. int32_t value : The value now stored in flash.
+ *
+ * @return:
+ * nothing
+ */
+static void nvs_ram_cache_fill(const char * namespace, const char * key, int32_t value)
+{
+	portENTER_CRITICAL(&ram_cache_mux);
+	nvs_ram_cache_entry * entry = nvs_ram_cache_find(namespace, key, 0);
+	if( entry != NULL )
+	{
+		entry->value = value;
+		entry->valid = 1;
+	}
+	portEXIT_CRITICAL(&ram_cache_mux);
+}
+
 /*
  * @brief : This API is used to initialize the NVS storage.
  *
@@ -18,9 +290,100 @@
  */
 void InitializeNVS()
 {
+	nvs_lock_create();
 	ESP_ERROR_CHECK(nvs_flash_init());
 }
 
+#ifdef CONFIG_NVS_ENCRYPTION
+/*
+ * @brief : Encryption keys of the NVS partition, read from the key partition once and kept for re-initialization.
+ */
+static nvs_sec_cfg_t nvs_security_cfg;
+
+static uint8_t nvs_security_loaded = 0;
+#endif
+
+/*
+ * @brief : This variable holds whether the NVS storage was initialized with encryption.
+ */
+static uint8_t nvs_encrypted = 0;
+
+/*
+ * @brief : This API is used to initialize the NVS storage with encryption. The XTS keys are read from the NVS key
+ * partition (and generated on first use) only once; later initializations reuse the cached keys. All other util_nvs
+ * APIs work unchanged on top of an encrypted storage.
+ *
+ * @param
+ * 1. const char * keys_partition : Label of the 'nvs_keys' partition, NULL for the first one found.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_ERR_NOT_SUPPORTED : CONFIG_NVS_ENCRYPTION is not enabled
+ * ESP_ERR_NOT_FOUND : no key partition
+ * Error code returned by the NVS flash APIs otherwise.
+ */
+esp_err_t InitializeSecureNVS(const char * keys_partition)
+{
+#ifdef CONFIG_NVS_ENCRYPTION
+	esp_err_t _err;
+
+	nvs_lock_create();
+
+	if( !nvs_security_loaded )
+	{
+		const esp_partition_t * part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS_KEYS, keys_partition);
+		if( part == NULL ) return ESP_ERR_NOT_FOUND;
+
+		_err = nvs_flash_read_security_cfg(part, &nvs_security_cfg);
+		// a blank key partition means this is the first boot with encryption
+		if( _err == ESP_ERR_NVS_KEYS_NOT_INITIALIZED ) _err = nvs_flash_generate_keys(part, &nvs_security_cfg);
+		if( _err != ESP_OK ) return _err;
+
+		nvs_security_loaded = 1;
+	}
+
+	_err = nvs_flash_secure_init(&nvs_security_cfg);
+	if( _err == ESP_OK ) nvs_encrypted = 1;
+
+	return _err;
+#else
+	(void)keys_partition;
+	return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+/*
+ * @brief : This API is used to find out whether the NVS storage was initialized with encryption.
+ *
+ * @param
+ * NONE
+ *
+ * @return - uint8_t
+ * 1 encrypted
+ * 0 plaintext
+ */
+uint8_t NVSIsEncrypted(void)
+{
+	return nvs_encrypted;
+}
+
+/*
+ * @brief : This API is used to close all cached handles and de-initialize the NVS storage.
+ *
+ * @param
+ * NONE
+ *
+ * @return
+ * NOTHING
+ */
+void DeinitializeNVS()
+{
+	NVSCloseAll();
+	NVSRamCacheInvalidateAll();
+	nvs_flash_deinit();
+	nvs_encrypted = 0;
+}
+
 /**
  * @brief : This API is used to erase the NVS flash
  *
@@ -32,7 +395,73 @@ void InitializeNVS()
  */
 void EraseNVS()
 {
+	// erasing de-initializes the storage, which invalidates every open handle
+	NVSCloseAll();
+	NVSRamCacheInvalidateAll();
 	ESP_ERROR_CHECK(nvs_flash_erase());
+	nvs_encrypted = 0;
+}
+
+/**
+ * @brief : This API is used to commit pending writes on all cached read-write handles.
+ *
+ * @param
+ * NONE
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed to commit at least one namespace
+ */
+esp_err_t NVSFlush(void)
+{
+	esp_err_t _err = ESP_OK;
+
+	nvs_lock_take();
+	for( uint8_t i=0; i<NVS_MAX_CACHED_HANDLES; i++ )
+	{
+		if( handle_cache[i].in_use && handle_cache[i].mode == NVS_READWRITE )
+		{
+			if( nvs_cache_commit(handle_cache[i].handle) != ESP_OK ) _err = ESP_FAIL;
+		}
+	}
+	nvs_lock_give();
+
+	return _err;
+}
+
+/**
+ * @brief : This API is used to commit and close all cached handles. It should be called before shutdown.
+ *
+ * @param
+ * NONE
+ *
+ * @return
+ * NOTHING
+ */
+void NVSCloseAll(void)
+{
+	nvs_lock_take();
+	for( uint8_t i=0; i<NVS_MAX_CACHED_HANDLES; i++ )
+	{
+		nvs_cache_close_entry(&handle_cache[i]);
+	}
+	nvs_lock_give();
+}
+
+/**
+ * @brief : This API is used to read the handle cache counters.
+ *
+ * @param
+ * 1. nvs_handle_cache_stats * stats : Pointer to structure where the counters will be stored.
+ *
+ * @return
+ * NOTHING
+ */
+void NVSGetHandleCacheStats(nvs_handle_cache_stats * stats)
+{
+	nvs_lock_take();
+	*stats = handle_cache_stats;
+	nvs_lock_give();
 }
 
 /**
@@ -49,47 +478,93 @@ void EraseNVS()
  * ESP_FAIL : failed
  */
 esp_err_t NVSStoreBytes(const char * namespace, const char * key, uint8_t * value, uint8_t len)
+{
+	return NVSStoreBlob(namespace, key, value, (size_t)len);
+}
+
+/**
+ * @brief : This API is used to read a string of 8 bit values from NVS Storage.
+ *
+ * @param :
+ * 1. const char * namespace : The NVS Namespace where data is stored.
+ * 2. const char * key : The key string.
+ * 3. uint8_t * value : Pointer to array where retrieved data will be stored.
+ * 4. uint8_t * max_length : Pointer to variable containing size of the destination array. If the read operation
+ * is successful then, number of read bytes is also stored in this variable.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed
+ */
+esp_err_t NVSReadBytes(const char * namespace, const char * key, uint8_t * value, uint8_t * max_length)
+{
+	size_t s = *max_length;
+
+	if( NVSReadBlob(namespace, key, value, &s) != ESP_OK ) return ESP_FAIL;
+
+	*max_length = (uint8_t)s;
+	return ESP_OK;
+}
+
+/**
+ * @brief : This API  is used to store a blob of any size supported by NVS in a single key.
+ *
+ * @param
+ * 1. const char * namespace : The NVS Namespace where data has to be stored.
+ * 2. const char * key : The key string.
+ * 3. const void * value : Pointer to the data.
+ * 4. size_t len : Number of bytes to store.
+ *
+ * @returns - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed
+ */
+esp_err_t NVSStoreBlob(const char * namespace, const char * key, const void * value, size_t len)
 {
 	esp_err_t _err;
 	nvs_handle_t nvs_st;
 
-	//open the NVS storage
-	_err=nvs_open(namespace, NVS_READWRITE, &nvs_st);
+	nvs_lock_take();
+
+	//get a cached handle to the NVS storage
+	_err=nvs_cache_get_handle(namespace, NVS_READWRITE, &nvs_st);
 	// if the nvs storage could not be opened, return with error code
-	if( _err != ESP_OK ) return ESP_FAIL;
+	if( _err != ESP_OK ){
+		nvs_lock_give();
+		return ESP_FAIL;
+	}
 
 	// storing operation
-	_err=nvs_set_blob(nvs_st, key, value, (size_t)len);
+	_err=nvs_set_blob(nvs_st, key, value, len);
 	// return with error code if something goes wrong in storing operation
 	if( _err != ESP_OK ){
-		//close the NVS storage before exit
-		nvs_close(nvs_st);
+		nvs_lock_give();
 		return ESP_FAIL;
 	}
 
 	// committing to memory
-	_err = nvs_commit(nvs_st);
-	nvs_close(nvs_st);
+	_err = nvs_cache_commit(nvs_st);
+	nvs_lock_give();
 
 	if(_err == ESP_OK ) return _err;
 	else return ESP_FAIL;
 }
 
 /**
- * @brief : This API is used to read a string of 8 bit values from NVS Storage.
+ * @brief : This API is used to read a blob stored with NVSStoreBlob().
  *
  * @param :
  * 1. const char * namespace : The NVS Namespace where data is stored.
  * 2. const char * key : The key string.
- * 3. uint8_t * value : Pointer to array where retrieved data will be stored.
- * 4. uint8_t * max_length : Pointer to variable containing size of the destination array. If the read operation
+ * 3. void * value : Pointer to array where retrieved data will be stored.
+ * 4. size_t * max_length : Pointer to variable containing size of the destination array. If the read operation
  * is successful then, number of read bytes is also stored in this variable.
  *
  * @return - esp_err_t
  * ESP_OK : success
- * ESP_FAIL : failed
+ * ESP_FAIL : failed, or the destination array is too small
  */
-esp_err_t NVSReadBytes(const char * namespace, const char * key, uint8_t * value, uint8_t * max_length)
+esp_err_t NVSReadBlob(const char * namespace, const char * key, void * value, size_t * max_length)
 {
 	//ESP error code holder
 	esp_err_t _err;
@@ -97,28 +572,31 @@ esp_err_t NVSReadBytes(const char * namespace, const char * key, uint8_t * value
 	nvs_handle_t nvs_st;
 	size_t s;
 
-	//open the NVS storage
-	_err=nvs_open(namespace, NVS_READWRITE, &nvs_st);
+	nvs_lock_take();
+
+	//get a cached read-only handle to the NVS storage
+	_err=nvs_cache_get_handle(namespace, NVS_READONLY, &nvs_st);
 	//if there was error in opening the storage name space then, return with error code
-	if(_err != ESP_OK) return ESP_FAIL;
+	if(_err != ESP_OK){
+		nvs_lock_give();
+		return ESP_FAIL;
+	}
 
 	//get the required number of bytes for key's value
 	_err=nvs_get_blob(nvs_st, key, NULL, &s);
-	if(_err != ESP_OK || ( (uint8_t)s>(*max_length) )){
+	if(_err != ESP_OK || s > *max_length){
 		//return with error code if, failed to read or the input variable is too small for the data
-		nvs_close(nvs_st);
+		nvs_lock_give();
 		return ESP_FAIL;
 	}
-	else *max_length = (uint8_t)s;
+	else *max_length = s;
 
 	//get the actual data into the key array
 	_err=nvs_get_blob(nvs_st, key, value, &s);
-	nvs_close(nvs_st);
+	nvs_lock_give();
 
 	if( _err == ESP_OK ) return _err;
 	else return ESP_FAIL;
-
-	return ESP_OK;
 }
 
 /**
@@ -139,22 +617,32 @@ esp_err_t NVSStoreInteger32(const char * namespace, const char * key, int32_t va
 	esp_err_t _err;
 	nvs_handle_t nvs_st;
 
-	//open the NVS storage
-	_err=nvs_open(namespace, NVS_READWRITE, &nvs_st);
+	nvs_lock_take();
+
+	//get a cached handle to the NVS storage
+	_err=nvs_cache_get_handle(namespace, NVS_READWRITE, &nvs_st);
 	//if there was error in opening the storage name space then, return with error code
-	if(_err != ESP_OK) return ESP_FAIL;
+	if(_err != ESP_OK){
+		nvs_lock_give();
+		return ESP_FAIL;
+	}
 
 	//get the required number of bytes for key's value
 	_err=nvs_set_i32(nvs_st, key, value);
 	if(_err != ESP_OK ){
 		//failed to read or the input variable is too small for the data
-		nvs_close(nvs_st);
+		NVSRamCacheInvalidate(namespace, key);
+		nvs_lock_give();
 		return ESP_FAIL;
 	}
 
 	//get the actual data into the key array
-	_err=nvs_commit(nvs_st);
-	nvs_close(nvs_st);
+	_err=nvs_cache_commit(nvs_st);
+
+	// keep the RAM copy in step with flash
+	if( _err == ESP_OK ) nvs_ram_cache_fill(namespace, key, value);
+	else NVSRamCacheInvalidate(namespace, key);
+	nvs_lock_give();
 
 	if( _err == ESP_OK ) return _err;
 	else return ESP_FAIL;
@@ -178,15 +666,1708 @@ esp_err_t NVSReadInteger32(const char * namespace, const char * key, int32_t * v
 	esp_err_t _err;
 	nvs_handle_t nvs_st;
 
-	//open the NVS storage
-	_err=nvs_open(namespace, NVS_READWRITE, &nvs_st);
-	//if there was error in opening the storage name space then, return with error code
-	if(_err != ESP_OK) return ESP_FAIL;
+	// hot keys are served from RAM without touching flash
+	if( nvs_ram_cache_get(namespace, key, value) == ESP_OK ) return ESP_OK;
+
+	nvs_lock_take();
+
+	//get a cached read-only handle to the NVS storage
+	_err=nvs_cache_get_handle(namespace, NVS_READONLY, &nvs_st);
+	//if there was error in opening the storage name space then, return with error code
+	if(_err != ESP_OK){
+		nvs_lock_give();
+		return ESP_FAIL;
+	}
 
 	//get the required number of bytes for key's value
 	_err=nvs_get_i32(nvs_st, key, value);
-	nvs_close(nvs_st);
+	if( _err == ESP_OK ) nvs_ram_cache_fill(namespace, key, *value);
+	nvs_lock_give();
 
 	if(_err == ESP_OK ) return _err;
 	else return ESP_FAIL;
 }
+
+/*
+ * @brief: This function stores one typed value using an open handle, without committing. Floats and doubles are
+ * stored as the bit pattern of an unsigned integer of the same width, which takes a single NVS entry.
+ *
+ * @param:
+ * 1. nvs_handle_t handle : The namespace handle.
+ * 2. const char * key : The key string.
+ * 3. nvs_field_type type : The type of the value.
+ * 4. const void * value : Pointer to the value.
+ * 5. size_t size : Size of the value in bytes, for strings the size of the buffer holding it.
+ *
+ * @return: esp_err_t
+ * Error code returned by the NVS set function.
+ */
+static esp_err_t nvs_set_field(nvs_handle_t handle, const char * key, nvs_field_type type, const void * value, size_t size)
+{
+	uint32_t u32;
+	uint64_t u64;
+
+	switch( type )
+	{
+	case NVS_FIELD_U8: return nvs_set_u8(handle, key, *(const uint8_t *)value);
+	case NVS_FIELD_I8: return nvs_set_i8(handle, key, *(const int8_t *)value);
+	case NVS_FIELD_U16: return nvs_set_u16(handle, key, *(const uint16_t *)value);
+	case NVS_FIELD_I16: return nvs_set_i16(handle, key, *(const int16_t *)value);
+	case NVS_FIELD_U32: return nvs_set_u32(handle, key, *(const uint32_t *)value);
+	case NVS_FIELD_I32: return nvs_set_i32(handle, key, *(const int32_t *)value);
+	case NVS_FIELD_U64: return nvs_set_u64(handle, key, *(const uint64_t *)value);
+	case NVS_FIELD_I64: return nvs_set_i64(handle, key, *(const int64_t *)value);
+
+	case NVS_FIELD_FLOAT:
+		memcpy(&u32, value, sizeof(float));
+		return nvs_set_u32(handle, key, u32);
+
+	case NVS_FIELD_DOUBLE:
+		memcpy(&u64, value, sizeof(double));
+		return nvs_set_u64(handle, key, u64);
+
+	case NVS_FIELD_STRING:
+		// the string must be terminated inside its buffer
+		if( memchr(value, 0, size) == NULL ) return ESP_ERR_INVALID_SIZE;
+		return nvs_set_str(handle, key, (const char *)value);
+
+	case NVS_FIELD_BLOB:
+		return nvs_set_blob(handle, key, value, size);
+	}
+
+	return ESP_ERR_INVALID_ARG;
+}
+
+/*
+ * @brief: This function reads one typed value using an open handle.
+ *
+ * @param:
+ * 1. nvs_handle_t handle : The namespace handle.
+ * 2. const char * key : The key string.
+ * 3. nvs_field_type type : The type of the value.
+ * 4. void * value : Pointer to the destination.
+ * 5. size_t * size : Pointer to variable containing the size of the destination. For strings and blobs the number of
+ * bytes read is stored in this variable.
+ *
+ * @return: esp_err_t
+ * Error code returned by the NVS get function.
+ */
+static esp_err_t nvs_get_field(nvs_handle_t handle, const char * key, nvs_field_type type, void * value, size_t * size)
+{
+	esp_err_t _err;
+	uint32_t u32;
+	uint64_t u64;
+
+	switch( type )
+	{
+	case NVS_FIELD_U8: return nvs_get_u8(handle, key, (uint8_t *)value);
+	case NVS_FIELD_I8: return nvs_get_i8(handle, key, (int8_t *)value);
+	case NVS_FIELD_U16: return nvs_get_u16(handle, key, (uint16_t *)value);
+	case NVS_FIELD_I16: return nvs_get_i16(handle, key, (int16_t *)value);
+	case NVS_FIELD_U32: return nvs_get_u32(handle, key, (uint32_t *)value);
+	case NVS_FIELD_I32: return nvs_get_i32(handle, key, (int32_t *)value);
+	case NVS_FIELD_U64: return nvs_get_u64(handle, key, (uint64_t *)value);
+	case NVS_FIELD_I64: return nvs_get_i64(handle, key, (int64_t *)value);
+
+	case NVS_FIELD_FLOAT:
+		_err = nvs_get_u32(handle, key, &u32);
+		if( _err == ESP_OK ) memcpy(value, &u32, sizeof(float));
+		return _err;
+
+	case NVS_FIELD_DOUBLE:
+		_err = nvs_get_u64(handle, key, &u64);
+		if( _err == ESP_OK ) memcpy(value, &u64, sizeof(double));
+		return _err;
+
+	case NVS_FIELD_STRING:
+		return nvs_get_str(handle, key, (char *)value, size);
+
+	case NVS_FIELD_BLOB:
+		return nvs_get_blob(handle, key, value, size);
+	}
+
+	return ESP_ERR_INVALID_ARG;
+}
+
+/*
+ * @brief: This function stores and commits one typed value.
+ *
+ * @param:
+ * 1. const char * namespace : The NVS namespace.
+ * 2. const char * key : The key string.
+ * 3. nvs_field_type type : The type of the value.
+ * 4. const void * value : Pointer to the value.
+ * 5. size_t size : Size of the value in bytes.
+ *
+ * @return: esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed
+ */
+static esp_err_t nvs_store_field(const char * namespace, const char * key, nvs_field_type type, const void * value, size_t size)
+{
+	esp_err_t _err;
+	nvs_handle_t nvs_st;
+
+	nvs_lock_take();
+
+	_err = nvs_cache_get_handle(namespace, NVS_READWRITE, &nvs_st);
+	if( _err == ESP_OK ) _err = nvs_set_field(nvs_st, key, type, value, size);
+	if( _err == ESP_OK ) _err = nvs_cache_commit(nvs_st);
+
+	nvs_lock_give();
+
+	if( _err == ESP_OK ) return _err;
+	else return ESP_FAIL;
+}
+
+/*
+ * @brief: This function reads one typed value.
+ *
+ * @param:
+ * 1. const char * namespace : The NVS namespace.
+ * 2. const char * key : The key string.
+ * 3. nvs_field_type type : The type of the value.
+ * 4. void * value : Pointer to the destination.
+ * 5. size_t * size : Pointer to variable containing the size of the destination.
+ *
+ * @return: esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed
+ */
+static esp_err_t nvs_read_field(const char * namespace, const char * key, nvs_field_type type, void * value, size_t * size)
+{
+	esp_err_t _err;
+	nvs_handle_t nvs_st;
+
+	nvs_lock_take();
+
+	_err = nvs_cache_get_handle(namespace, NVS_READONLY, &nvs_st);
+	if( _err == ESP_OK ) _err = nvs_get_field(nvs_st, key, type, value, size);
+
+	nvs_lock_give();
+
+	if( _err == ESP_OK ) return _err;
+	else return ESP_FAIL;
+}
+
+/**
+ * @brief : These APIs are used to store an integer of the given width in NVS Storage.
+ *
+ * @param:
+ * 1. const char * namespace : The namespace where integer has to stored.
+ * 2. const char * key : The key value.
+ * 3. value : The integer to be stored.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed
+ */
+esp_err_t NVSStoreUInteger8(const char * namespace, const char * key, uint8_t value)
+{
+	return nvs_store_field(namespace, key, NVS_FIELD_U8, &value, sizeof(value));
+}
+
+esp_err_t NVSStoreInteger8(const char * namespace, const char * key, int8_t value)
+{
+	return nvs_store_field(namespace, key, NVS_FIELD_I8, &value, sizeof(value));
+}
+
+esp_err_t NVSStoreUInteger16(const char * namespace, const char * key, uint16_t value)
+{
+	return nvs_store_field(namespace, key, NVS_FIELD_U16, &value, sizeof(value));
+}
+
+esp_err_t NVSStoreInteger16(const char * namespace, const char * key, int16_t value)
+{
+	return nvs_store_field(namespace, key, NVS_FIELD_I16, &value, sizeof(value));
+}
+
+esp_err_t NVSStoreUInteger32(const char * namespace, const char * key, uint32_t value)
+{
+	return nvs_store_field(namespace, key, NVS_FIELD_U32, &value, sizeof(value));
+}
+
+esp_err_t NVSStoreUInteger64(const char * namespace, const char * key, uint64_t value)
+{
+	return nvs_store_field(namespace, key, NVS_FIELD_U64, &value, sizeof(value));
+}
+
+esp_err_t NVSStoreInteger64(const char * namespace, const char * key, int64_t value)
+{
+	return nvs_store_field(namespace, key, NVS_FIELD_I64, &value, sizeof(value));
+}
+
+/**
+ * @brief : These APIs are used to read an integer of the given width from NVS Storage.
+ *
+ * @param:
+ * 1. const char * namespace : The namespace where integer is stored.
+ * 2. const char * key : The key value.
+ * 3. value : Pointer to variable where retrieved integer will be stored.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed
+ */
+esp_err_t NVSReadUInteger8(const char * namespace, const char * key, uint8_t * value)
+{
+	return nvs_read_field(namespace, key, NVS_FIELD_U8, value, NULL);
+}
+
+esp_err_t NVSReadInteger8(const char * namespace, const char * key, int8_t * value)
+{
+	return nvs_read_field(namespace, key, NVS_FIELD_I8, value, NULL);
+}
+
+esp_err_t NVSReadUInteger16(const char * namespace, const char * key, uint16_t * value)
+{
+	return nvs_read_field(namespace, key, NVS_FIELD_U16, value, NULL);
+}
+
+esp_err_t NVSReadInteger16(const char * namespace, const char * key, int16_t * value)
+{
+	return nvs_read_field(namespace, key, NVS_FIELD_I16, value, NULL);
+}
+
+esp_err_t NVSReadUInteger32(const char * namespace, const char * key, uint32_t * value)
+{
+	return nvs_read_field(namespace, key, NVS_FIELD_U32, value, NULL);
+}
+
+esp_err_t NVSReadUInteger64(const char * namespace, const char * key, uint64_t * value)
+{
+	return nvs_read_field(namespace, key, NVS_FIELD_U64, value, NULL);
+}
+
+esp_err_t NVSReadInteger64(const char * namespace, const char * key, int64_t * value)
+{
+	return nvs_read_field(namespace, key, NVS_FIELD_I64, value, NULL);
+}
+
+/**
+ * @brief : These APIs are used to store a float or a double in NVS Storage.
+ *
+ * @param:
+ * 1. const char * namespace : The namespace where the value has to stored.
+ * 2. const char * key : The key value.
+ * 3. value : The value to be stored.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed
+ */
+esp_err_t NVSStoreFloat(const char * namespace, const char * key, float value)
+{
+	return nvs_store_field(namespace, key, NVS_FIELD_FLOAT, &value, sizeof(value));
+}
+
+esp_err_t NVSStoreDouble(const char * namespace, const char * key, double value)
+{
+	return nvs_store_field(namespace, key, NVS_FIELD_DOUBLE, &value, sizeof(value));
+}
+
+/**
+ * @brief : These APIs are used to read a float or a double from NVS Storage.
+ *
+ * @param:
+ * 1. const char * namespace : The namespace where the value is stored.
+ * 2. const char * key : The key value.
+ * 3. value : Pointer to variable where retrieved value will be stored.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed
+ */
+esp_err_t NVSReadFloat(const char * namespace, const char * key, float * value)
+{
+	return nvs_read_field(namespace, key, NVS_FIELD_FLOAT, value, NULL);
+}
+
+esp_err_t NVSReadDouble(const char * namespace, const char * key, double * value)
+{
+	return nvs_read_field(namespace, key, NVS_FIELD_DOUBLE, value, NULL);
+}
+
+/**
+ * @brief : This API is used to store a NULL terminated string in NVS Storage.
+ *
+ * @param:
+ * 1. const char * namespace : The namespace where the string has to stored.
+ * 2. const char * key : The key value.
+ * 3. const char * value : The string to be stored.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed
+ */
+esp_err_t NVSStoreString(const char * namespace, const char * key, const char * value)
+{
+	return nvs_store_field(namespace, key, NVS_FIELD_STRING, value, strlen(value) + 1);
+}
+
+/**
+ * @brief : This API is used to read a NULL terminated string from NVS Storage.
+ *
+ * @param:
+ * 1. const char * namespace : The namespace where the string is stored.
+ * 2. const char * key : The key value.
+ * 3. char * value : Pointer to array where retrieved string will be stored.
+ * 4. size_t * max_length : Pointer to variable containing size of the destination array. If the read operation
+ * is successful then, length of the string including the terminating character is stored in this variable.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed, or the destination array is too small
+ */
+esp_err_t NVSReadString(const char * namespace, const char * key, char * value, size_t * max_length)
+{
+	return nvs_read_field(namespace, key, NVS_FIELD_STRING, value, max_length);
+}
+
+/**
+ * @brief : This API is used to load a structure described by a schema table. All fields are read through one handle.
+ * Fields whose keys do not exist yet keep the value they already have in the structure, so defaults can be set
+ * before loading.
+ *
+ * @param:
+ * 1. const nvs_schema * schema : Pointer to the schema.
+ * 2. void * obj : Pointer to the structure.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed to read a field that exists
+ */
+esp_err_t NVSSchemaLoad(const nvs_schema * schema, void * obj)
+{
+	esp_err_t _err;
+	nvs_handle_t nvs_st;
+
+	nvs_lock_take();
+
+	_err = nvs_cache_get_handle(schema->namespace, NVS_READONLY, &nvs_st);
+	if( _err == ESP_ERR_NVS_NOT_FOUND ){
+		// nothing has been saved in the namespace yet
+		nvs_lock_give();
+		return ESP_OK;
+	}
+
+	for( uint8_t i=0; _err == ESP_OK && i<schema->count; i++ )
+	{
+		const nvs_schema_field * field = &(schema->fields[i]);
+		size_t size = field->size;
+
+		_err = nvs_get_field(nvs_st, field->key, field->type, (uint8_t *)obj + field->offset, &size);
+		if( _err == ESP_ERR_NVS_NOT_FOUND ) _err = ESP_OK;
+		else if( _err == ESP_OK && field->type == NVS_FIELD_I32 )
+			nvs_ram_cache_fill(schema->namespace, field->key, *(int32_t *)((uint8_t *)obj + field->offset));
+	}
+
+	nvs_lock_give();
+
+	if( _err == ESP_OK ) return _err;
+	else return ESP_FAIL;
+}
+
+/**
+ * @brief : This API is used to save a structure described by a schema table. All fields are written through one
+ * handle and committed once.
+ *
+ * @param:
+ * 1. const nvs_schema * schema : Pointer to the schema.
+ * 2. const void * obj : Pointer to the structure.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed
+ */
+esp_err_t NVSSchemaSave(const nvs_schema * schema, const void * obj)
+{
+	esp_err_t _err;
+	nvs_handle_t nvs_st;
+
+	nvs_lock_take();
+
+	_err = nvs_cache_get_handle(schema->namespace, NVS_READWRITE, &nvs_st);
+
+	for( uint8_t i=0; _err == ESP_OK && i<schema->count; i++ )
+	{
+		const nvs_schema_field * field = &(schema->fields[i]);
+		const void * value = (const uint8_t *)obj + field->offset;
+
+		_err = nvs_set_field(nvs_st, field->key, field->type, value, field->size);
+	}
+
+	if( _err == ESP_OK ) _err = nvs_cache_commit(nvs_st);
+
+	// the RAM copies only take the new values once they are committed to flash
+	for( uint8_t i=0; i<schema->count; i++ )
+	{
+		const nvs_schema_field * field = &(schema->fields[i]);
+		if( field->type != NVS_FIELD_I32 ) continue;
+
+		if( _err == ESP_OK ) nvs_ram_cache_fill(schema->namespace, field->key, *(const int32_t *)((const uint8_t *)obj + field->offset));
+		else NVSRamCacheInvalidate(schema->namespace, field->key);
+	}
+
+	nvs_lock_give();
+
+	if( _err == ESP_OK ) return _err;
+	else return ESP_FAIL;
+}
+
+/*
+ * @brief: This function stores a staged transaction entry using an open handle, without committing.
+ *
+ * @param:
+ * 1. nvs_handle_t handle : The namespace handle.
+ * 2. nvs_txn_entry * entry : The entry to store.
+ *
+ * @return: esp_err_t
+ * Error code returned by the NVS set function.
+ */
+static esp_err_t nvs_txn_store_entry(nvs_handle_t handle, nvs_txn_entry * entry)
+{
+	switch( entry->type )
+	{
+	case NVS_TYPE_I32:
+		return nvs_set_i32(handle, entry->key, entry->value.i32);
+
+	case NVS_TYPE_BLOB:
+		return nvs_set_blob(handle, entry->key, entry->value.blob, entry->len);
+
+	default:
+		return ESP_ERR_INVALID_ARG;
+	}
+}
+
+/*
+ * @brief: This function checks whether a key exists in a namespace with any type.
+ *
+ * @param:
+ * 1. nvs_handle_t handle : The namespace handle.
+ * 2. const char * key : The key string.
+ *
+ * @return: uint8_t
+ * 1 the key exists
+ * 0 otherwise
+ */
+static uint8_t nvs_key_exists(nvs_handle_t handle, const char * key)
+{
+	uint64_t value;
+	size_t s;
+
+	for( nvs_field_type type=NVS_FIELD_U8; type<=NVS_FIELD_BLOB; type++ )
+	{
+		// strings and blobs are only measured, not read
+		s = 0;
+		if( nvs_get_field(handle, key, type, ( type >= NVS_FIELD_STRING ) ? NULL : &value, &s) == ESP_OK ) return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * @brief: This function saves the current value of a key so that it can be restored if the transaction fails.
+ * A key that exists with a different type is refused, as restoring it would need a type the transaction does not
+ * stage.
+ *
+ * @param:
+ * 1. nvs_handle_t handle : The namespace handle.
+ * 2. nvs_txn_entry * entry : The staged entry.
+ * 3. nvs_txn_entry * backup : The entry where the previous value will be saved. Its type is left as NVS_TYPE_ANY
+ * if the key does not exist yet.
+ *
+ * @return: esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed
+ */
+static esp_err_t nvs_txn_backup_entry(nvs_handle_t handle, nvs_txn_entry * entry, nvs_txn_entry * backup)
+{
+	esp_err_t _err;
+	size_t s;
+
+	memset(backup, 0, sizeof(nvs_txn_entry));
+	strcpy(backup->key, entry->key);
+	backup->type = NVS_TYPE_ANY;
+
+	switch( entry->type )
+	{
+	case NVS_TYPE_I32:
+		_err = nvs_get_i32(handle, entry->key, &(backup->value.i32));
+		break;
+
+	case NVS_TYPE_BLOB:
+		_err = nvs_get_blob(handle, entry->key, NULL, &s);
+		if( _err != ESP_OK ) break;
+
+		backup->value.blob = (uint8_t *)malloc(s ? s : 1);
+		if( backup->value.blob == NULL ) return ESP_FAIL;
+		backup->len = s;
+
+		_err = nvs_get_blob(handle, entry->key, backup->value.blob, &s);
+		if( _err != ESP_OK ){
+			free(backup->value.blob);
+			backup->value.blob = NULL;
+			return ESP_FAIL;
+		}
+		break;
+
+	default:
+		return ESP_FAIL;
+	}
+
+	if( _err == ESP_ERR_NVS_NOT_FOUND ) return nvs_key_exists(handle, entry->key) ? ESP_FAIL : ESP_OK;
+	if( _err != ESP_OK ) return ESP_FAIL;
+
+	backup->type = entry->type;
+	return ESP_OK;
+}
+
+/*
+ * @brief: This function releases the heap memory held by a staged entry.
+ *
+ * @param:
+ * 1. nvs_txn_entry * entry : The entry.
+ *
+ * @return:
+ * nothing
+ */
+static void nvs_txn_free_entry(nvs_txn_entry * entry)
+{
+	if( entry->type == NVS_TYPE_BLOB ) free(entry->value.blob);
+	memset(entry, 0, sizeof(nvs_txn_entry));
+}
+
+/*
+ * @brief: This function stages an entry into a transaction, replacing an earlier entry with the same key.
+ *
+ * @param:
+ * 1. nvs_transaction * txn : The transaction.
+ * 2. nvs_txn_entry * entry : The entry to stage.
+ *
+ * @return: esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : the transaction is full or was not started
+ */
+static esp_err_t nvs_txn_stage(nvs_transaction * txn, nvs_txn_entry * entry)
+{
+	if( !txn->active ) return ESP_FAIL;
+
+	for( uint8_t i=0; i<txn->count; i++ )
+	{
+		if( !strcmp(txn->entries[i].key, entry->key) )
+		{
+			nvs_txn_free_entry(&(txn->entries[i]));
+			txn->entries[i] = *entry;
+			return ESP_OK;
+		}
+	}
+
+	if( txn->count >= NVS_TXN_MAX_ENTRIES ) return ESP_FAIL;
+
+	txn->entries[txn->count++] = *entry;
+	return ESP_OK;
+}
+
+/**
+ * @brief : This API is used to start a transaction. Writes staged into a transaction are applied together with a
+ * single commit by NVSTransactionCommit().
+ *
+ * @param :
+ * 1. nvs_transaction * txn : Pointer to the transaction object.
+ * 2. const char * namespace : The NVS Namespace where data has to be stored.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed
+ */
+esp_err_t NVSTransactionBegin(nvs_transaction * txn, const char * namespace)
+{
+	if( txn == NULL || namespace == NULL || strlen(namespace) >= NVS_KEY_NAME_MAX_SIZE ) return ESP_FAIL;
+
+	memset(txn, 0, sizeof(nvs_transaction));
+	strcpy(txn->namespace, namespace);
+	txn->active = 1;
+
+	return ESP_OK;
+}
+
+/**
+ * @brief : This API is used to stage a 32 bit signed integer into a transaction.
+ *
+ * @param :
+ * 1. nvs_transaction * txn : Pointer to the transaction object.
+ * 2. const char * key : The key value.
+ * 3. int32_t value : The integer to be stored.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed
+ */
+esp_err_t NVSTransactionSetInteger32(nvs_transaction * txn, const char * key, int32_t value)
+{
+	if( key == NULL || strlen(key) >= NVS_KEY_NAME_MAX_SIZE ) return ESP_FAIL;
+
+	nvs_txn_entry entry = { .type = NVS_TYPE_I32, .value.i32 = value };
+	strcpy(entry.key, key);
+
+	return nvs_txn_stage(txn, &entry);
+}
+
+/**
+ * @brief : This API is used to stage a string of 8 bit values into a transaction. The data is copied, so the caller
+ * may reuse its buffer straight away.
+ *
+ * @param :
+ * 1. nvs_transaction * txn : Pointer to the transaction object.
+ * 2. const char * key : The key string.
+ * 3. uint8_t * value : Pointer to string of 8 bit values that are to be stored.
+ * 4. uint8_t len : The number of values.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed
+ */
+esp_err_t NVSTransactionSetBytes(nvs_transaction * txn, const char * key, uint8_t * value, uint8_t len)
+{
+	return NVSTransactionSetBlob(txn, key, value, (size_t)len);
+}
+
+/**
+ * @brief : This API is used to stage a blob of any size supported by NVS into a transaction. The data is copied.
+ *
+ * @param :
+ * 1. nvs_transaction * txn : Pointer to the transaction object.
+ * 2. const char * key : The key string.
+ * 3. const void * value : Pointer to the data.
+ * 4. size_t len : Number of bytes.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed
+ */
+esp_err_t NVSTransactionSetBlob(nvs_transaction * txn, const char * key, const void * value, size_t len)
+{
+	if( key == NULL || strlen(key) >= NVS_KEY_NAME_MAX_SIZE ) return ESP_FAIL;
+
+	nvs_txn_entry entry = { .type = NVS_TYPE_BLOB, .len = len };
+	strcpy(entry.key, key);
+
+	entry.value.blob = (uint8_t *)malloc(len ? len : 1);
+	if( entry.value.blob == NULL ) return ESP_FAIL;
+	memcpy(entry.value.blob, value, len);
+
+	if( nvs_txn_stage(txn, &entry) != ESP_OK ){
+		free(entry.value.blob);
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+/**
+ * @brief : This API is used to discard a transaction without writing anything.
+ *
+ * @param :
+ * 1. nvs_transaction * txn : Pointer to the transaction object.
+ *
+ * @return :
+ * NOTHING
+ */
+void NVSTransactionAbort(nvs_transaction * txn)
+{
+	for( uint8_t i=0; i<txn->count; i++ )
+	{
+		nvs_txn_free_entry(&(txn->entries[i]));
+	}
+	txn->count = 0;
+	txn->active = 0;
+}
+
+/*
+ * @brief : Previous values of the keys written by the transaction being committed, guarded by the cache lock.
+ */
+static nvs_txn_entry txn_backup[NVS_TXN_MAX_ENTRIES];
+
+/**
+ * @brief : This API is used to write all staged values and commit them once. If any write fails, the keys written
+ * so far are restored to their previous values (or erased if they did not exist) and nothing is left half-saved.
+ * Nothing is written if a staged key already exists with a different type.
+ * The transaction is finished after this call, whatever the outcome.
+ *
+ * @param :
+ * 1. nvs_transaction * txn : Pointer to the transaction object.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed, previous values restored
+ */
+esp_err_t NVSTransactionCommit(nvs_transaction * txn)
+{
+	if( txn == NULL || !txn->active ) return ESP_FAIL;
+
+	esp_err_t _err;
+	nvs_handle_t nvs_st;
+	nvs_txn_entry * backup = txn_backup;
+	uint8_t saved = 0, written = 0;
+
+	int64_t start = esp_timer_get_time();
+
+	nvs_lock_take();
+
+	_err = nvs_cache_get_handle(txn->namespace, NVS_READWRITE, &nvs_st);
+	if( _err != ESP_OK ){
+		nvs_lock_give();
+		NVSTransactionAbort(txn);
+		return ESP_FAIL;
+	}
+
+	// save every previous value before writing anything
+	for( ; saved<txn->count; saved++ )
+	{
+		if( nvs_txn_backup_entry(nvs_st, &(txn->entries[saved]), &backup[saved]) != ESP_OK ){
+			_err = ESP_FAIL;
+			break;
+		}
+	}
+
+	for( ; _err == ESP_OK && written<txn->count; written++ )
+	{
+		if( nvs_txn_store_entry(nvs_st, &(txn->entries[written])) != ESP_OK ){
+			// the failed key may be half written, restore it too
+			written++;
+			_err = ESP_FAIL;
+			break;
+		}
+	}
+
+	if( _err != ESP_OK )
+	{
+		// restore in reverse order, erasing keys that did not exist before the transaction
+		for( int16_t i=written-1; i>=0; i-- )
+		{
+			if( backup[i].type == NVS_TYPE_ANY ) nvs_erase_key(nvs_st, backup[i].key);
+			else nvs_txn_store_entry(nvs_st, &backup[i]);
+		}
+	}
+
+	if( nvs_cache_commit(nvs_st) != ESP_OK ) _err = ESP_FAIL;
+
+	// keep the RAM copies of hot keys in step with flash
+	for( uint8_t i=0; i<txn->count; i++ )
+	{
+		if( txn->entries[i].type != NVS_TYPE_I32 ) continue;
+
+		if( _err == ESP_OK ) nvs_ram_cache_fill(txn->namespace, txn->entries[i].key, txn->entries[i].value.i32);
+		else NVSRamCacheInvalidate(txn->namespace, txn->entries[i].key);
+	}
+
+	for( uint8_t i=0; i<saved; i++ )
+	{
+		nvs_txn_free_entry(&backup[i]);
+	}
+
+	nvs_lock_give();
+
+	txn->commit_time_us = (uint32_t)(esp_timer_get_time() - start);
+
+	NVSTransactionAbort(txn);
+
+	return ( _err == ESP_OK ) ? ESP_OK : ESP_FAIL;
+}
+
+/*
+ * @brief: This function builds the key under which one chunk of a chunked blob is stored.
+ *
+ * @param:
+ * 1. const char * key : The blob key.
+ * 2. uint16_t index : The chunk index.
+ * 3. char * buff : Buffer of NVS_KEY_NAME_MAX_SIZE bytes where the chunk key will be stored.
+ *
+ * The callers check that the key is at most NVS_BLOB_MAX_KEY_LENGTH characters and the index is below
+ * NVS_BLOB_MAX_CHUNKS, so the ".XXX" suffix always fits and two chunk keys never collide.
+ *
+ * @return:
+ * nothing
+ */
+static void nvs_blob_chunk_key(const char * key, uint16_t index, char * buff)
+{
+	static const char digits[] = "0123456789ABCDEF";
+	size_t len = strnlen(key, NVS_BLOB_MAX_KEY_LENGTH);
+
+	memcpy(buff, key, len);
+	buff[len++] = '.';
+	buff[len++] = digits[(index >> 8) & 0X0F];
+	buff[len++] = digits[(index >> 4) & 0X0F];
+	buff[len++] = digits[index & 0X0F];
+	buff[len] = '\0';
+}
+
+/*
+ * @brief: This function writes the buffered bytes of a blob stream as the next chunk.
+ *
+ * @param:
+ * 1. nvs_blob_stream * stream : The stream.
+ *
+ * @return: esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed
+ */
+static esp_err_t nvs_blob_flush_chunk(nvs_blob_stream * stream)
+{
+	esp_err_t _err;
+	nvs_handle_t nvs_st;
+	char chunk_key[NVS_KEY_NAME_MAX_SIZE];
+
+	if( !stream->buffered ) return ESP_OK;
+
+	nvs_blob_chunk_key(stream->key, stream->chunk, chunk_key);
+
+	nvs_lock_take();
+	_err = nvs_cache_get_handle(stream->namespace, NVS_READWRITE, &nvs_st);
+	if( _err == ESP_OK ) _err = nvs_set_blob(nvs_st, chunk_key, stream->buffer, stream->buffered);
+	nvs_lock_give();
+
+	if( _err != ESP_OK ) return ESP_FAIL;
+
+	stream->chunk++;
+	stream->buffered = 0;
+	return ESP_OK;
+}
+
+/*
+ * @brief: This function loads the next chunk of a blob stream into the stream buffer.
+ *
+ * @param:
+ * 1. nvs_blob_stream * stream : The stream.
+ *
+ * @return: esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed
+ */
+static esp_err_t nvs_blob_load_chunk(nvs_blob_stream * stream)
+{
+	esp_err_t _err;
+	nvs_handle_t nvs_st;
+	char chunk_key[NVS_KEY_NAME_MAX_SIZE];
+	size_t s = NVS_BLOB_CHUNK_SIZE;
+
+	nvs_blob_chunk_key(stream->key, stream->chunk, chunk_key);
+
+	nvs_lock_take();
+	_err = nvs_cache_get_handle(stream->namespace, NVS_READONLY, &nvs_st);
+	if( _err == ESP_OK ) _err = nvs_get_blob(nvs_st, chunk_key, stream->buffer, &s);
+	nvs_lock_give();
+
+	if( _err != ESP_OK || s == 0 ) return ESP_FAIL;
+
+	stream->chunk++;
+	stream->buffered = s;
+	stream->position = 0;
+	return ESP_OK;
+}
+
+/*
+ * @brief: This function reads the header of a chunked blob.
+ *
+ * @param:
+ * 1. const char * namespace : The NVS Namespace.
+ * 2. const char * key : The blob key.
+ * 3. nvs_blob_header * header : Pointer to structure where the header will be stored.
+ *
+ * @return: esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : the key does not hold a chunked blob
+ */
+static esp_err_t nvs_blob_read_header(const char * namespace, const char * key, nvs_blob_header * header)
+{
+	size_t s = sizeof(nvs_blob_header);
+
+	if( NVSReadBlob(namespace, key, header, &s) != ESP_OK ) return ESP_FAIL;
+	if( s != sizeof(nvs_blob_header) || header->magic != NVS_BLOB_MAGIC ) return ESP_FAIL;
+
+	return ESP_OK;
+}
+
+/*
+ * @brief: This function validates the namespace and key of a chunked blob and resets the stream.
+ *
+ * @param:
+ * 1. nvs_blob_stream * stream : The stream.
+ * 2. const char * namespace : The NVS Namespace.
+ * 3. const char * key : The blob key.
+ *
+ * @return: esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : invalid arguments
+ */
+static esp_err_t nvs_blob_stream_init(nvs_blob_stream * stream, const char * namespace, const char * key)
+{
+	if( stream == NULL || namespace == NULL || key == NULL ) return ESP_FAIL;
+	if( strlen(namespace) >= NVS_KEY_NAME_MAX_SIZE || strlen(key) > NVS_BLOB_MAX_KEY_LENGTH ) return ESP_FAIL;
+
+	memset(stream, 0, sizeof(nvs_blob_stream));
+	strcpy(stream->namespace, namespace);
+	strcpy(stream->key, key);
+
+	return ESP_OK;
+}
+
+/**
+ * @brief : This API is used to start writing a chunked blob. Chunked blobs are spread over several keys of
+ * NVS_BLOB_CHUNK_SIZE bytes each, so values of several KB can be written and read in pieces without one large
+ * buffer. The value becomes visible only after NVSBlobWriteEnd() succeeds.
+ *
+ * @param :
+ * 1. nvs_blob_stream * stream : Pointer to the stream object.
+ * 2. const char * namespace : The NVS Namespace where data has to be stored.
+ * 3. const char * key : The key string, at most NVS_BLOB_MAX_KEY_LENGTH characters.
+ * 4. size_t total_len : Total number of bytes that will be written.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed
+ */
+esp_err_t NVSBlobWriteBegin(nvs_blob_stream * stream, const char * namespace, const char * key, size_t total_len)
+{
+	esp_err_t _err;
+	nvs_handle_t nvs_st;
+	nvs_blob_header header;
+
+	if( nvs_blob_stream_init(stream, namespace, key) != ESP_OK ) return ESP_FAIL;
+	if( total_len > (size_t)NVS_BLOB_CHUNK_SIZE * NVS_BLOB_MAX_CHUNKS ) return ESP_FAIL;
+
+	// remember how many chunks the previous value had, so that stale ones can be erased at the end
+	if( nvs_blob_read_header(namespace, key, &header) == ESP_OK ) stream->old_chunks = header.chunks;
+
+	// drop the header first, so a partially written value is never read back as valid
+	nvs_lock_take();
+	_err = nvs_cache_get_handle(namespace, NVS_READWRITE, &nvs_st);
+	if( _err == ESP_OK ){
+		_err = nvs_erase_key(nvs_st, key);
+		if( _err == ESP_ERR_NVS_NOT_FOUND ) _err = ESP_OK;
+	}
+	nvs_lock_give();
+
+	if( _err != ESP_OK ) return ESP_FAIL;
+
+	stream->total = total_len;
+	stream->writing = 1;
+	return ESP_OK;
+}
+
+/**
+ * @brief : This API is used to append data to a chunked blob.
+ *
+ * @param :
+ * 1. nvs_blob_stream * stream : Pointer to the stream object.
+ * 2. const void * data : Pointer to the data.
+ * 3. size_t len : Number of bytes.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed, or more data than announced in NVSBlobWriteBegin()
+ */
+esp_err_t NVSBlobWrite(nvs_blob_stream * stream, const void * data, size_t len)
+{
+	const uint8_t * src = (const uint8_t *)data;
+
+	if( !stream->writing || stream->offset + len > stream->total ) return ESP_FAIL;
+
+	while( len )
+	{
+		size_t n = NVS_BLOB_CHUNK_SIZE - stream->buffered;
+		if( n > len ) n = len;
+
+		memcpy(stream->buffer + stream->buffered, src, n);
+		stream->buffered += n;
+		stream->offset += n;
+		src += n;
+		len -= n;
+
+		if( stream->buffered == NVS_BLOB_CHUNK_SIZE && nvs_blob_flush_chunk(stream) != ESP_OK ){
+			stream->writing = 0;
+			return ESP_FAIL;
+		}
+	}
+
+	return ESP_OK;
+}
+
+/**
+ * @brief : This API is used to finish writing a chunked blob. It writes the header, erases chunks left over from
+ * a longer previous value and commits once.
+ *
+ * @param :
+ * 1. nvs_blob_stream * stream : Pointer to the stream object.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed, or fewer bytes written than announced in NVSBlobWriteBegin()
+ */
+esp_err_t NVSBlobWriteEnd(nvs_blob_stream * stream)
+{
+	esp_err_t _err;
+	nvs_handle_t nvs_st;
+	char chunk_key[NVS_KEY_NAME_MAX_SIZE];
+
+	if( !stream->writing ) return ESP_FAIL;
+	stream->writing = 0;
+
+	if( stream->offset != stream->total ) return ESP_FAIL;
+	if( nvs_blob_flush_chunk(stream) != ESP_OK ) return ESP_FAIL;
+
+	nvs_blob_header header = { .magic = NVS_BLOB_MAGIC, .length = stream->total, .chunks = stream->chunk };
+
+	nvs_lock_take();
+	_err = nvs_cache_get_handle(stream->namespace, NVS_READWRITE, &nvs_st);
+	if( _err == ESP_OK ) _err = nvs_set_blob(nvs_st, stream->key, &header, sizeof(nvs_blob_header));
+	if( _err == ESP_OK )
+	{
+		for( uint16_t i=stream->chunk; i<stream->old_chunks; i++ )
+		{
+			nvs_blob_chunk_key(stream->key, i, chunk_key);
+			nvs_erase_key(nvs_st, chunk_key);
+		}
+		_err = nvs_cache_commit(nvs_st);
+	}
+	nvs_lock_give();
+
+	if( _err == ESP_OK ) return _err;
+	else return ESP_FAIL;
+}
+
+/**
+ * @brief : This API is used to start reading a chunked blob.
+ *
+ * @param :
+ * 1. nvs_blob_stream * stream : Pointer to the stream object.
+ * 2. const char * namespace : The NVS Namespace where data is stored.
+ * 3. const char * key : The key string.
+ * 4. size_t * total_len : Pointer to variable where the total size of the blob will be stored. May be NULL.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed, or the key does not hold a chunked blob
+ */
+esp_err_t NVSBlobReadBegin(nvs_blob_stream * stream, const char * namespace, const char * key, size_t * total_len)
+{
+	nvs_blob_header header;
+
+	if( nvs_blob_stream_init(stream, namespace, key) != ESP_OK ) return ESP_FAIL;
+	if( nvs_blob_read_header(namespace, key, &header) != ESP_OK ) return ESP_FAIL;
+
+	stream->total = header.length;
+	stream->old_chunks = header.chunks;
+
+	if( total_len != NULL ) *total_len = header.length;
+	return ESP_OK;
+}
+
+/**
+ * @brief : This API is used to read the next part of a chunked blob into a caller buffer.
+ *
+ * @param :
+ * 1. nvs_blob_stream * stream : Pointer to the stream object.
+ * 2. void * buff : Pointer to the destination buffer.
+ * 3. size_t * len : Pointer to variable containing the size of the buffer. The number of bytes read is stored in
+ * this variable; it is 0 once the whole blob has been read.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed
+ */
+esp_err_t NVSBlobRead(nvs_blob_stream * stream, void * buff, size_t * len)
+{
+	uint8_t * dst = (uint8_t *)buff;
+	size_t done = 0;
+
+	while( done < *len && stream->offset < stream->total )
+	{
+		if( stream->position == stream->buffered )
+		{
+			if( stream->chunk >= stream->old_chunks || nvs_blob_load_chunk(stream) != ESP_OK ){
+				*len = done;
+				return ESP_FAIL;
+			}
+		}
+
+		size_t n = stream->buffered - stream->position;
+		if( n > *len - done ) n = *len - done;
+
+		memcpy(dst + done, stream->buffer + stream->position, n);
+		stream->position += n;
+		stream->offset += n;
+		done += n;
+	}
+
+	*len = done;
+	return ESP_OK;
+}
+
+/**
+ * @brief : This API is used to erase a chunked blob and all of its chunks.
+ *
+ * @param :
+ * 1. const char * namespace : The NVS Namespace where data is stored.
+ * 2. const char * key : The key string.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : failed
+ */
+esp_err_t NVSBlobErase(const char * namespace, const char * key)
+{
+	esp_err_t _err;
+	nvs_handle_t nvs_st;
+	nvs_blob_header header;
+	char chunk_key[NVS_KEY_NAME_MAX_SIZE];
+
+	if( key == NULL || strlen(key) > NVS_BLOB_MAX_KEY_LENGTH ) return ESP_FAIL;
+	if( nvs_blob_read_header(namespace, key, &header) != ESP_OK ) return ESP_FAIL;
+
+	nvs_lock_take();
+	_err = nvs_cache_get_handle(namespace, NVS_READWRITE, &nvs_st);
+	if( _err == ESP_OK )
+	{
+		_err = nvs_erase_key(nvs_st, key);
+		for( uint16_t i=0; i<header.chunks; i++ )
+		{
+			nvs_blob_chunk_key(key, i, chunk_key);
+			nvs_erase_key(nvs_st, chunk_key);
+		}
+		if( _err == ESP_OK ) _err = nvs_cache_commit(nvs_st);
+	}
+	nvs_lock_give();
+
+	if( _err == ESP_OK ) return _err;
+	else return ESP_FAIL;
+}
+
+/**
+ * @brief : This API is used to register a 32 bit integer key as a hot key. Reads of hot keys through
+ * NVSReadInteger32() are served from RAM, and writes through util_nvs update the RAM copy. The current value is
+ * loaded straight away, so keys should be registered after the NVS storage is initialized.
+ *
+ * @param :
+ * 1. const char * namespace : The namespace where the integer is stored.
+ * 2. const char * key : The key value.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success, the key may not exist in flash yet
+ * ESP_FAIL : invalid arguments or the cache is full
+ */
+esp_err_t NVSRamCacheRegister(const char * namespace, const char * key)
+{
+	int32_t value;
+
+	if( namespace == NULL || key == NULL ) return ESP_FAIL;
+	if( strlen(namespace) >= NVS_KEY_NAME_MAX_SIZE || strlen(key) >= NVS_KEY_NAME_MAX_SIZE ) return ESP_FAIL;
+
+	portENTER_CRITICAL(&ram_cache_mux);
+	nvs_ram_cache_entry * entry = nvs_ram_cache_find(namespace, key, 1);
+	if( entry != NULL && !entry->registered )
+	{
+		strcpy(entry->namespace, namespace);
+		strcpy(entry->key, key);
+		entry->valid = 0;
+		entry->registered = 1;
+	}
+	portEXIT_CRITICAL(&ram_cache_mux);
+
+	if( entry == NULL ) return ESP_FAIL;
+
+	// the read fills the RAM copy
+	NVSReadInteger32(namespace, key, &value);
+
+	return ESP_OK;
+}
+
+/**
+ * @brief : This API is used to drop the RAM copy of a hot key, so that the next read goes to flash. It must be
+ * called when the key is changed without going through util_nvs.
+ *
+ * @param :
+ * 1. const char * namespace : The namespace where the integer is stored.
+ * 2. const char * key : The key value.
+ *
+ * @return :
+ * NOTHING
+ */
+void NVSRamCacheInvalidate(const char * namespace, const char * key)
+{
+	portENTER_CRITICAL(&ram_cache_mux);
+	nvs_ram_cache_entry * entry = nvs_ram_cache_find(namespace, key, 0);
+	if( entry != NULL ) entry->valid = 0;
+	portEXIT_CRITICAL(&ram_cache_mux);
+}
+
+/**
+ * @brief : This API is used to drop the RAM copies of all hot keys.
+ *
+ * @param :
+ * NONE
+ *
+ * @return :
+ * NOTHING
+ */
+void NVSRamCacheInvalidateAll(void)
+{
+	portENTER_CRITICAL(&ram_cache_mux);
+	for( uint16_t i=0; i<NVS_RAM_CACHE_SIZE; i++ )
+	{
+		ram_cache[i].valid = 0;
+	}
+	portEXIT_CRITICAL(&ram_cache_mux);
+}
+
+/**
+ * @brief : This API is used to read the hit and miss counters of NVSReadInteger32().
+ *
+ * @param :
+ * 1. nvs_ram_cache_stats * stats : Pointer to structure where the counters will be stored.
+ *
+ * @return :
+ * NOTHING
+ */
+void NVSGetRamCacheStats(nvs_ram_cache_stats * stats)
+{
+	portENTER_CRITICAL(&ram_cache_mux);
+	*stats = ram_cache_stats;
+	portEXIT_CRITICAL(&ram_cache_mux);
+}
+
+/*
+ * @brief : Keys that are carried over when the NVS storage has to be re-created.
+ */
+static nvs_migration_key migration_keys[NVS_MIGRATION_MAX_KEYS];
+
+static uint8_t migration_key_count = 0;
+
+/*
+ * @brief: This function updates a CRC-32 (IEEE 802.3) over a block of data.
+ *
+ * @param:
+ * 1. uint32_t crc : The CRC of the preceding data, 0 for the first block.
+ * 2. const void * data : Pointer to the data.
+ * 3. size_t len : Number of bytes.
+ *
+ * @return: uint32_t
+ * The updated CRC.
+ */
+static uint32_t nvs_crc32(uint32_t crc, const void * data, size_t len)
+{
+	const uint8_t * p = (const uint8_t *)data;
+
+	crc = ~crc;
+	while( len-- )
+	{
+		crc ^= *p++;
+		for( uint8_t k=0; k<8; k++ ) crc = (crc >> 1) ^ (0XEDB88320 & (0 - (crc & 1)));
+	}
+	return ~crc;
+}
+
+/*
+ * @brief: This function initializes the NVS storage in the mode it was last initialized in, using the cached keys
+ * when encryption is in use.
+ *
+ * @param:
+ * none
+ *
+ * @return: esp_err_t
+ * Error code returned by the NVS flash init API.
+ */
+static esp_err_t nvs_flash_init_current(void)
+{
+#ifdef CONFIG_NVS_ENCRYPTION
+	if( nvs_security_loaded )
+	{
+		esp_err_t _err = nvs_flash_secure_init(&nvs_security_cfg);
+		if( _err == ESP_OK ) nvs_encrypted = 1;
+		return _err;
+	}
+#endif
+	return nvs_flash_init();
+}
+
+/*
+ * @brief: This function returns the number of bytes a fixed size field occupies.
+ *
+ * @param:
+ * 1. nvs_field_type type : The field type.
+ *
+ * @return: size_t
+ * Size in bytes, 0 for strings and blobs.
+ */
+static size_t nvs_field_size(nvs_field_type type)
+{
+	switch( type )
+	{
+	case NVS_FIELD_U8: case NVS_FIELD_I8: return 1;
+	case NVS_FIELD_U16: case NVS_FIELD_I16: return 2;
+	case NVS_FIELD_U32: case NVS_FIELD_I32: case NVS_FIELD_FLOAT: return 4;
+	case NVS_FIELD_U64: case NVS_FIELD_I64: case NVS_FIELD_DOUBLE: return 8;
+	default: return 0;
+	}
+}
+
+/*
+ * @brief: This function compares data with the bytes stored at an offset of a partition, a few bytes at a time.
+ *
+ * @param:
+ * 1. const esp_partition_t * part : The partition.
+ * 2. uint32_t offset : Offset of the stored bytes.
+ * 3. const void * data : Pointer to the data.
+ * 4. size_t len : Number of bytes.
+ *
+ * @return: uint8_t
+ * 1 the stored bytes are equal to the data
+ * 0 otherwise
+ */
+static uint8_t nvs_migration_compare(const esp_partition_t * part, uint32_t offset, const void * data, size_t len)
+{
+	uint8_t stored[32];
+	const uint8_t * p = (const uint8_t *)data;
+
+	while( len )
+	{
+		size_t n = ( len > sizeof(stored) ) ? sizeof(stored) : len;
+
+		if( esp_partition_read(part, offset, stored, n) != ESP_OK ) return 0;
+		if( memcmp(stored, p, n) ) return 0;
+
+		offset += n;
+		p += n;
+		len -= n;
+	}
+	return 1;
+}
+
+/*
+ * @brief: This function walks the registered keys and serializes them one record at a time. With a NULL partition
+ * only the header (length, count and CRC) is computed. In compare mode the records are compared with the ones
+ * stored in the partition instead of being written, so that an unchanged snapshot is never erased.
+ *
+ * @param:
+ * 1. const esp_partition_t * part : The backup partition, or NULL.
+ * 2. uint32_t limit : Number of erased bytes available in the partition.
+ * 3. uint8_t compare : 1 to compare with the stored records, 0 to write them.
+ * 4. nvs_migration_header * header : Pointer to the header that will be filled in.
+ * 5. uint16_t * skipped : Pointer to variable where the number of values larger than NVS_MIGRATION_MAX_VALUE_SIZE
+ * (or unreadable) is stored. These keys are not in the snapshot.
+ *
+ * @return: esp_err_t
+ * ESP_OK : success, or equal in compare mode
+ * ESP_ERR_INVALID_STATE : the stored records differ, in compare mode
+ * ESP_ERR_NO_MEM : the records do not fit in the erased area
+ * Error code returned by the partition API otherwise.
+ */
+static esp_err_t nvs_migration_walk(const esp_partition_t * part, uint32_t limit, uint8_t compare, nvs_migration_header * header, uint16_t * skipped)
+{
+	esp_err_t _err;
+	nvs_handle_t nvs_st;
+	uint8_t value[NVS_MIGRATION_MAX_VALUE_SIZE];
+	uint32_t offset = sizeof(nvs_migration_header);
+
+	memset(header, 0, sizeof(nvs_migration_header));
+	*skipped = 0;
+
+	for( uint8_t i=0; i<migration_key_count; i++ )
+	{
+		nvs_migration_key * entry = &migration_keys[i];
+		size_t size = nvs_field_size(entry->type);
+		if( !size ) size = NVS_MIGRATION_MAX_VALUE_SIZE;
+
+		nvs_lock_take();
+		_err = nvs_cache_get_handle(entry->namespace, NVS_READONLY, &nvs_st);
+		if( _err == ESP_OK ) _err = nvs_get_field(nvs_st, entry->key, entry->type, value, &size);
+		nvs_lock_give();
+
+		// keys that were never written are simply not carried over, larger values are counted as skipped
+		if( _err == ESP_ERR_NVS_NOT_FOUND ) continue;
+		if( _err != ESP_OK ){
+			(*skipped)++;
+			continue;
+		}
+
+		nvs_migration_record record = { .namespace_len = strlen(entry->namespace), .key_len = strlen(entry->key), .type = entry->type, .value_len = size };
+
+		header->crc = nvs_crc32(header->crc, &record, sizeof(record));
+		header->crc = nvs_crc32(header->crc, entry->namespace, record.namespace_len);
+		header->crc = nvs_crc32(header->crc, entry->key, record.key_len);
+		header->crc = nvs_crc32(header->crc, value, size);
+
+		if( part != NULL && offset + sizeof(record) + record.namespace_len + record.key_len + size > limit )
+			return compare ? ESP_ERR_INVALID_STATE : ESP_ERR_NO_MEM;
+
+		if( part != NULL && compare )
+		{
+			uint32_t o = offset;
+			if( !nvs_migration_compare(part, o, &record, sizeof(record)) ) return ESP_ERR_INVALID_STATE;
+			o += sizeof(record);
+			if( !nvs_migration_compare(part, o, entry->namespace, record.namespace_len) ) return ESP_ERR_INVALID_STATE;
+			o += record.namespace_len;
+			if( !nvs_migration_compare(part, o, entry->key, record.key_len) ) return ESP_ERR_INVALID_STATE;
+			o += record.key_len;
+			if( !nvs_migration_compare(part, o, value, size) ) return ESP_ERR_INVALID_STATE;
+		}
+		else if( part != NULL )
+		{
+			_err = esp_partition_write(part, offset, &record, sizeof(record));
+			if( _err == ESP_OK ) _err = esp_partition_write(part, offset + sizeof(record), entry->namespace, record.namespace_len);
+			if( _err == ESP_OK ) _err = esp_partition_write(part, offset + sizeof(record) + record.namespace_len, entry->key, record.key_len);
+			if( _err == ESP_OK ) _err = esp_partition_write(part, offset + sizeof(record) + record.namespace_len + record.key_len, value, size);
+			if( _err != ESP_OK ) return _err;
+		}
+
+		offset += sizeof(record) + record.namespace_len + record.key_len + size;
+		header->count++;
+	}
+
+	header->magic = NVS_MIGRATION_MAGIC;
+	header->length = offset - sizeof(nvs_migration_header);
+	return ESP_OK;
+}
+
+/*
+ * @brief: This function reads the next record of a snapshot.
+ *
+ * @param:
+ * 1. const esp_partition_t * part : The backup partition.
+ * 2. uint32_t * offset : Pointer to the read offset, advanced past the record.
+ * 3. nvs_migration_record * record : Pointer to the record header.
+ * 4. char * namespace : Buffer of NVS_KEY_NAME_MAX_SIZE bytes for the namespace.
+ * 5. char * key : Buffer of NVS_KEY_NAME_MAX_SIZE bytes for the key.
+ * 6. uint8_t * value : Buffer of NVS_MIGRATION_MAX_VALUE_SIZE bytes for the value.
+ *
+ * @return: esp_err_t
+ * ESP_OK : success
+ * ESP_ERR_INVALID_SIZE : the record is malformed
+ * Error code returned by the partition API otherwise.
+ */
+static esp_err_t nvs_migration_read_record(const esp_partition_t * part, uint32_t * offset, nvs_migration_record * record, char * namespace, char * key, uint8_t * value)
+{
+	esp_err_t _err = esp_partition_read(part, *offset, record, sizeof(nvs_migration_record));
+	if( _err != ESP_OK ) return _err;
+
+	if( record->namespace_len >= NVS_KEY_NAME_MAX_SIZE || record->key_len >= NVS_KEY_NAME_MAX_SIZE ) return ESP_ERR_INVALID_SIZE;
+	if( record->value_len > NVS_MIGRATION_MAX_VALUE_SIZE ) return ESP_ERR_INVALID_SIZE;
+
+	*offset += sizeof(nvs_migration_record);
+	memset(namespace, 0, NVS_KEY_NAME_MAX_SIZE);
+	memset(key, 0, NVS_KEY_NAME_MAX_SIZE);
+
+	_err = esp_partition_read(part, *offset, namespace, record->namespace_len);
+	if( _err == ESP_OK ) _err = esp_partition_read(part, *offset + record->namespace_len, key, record->key_len);
+	if( _err == ESP_OK ) _err = esp_partition_read(part, *offset + record->namespace_len + record->key_len, value, record->value_len);
+
+	*offset += record->namespace_len + record->key_len + record->value_len;
+	return _err;
+}
+
+/*
+ * @brief: This function writes the snapshot back into a freshly initialized NVS storage. The snapshot is verified
+ * against its CRC before anything is written. Only one record is held in RAM at a time.
+ *
+ * @param:
+ * 1. const esp_partition_t * part : The backup partition.
+ * 2. nvs_migration_report * report : Pointer to the report, restored and failed counts are updated.
+ *
+ * @return: esp_err_t
+ * ESP_OK : success
+ * ESP_ERR_NOT_FOUND : no valid snapshot
+ * ESP_ERR_INVALID_CRC : the snapshot is corrupted
+ */
+static esp_err_t nvs_migration_restore(const esp_partition_t * part, nvs_migration_report * report)
+{
+	esp_err_t _err;
+	nvs_handle_t nvs_st;
+	nvs_migration_header header;
+	nvs_migration_record record;
+	char namespace[NVS_KEY_NAME_MAX_SIZE];
+	char key[NVS_KEY_NAME_MAX_SIZE];
+	uint8_t value[NVS_MIGRATION_MAX_VALUE_SIZE];
+	uint32_t offset, crc = 0;
+
+	if( esp_partition_read(part, 0, &header, sizeof(header)) != ESP_OK ) return ESP_ERR_NOT_FOUND;
+	if( header.magic != NVS_MIGRATION_MAGIC || header.length > part->size - sizeof(header) ) return ESP_ERR_NOT_FOUND;
+
+	// verification pass
+	offset = sizeof(header);
+	for( uint16_t i=0; i<header.count; i++ )
+	{
+		_err = nvs_migration_read_record(part, &offset, &record, namespace, key, value);
+		if( _err != ESP_OK ) return ESP_ERR_INVALID_CRC;
+
+		crc = nvs_crc32(crc, &record, sizeof(record));
+		crc = nvs_crc32(crc, namespace, record.namespace_len);
+		crc = nvs_crc32(crc, key, record.key_len);
+		crc = nvs_crc32(crc, value, record.value_len);
+	}
+	if( crc != header.crc || offset - sizeof(header) != header.length ) return ESP_ERR_INVALID_CRC;
+
+	// restore pass
+	offset = sizeof(header);
+	for( uint16_t i=0; i<header.count; i++ )
+	{
+		_err = nvs_migration_read_record(part, &offset, &record, namespace, key, value);
+		if( _err != ESP_OK ) return _err;
+
+		nvs_lock_take();
+		_err = nvs_cache_get_handle(namespace, NVS_READWRITE, &nvs_st);
+		if( _err == ESP_OK ) _err = nvs_set_field(nvs_st, key, (nvs_field_type)record.type, value, record.value_len);
+		nvs_lock_give();
+
+		if( _err == ESP_OK ) report->restored++;
+		else report->failed++;
+	}
+
+	return NVSFlush();
+}
+
+/**
+ * @brief : This API is used to register a key that has to survive a re-creation of the NVS storage. Registered keys
+ * are copied to the 'NVS_MIGRATION_PARTITION' partition by InitializeNVSWithMigration() and NVSMigrationSnapshot().
+ * When NVS encryption is used the backup partition should be marked encrypted, or secrets should not be registered.
+ *
+ * @param :
+ * 1. const char * namespace : The namespace of the key.
+ * 2. const char * key : The key string.
+ * 3. nvs_field_type type : The type the key was stored with.
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_FAIL : invalid arguments or too many keys registered
+ */
+esp_err_t NVSMigrationRegister(const char * namespace, const char * key, nvs_field_type type)
+{
+	if( namespace == NULL || key == NULL ) return ESP_FAIL;
+	if( strlen(namespace) >= NVS_KEY_NAME_MAX_SIZE || strlen(key) >= NVS_KEY_NAME_MAX_SIZE ) return ESP_FAIL;
+	if( migration_key_count >= NVS_MIGRATION_MAX_KEYS ) return ESP_FAIL;
+
+	nvs_migration_key * entry = &migration_keys[migration_key_count++];
+	strcpy(entry->namespace, namespace);
+	strcpy(entry->key, key);
+	entry->type = type;
+
+	return ESP_OK;
+}
+
+/*
+ * @brief: This function copies the registered keys to the backup partition, unless the stored snapshot already
+ * holds exactly the same records.
+ *
+ * @param:
+ * 1. uint16_t * skipped : Pointer to variable where the number of keys left out of the snapshot is stored.
+ *
+ * @return: esp_err_t
+ * See NVSMigrationSnapshot().
+ */
+static esp_err_t nvs_migration_snapshot(uint16_t * skipped)
+{
+	esp_err_t _err;
+	nvs_migration_header current, stored;
+
+	*skipped = 0;
+
+	const esp_partition_t * part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, NVS_MIGRATION_PARTITION);
+	if( part == NULL ) return ESP_ERR_NOT_FOUND;
+
+	nvs_migration_walk(NULL, 0, 0, &current, skipped);
+
+	_err = esp_partition_read(part, 0, &stored, sizeof(stored));
+	if( _err != ESP_OK ) return _err;
+
+	// a matching header is only a hint, the records themselves are compared before anything is erased
+	if( !memcmp(&current, &stored, sizeof(current)) && nvs_migration_walk(part, part->size, 1, &current, skipped) == ESP_OK )
+		return ( *skipped ) ? ESP_ERR_NVS_INVALID_LENGTH : ESP_OK;
+
+	uint32_t limit = (sizeof(current) + current.length + SPI_FLASH_SEC_SIZE - 1) & ~(SPI_FLASH_SEC_SIZE - 1);
+	if( limit > part->size ) return ESP_ERR_NO_MEM;
+
+	_err = esp_partition_erase_range(part, 0, limit);
+	if( _err != ESP_OK ) return _err;
+
+	_err = nvs_migration_walk(part, limit, 0, &current, skipped);
+	if( _err != ESP_OK ) return _err;
+
+	// the header goes last, so an interrupted snapshot is never taken as valid
+	_err = esp_partition_write(part, 0, &current, sizeof(current));
+	if( _err != ESP_OK ) return _err;
+
+	return ( *skipped ) ? ESP_ERR_NVS_INVALID_LENGTH : ESP_OK;
+}
+
+/**
+ * @brief : This API is used to copy the registered keys to the backup partition. The partition is only erased and
+ * rewritten when the stored records differ from the current values.
+ *
+ * @param :
+ * NONE
+ *
+ * @return - esp_err_t
+ * ESP_OK : success
+ * ESP_ERR_NOT_FOUND : there is no backup partition
+ * ESP_ERR_NO_MEM : the registered keys do not fit in the backup partition
+ * ESP_ERR_NVS_INVALID_LENGTH : the snapshot was taken, but at least one string or blob is larger than
+ * NVS_MIGRATION_MAX_VALUE_SIZE and was left out
+ * Error code returned by the partition API otherwise.
+ */
+esp_err_t NVSMigrationSnapshot(void)
+{
+	uint16_t skipped;
+	return nvs_migration_snapshot(&skipped);
+}
+
+/**
+ * @brief : This API is used to initialize the NVS storage without aborting. If the storage can not be loaded
+ * because it has no free pages or was written by a newer NVS version, it is erased, re-initialized and the keys
+ * registered with NVSMigrationRegister() are restored from the last snapshot. On a normal boot the snapshot is
+ * refreshed instead; the report then holds the result of the refresh and the number of keys too large to be
+ * carried over. Call InitializeSecureNVS() first to use encryption.
+ *
+ * @param
+ * 1. nvs_migration_report * report : Pointer to structure where the outcome is stored. May be NULL.
+ *
+ * @return - esp_err_t
+ * ESP_OK : the storage is usable
+ * Error code returned by the NVS flash APIs otherwise.
+ */
+esp_err_t InitializeNVSWithMigration(nvs_migration_report * report)
+{
+	esp_err_t _err;
+	nvs_migration_report r = { 0 };
+
+	if( report == NULL ) report = &r;
+	memset(report, 0, sizeof(nvs_migration_report));
+
+	int64_t start = esp_timer_get_time();
+
+	nvs_lock_create();
+
+	_err = nvs_flash_init_current();
+	if( _err == ESP_OK )
+	{
+		report->snapshot = nvs_migration_snapshot(&(report->skipped));
+		report->elapsed_us = (uint32_t)(esp_timer_get_time() - start);
+		return ESP_OK;
+	}
+	if( _err != ESP_ERR_NVS_NO_FREE_PAGES && _err != ESP_ERR_NVS_NEW_VERSION_FOUND ) return _err;
+
+	report->migrated = 1;
+	report->cause = _err;
+
+	NVSCloseAll();
+	NVSRamCacheInvalidateAll();
+
+	_err = nvs_flash_erase();
+	if( _err == ESP_OK ) _err = nvs_flash_init_current();
+	if( _err != ESP_OK ) return _err;
+
+	const esp_partition_t * part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, NVS_MIGRATION_PARTITION);
+	if( part != NULL ) nvs_migration_restore(part, report);
+
+	report->elapsed_us = (uint32_t)(esp_timer_get_time() - start);
+
+	return ESP_OK;
+}
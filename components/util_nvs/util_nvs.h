@@ -9,18 +9,209 @@
 #ifndef COMPONENTS_UTIL_NVS_UTIL_NVS_H_
 #define COMPONENTS_UTIL_NVS_UTIL_NVS_H_
 
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include "sdkconfig.h"
 #include "nvs_flash.h"
+#include "esp_partition.h"
+#include "esp_spi_flash.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
+/*
+ * @brief : Maximum number of namespace handles kept open by util_nvs.
+ */
+#define NVS_MAX_CACHED_HANDLES 8
+
+/*
+ * @brief : Maximum number of keys that can be staged in one transaction.
+ */
+#define NVS_TXN_MAX_ENTRIES 24
+
+/*
+ * @brief : Number of bytes stored in each key of a chunked blob.
+ */
+#define NVS_BLOB_CHUNK_SIZE 1024
+
+/*
+ * @brief : Maximum number of chunks in a chunked blob.
+ */
+#define NVS_BLOB_MAX_CHUNKS 4096
+
+/*
+ * @brief : Maximum key length of a chunked blob, chunk keys append a ".XXX" suffix to it.
+ */
+#define NVS_BLOB_MAX_KEY_LENGTH (NVS_KEY_NAME_MAX_SIZE - 5)
+
+#define NVS_BLOB_MAGIC 0X424C4F42
+
+typedef struct nvs_blob_header { uint32_t magic; uint32_t length; uint16_t chunks; }nvs_blob_header;
+
+typedef struct nvs_blob_stream { char namespace[NVS_KEY_NAME_MAX_SIZE]; char key[NVS_KEY_NAME_MAX_SIZE]; size_t total; size_t offset; uint16_t chunk; uint16_t old_chunks; uint8_t writing; size_t buffered; size_t position; uint8_t buffer[NVS_BLOB_CHUNK_SIZE]; }nvs_blob_stream;
+
+/*
+ * @brief : Number of hot keys that can be kept in RAM, must be a power of 2.
+ */
+#define NVS_RAM_CACHE_SIZE 32
+
+typedef struct nvs_ram_cache_entry { char namespace[NVS_KEY_NAME_MAX_SIZE]; char key[NVS_KEY_NAME_MAX_SIZE]; int32_t value; uint8_t registered; uint8_t valid; }nvs_ram_cache_entry;
+
+typedef struct nvs_ram_cache_stats { uint32_t hits; uint32_t misses; }nvs_ram_cache_stats;
+
+typedef struct nvs_handle_cache_stats { uint32_t hits; uint32_t opens; uint32_t evictions; uint32_t commits; }nvs_handle_cache_stats;
+
+typedef struct nvs_txn_entry { char key[NVS_KEY_NAME_MAX_SIZE]; nvs_type_t type; size_t len; union { int32_t i32; uint8_t * blob; } value; }nvs_txn_entry;
+
+typedef struct nvs_transaction { char namespace[NVS_KEY_NAME_MAX_SIZE]; uint8_t active; uint8_t count; uint32_t commit_time_us; nvs_txn_entry entries[NVS_TXN_MAX_ENTRIES]; }nvs_transaction;
+
+typedef enum nvs_field_type { NVS_FIELD_U8, NVS_FIELD_I8, NVS_FIELD_U16, NVS_FIELD_I16, NVS_FIELD_U32, NVS_FIELD_I32, NVS_FIELD_U64, NVS_FIELD_I64, NVS_FIELD_FLOAT, NVS_FIELD_DOUBLE, NVS_FIELD_STRING, NVS_FIELD_BLOB }nvs_field_type;
+
+typedef struct nvs_schema_field { const char * key; nvs_field_type type; size_t offset; size_t size; }nvs_schema_field;
+
+typedef struct nvs_schema { const char * namespace; const nvs_schema_field * fields; uint8_t count; }nvs_schema;
+
+/*
+ * @brief : Describes one member of a structure in a schema table, e.g.
+ * NVS_SCHEMA_FIELD(config_t, interval, "interval", NVS_FIELD_U32)
+ */
+#define NVS_SCHEMA_FIELD(st, member, key, type) { (key), (type), offsetof(st, member), sizeof(((st *)0)->member) }
+
+/*
+ * @brief : Label of the partition holding the snapshot of keys registered for migration.
+ */
+#define NVS_MIGRATION_PARTITION "nvs_bak"
+
+/*
+ * @brief : Maximum number of keys carried over when the NVS storage is re-created.
+ */
+#define NVS_MIGRATION_MAX_KEYS 32
+
+/*
+ * @brief : Maximum size of a string or blob carried over, it bounds the RAM used while migrating.
+ */
+#define NVS_MIGRATION_MAX_VALUE_SIZE 256
+
+#define NVS_MIGRATION_MAGIC 0X4E565342
+
+typedef struct nvs_migration_key { char namespace[NVS_KEY_NAME_MAX_SIZE]; char key[NVS_KEY_NAME_MAX_SIZE]; nvs_field_type type; }nvs_migration_key;
+
+typedef struct nvs_migration_header { uint32_t magic; uint32_t length; uint32_t crc; uint16_t count; uint16_t reserved; }nvs_migration_header;
+
+typedef struct nvs_migration_record { uint8_t namespace_len; uint8_t key_len; uint8_t type; uint8_t reserved; uint16_t value_len; }nvs_migration_record;
+
+typedef struct nvs_migration_report { uint8_t migrated; esp_err_t cause; uint16_t restored; uint16_t failed; uint16_t skipped; esp_err_t snapshot; uint32_t elapsed_us; }nvs_migration_report;
 
 void InitializeNVS();
 
+esp_err_t InitializeNVSWithMigration(nvs_migration_report *);
+
+esp_err_t NVSMigrationRegister(const char *, const char *, nvs_field_type);
+
+esp_err_t NVSMigrationSnapshot(void);
+
+esp_err_t InitializeSecureNVS(const char *);
+
+uint8_t NVSIsEncrypted(void);
+
+void DeinitializeNVS();
+
 void EraseNVS();
 
+esp_err_t NVSFlush(void);
+
+void NVSCloseAll(void);
+
+void NVSGetHandleCacheStats(nvs_handle_cache_stats *);
+
 esp_err_t NVSStoreBytes(const char *, const char *, uint8_t *, uint8_t);
 
 esp_err_t NVSReadBytes(const char *, const char *, uint8_t *, uint8_t *);
 
+esp_err_t NVSStoreBlob(const char *, const char *, const void *, size_t);
+
+esp_err_t NVSReadBlob(const char *, const char *, void *, size_t *);
+
 esp_err_t NVSStoreInteger32(const char *, const char *, int32_t);
 
 esp_err_t NVSReadInteger32(const char *, const char *, int32_t *);
 
+esp_err_t NVSStoreUInteger8(const char *, const char *, uint8_t);
+
+esp_err_t NVSReadUInteger8(const char *, const char *, uint8_t *);
+
+esp_err_t NVSStoreInteger8(const char *, const char *, int8_t);
+
+esp_err_t NVSReadInteger8(const char *, const char *, int8_t *);
+
+esp_err_t NVSStoreUInteger16(const char *, const char *, uint16_t);
+
+esp_err_t NVSReadUInteger16(const char *, const char *, uint16_t *);
+
+esp_err_t NVSStoreInteger16(const char *, const char *, int16_t);
+
+esp_err_t NVSReadInteger16(const char *, const char *, int16_t *);
+
+esp_err_t NVSStoreUInteger32(const char *, const char *, uint32_t);
+
+esp_err_t NVSReadUInteger32(const char *, const char *, uint32_t *);
+
+esp_err_t NVSStoreUInteger64(const char *, const char *, uint64_t);
+
+esp_err_t NVSReadUInteger64(const char *, const char *, uint64_t *);
+
+esp_err_t NVSStoreInteger64(const char *, const char *, int64_t);
+
+esp_err_t NVSReadInteger64(const char *, const char *, int64_t *);
+
+esp_err_t NVSStoreFloat(const char *, const char *, float);
+
+esp_err_t NVSReadFloat(const char *, const char *, float *);
+
+esp_err_t NVSStoreDouble(const char *, const char *, double);
+
+esp_err_t NVSReadDouble(const char *, const char *, double *);
+
+esp_err_t NVSStoreString(const char *, const char *, const char *);
+
+esp_err_t NVSReadString(const char *, const char *, char *, size_t *);
+
+esp_err_t NVSSchemaLoad(const nvs_schema *, void *);
+
+esp_err_t NVSSchemaSave(const nvs_schema *, const void *);
+
+esp_err_t NVSTransactionBegin(nvs_transaction *, const char *);
+
+esp_err_t NVSTransactionSetInteger32(nvs_transaction *, const char *, int32_t);
+
+esp_err_t NVSTransactionSetBytes(nvs_transaction *, const char *, uint8_t *, uint8_t);
+
+esp_err_t NVSTransactionSetBlob(nvs_transaction *, const char *, const void *, size_t);
+
+esp_err_t NVSTransactionCommit(nvs_transaction *);
+
+void NVSTransactionAbort(nvs_transaction *);
+
+esp_err_t NVSRamCacheRegister(const char *, const char *);
+
+void NVSRamCacheInvalidate(const char *, const char *);
+
+void NVSRamCacheInvalidateAll(void);
+
+void NVSGetRamCacheStats(nvs_ram_cache_stats *);
+
+esp_err_t NVSBlobWriteBegin(nvs_blob_stream *, const char *, const char *, size_t);
+
+esp_err_t NVSBlobWrite(nvs_blob_stream *, const void *, size_t);
+
+esp_err_t NVSBlobWriteEnd(nvs_blob_stream *);
+
+esp_err_t NVSBlobReadBegin(nvs_blob_stream *, const char *, const char *, size_t *);
+
+esp_err_t NVSBlobRead(nvs_blob_stream *, void *, size_t *);
+
+esp_err_t NVSBlobErase(const char *, const char *);
+
 #endif /* COMPONENTS_UTIL_NVS_UTIL_NVS_H_ */
@@ -8,249 +8,420 @@
 
 #include "util_uart.h"
 
-static char STRING0[UART0_RX_BUFFER_SIZE];
-static char * empty_string0="";
-uint16_t ind0=0;
+static char * empty_string="";
 
-static char STRING2[UART2_RX_BUFFER_SIZE];
-static char * empty_string2="";
-uint16_t ind2=0;
+/*
+ * @brief : Digit tables used by the formatters. Decimal digits are produced two at a time.
+ */
+static const char hex_digits[] = "0123456789ABCDEF";
+
+static const char decimal_pairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
 
 /*
- * @brief: This function initializes UART0 port for communication.
+ * @brief : Ports that are currently open, indexed by port number.
+ */
+static util_uart_t * open_ports[UART_NUM_MAX];
+
+/*
+ * @brief : Handles used by the uart0 and uart2 functions.
+ */
+static util_uart_t * uart0_handle = NULL;
+static util_uart_t * uart2_handle = NULL;
+
+static void uart_framer_free(util_uart_t *);
+static uint8_t uart_reader_busy(util_uart_t *);
+
+/*
+ * @brief: This function writes bytes to the driver and counts them.
  *
  * @param:
- * 1. int _baud - baud rate.
+ * 1. util_uart_t * uart - port handle.
+ * 2. const void * data : the bytes.
+ * 3. size_t len : number of bytes.
  *
- * @return: esp_err_t
- * ESP_OK - if everything initialization is successful.
- * Error code otherwise.
+ * @return:
+ * nothing
  */
-esp_err_t uart0_begin(int _baud)
+static inline void uart_write(util_uart_t * uart, const void * data, size_t len)
 {
-	esp_err_t _err;
-
-	uart_config_t uart0_config = {
-	        .baud_rate = _baud,
-	        .data_bits = UART_DATA_8_BITS,
-	        .parity    = UART_PARITY_DISABLE,
-	        .stop_bits = UART_STOP_BITS_1,
-	        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
-	        .source_clk = UART_SCLK_APB,
-	};
+	int n = uart_write_bytes(uart->port, (const char *)data, len);
+	if( n <= 0 ) return;
 
-	_err=uart_driver_install(UART_NUM_0, UART0_RX_BUFFER_SIZE * 2, 0, 0, NULL, 0);
-	if(_err!=ESP_OK) return _err;
-
-	_err=uart_param_config(UART_NUM_0, &uart0_config);
-	if(_err!=ESP_OK) return _err;
-
-	_err=uart_set_pin(UART_NUM_0, 1, 3, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
-
-	return _err;
+	portENTER_CRITICAL(&(uart->stats_mux));
+	uart->stats.bytes_out += n;
+	portEXIT_CRITICAL(&(uart->stats_mux));
 }
 
 /*
- * @brief: This function initializes UART2 port for communication.
+ * @brief: This function reads bytes from the driver and counts them. The RX ring occupancy seen before the read is
+ * tracked, its maximum tells how close the port came to overflowing.
  *
  * @param:
- * 1. int _baud - baud rate.
+ * 1. util_uart_t * uart - port handle.
+ * 2. void * data : destination.
+ * 3. uint32_t len : maximum number of bytes.
+ * 4. TickType_t wait : maximum number of ticks to block.
  *
- * @return: esp_err_t
- * ESP_OK - if everything initialization is successful.
- * Error code otherwise.
+ * @return: int
+ * Number of bytes read, -1 on error.
  */
-esp_err_t uart2_begin(int _baud)
+static int uart_read(util_uart_t * uart, void * data, uint32_t len, TickType_t wait)
 {
-	esp_err_t _err;
+	size_t buffered;
 
-	uart_config_t uart2_config = {
-	        .baud_rate = _baud,
-	        .data_bits = UART_DATA_8_BITS,
-	        .parity    = UART_PARITY_DISABLE,
-	        .stop_bits = UART_STOP_BITS_1,
-	        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
-	        .source_clk = UART_SCLK_APB,
-	};
+	if( uart_get_buffered_data_len(uart->port, &buffered) != ESP_OK ) buffered = 0;
 
-	_err=uart_driver_install(UART_NUM_2, UART2_RX_BUFFER_SIZE * 2, 0, 0, NULL, 0);
-	if(_err!=ESP_OK) return _err;
+	int n = uart_read_bytes(uart->port, (uint8_t *)data, len, wait);
 
-	_err=uart_param_config(UART_NUM_2, &uart2_config);
-	if(_err!=ESP_OK) return _err;
+	portENTER_CRITICAL(&(uart->stats_mux));
+	if( buffered > uart->stats.max_ring_used ) uart->stats.max_ring_used = buffered;
+	if( n > 0 ) uart->stats.bytes_in += n;
+	portEXIT_CRITICAL(&(uart->stats_mux));
 
-	_err=uart_set_pin(UART_NUM_2, 17, 16, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+	return n;
+}
 
-	return _err;
+/*
+ * @brief: This function adds to a 32 bit counter of the port or of its bulk mode. All counters of a port are updated
+ * and copied under its spinlock, the reader, bulk and calling tasks update them concurrently.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ * 2. uint32_t * counter : the counter.
+ * 3. uint32_t n : the amount to add.
+ *
+ * @return:
+ * nothing
+ */
+static inline void uart_count(util_uart_t * uart, uint32_t * counter, uint32_t n)
+{
+	portENTER_CRITICAL(&(uart->stats_mux));
+	*counter += n;
+	portEXIT_CRITICAL(&(uart->stats_mux));
 }
 
 /*
- * @brief: This function is used to delete the driver for UART0 port.
+ * @brief: This function counts the driver events that mean received data was lost.
  *
  * @param:
- * NONE
+ * 1. util_uart_t * uart - port handle.
+ * 2. uart_event_type_t type : the event type.
  *
  * @return:
- * NOTHING
+ * nothing
  */
-void uart0End(void)
+static inline void uart_note_event(util_uart_t * uart, uart_event_type_t type)
 {
-	uart_driver_delete(UART_NUM_0);
+	portENTER_CRITICAL(&(uart->stats_mux));
+	if( type == UART_FIFO_OVF ) uart->stats.fifo_overflows++;
+	else if( type == UART_BUFFER_FULL ) uart->stats.ring_overflows++;
+	portEXIT_CRITICAL(&(uart->stats_mux));
 }
 
 /*
- * @brief: This function is used to delete the driver for UART2 port.
+ * @brief: This function adds a line's delimiter-to-delivery time to the latency histogram. Bucket 0 holds times
+ * below 2^UART_LATENCY_MIN_SHIFT us, each further bucket doubles the bound and the last one holds everything above.
  *
  * @param:
- * NONE
+ * 1. util_uart_t * uart - port handle.
+ * 2. int64_t since_us : time the delimiter was received.
  *
  * @return:
- * NOTHING
+ * nothing
  */
-void uart2End(void)
+static void uart_note_latency(util_uart_t * uart, int64_t since_us)
 {
-	uart_driver_delete(UART_NUM_2);
+	int64_t elapsed = esp_timer_get_time() - since_us;
+	uint32_t us = ( elapsed <= 0 ) ? 0 : ( elapsed > UINT32_MAX ) ? UINT32_MAX : (uint32_t)elapsed;
+	uint8_t bucket = 0;
+
+	if( us >> UART_LATENCY_MIN_SHIFT ) bucket = 32 - __builtin_clz(us) - UART_LATENCY_MIN_SHIFT;
+	if( bucket >= UART_LATENCY_BUCKETS ) bucket = UART_LATENCY_BUCKETS - 1;
+
+	portENTER_CRITICAL(&(uart->stats_mux));
+	uart->stats.latency[bucket]++;
+	if( us > uart->stats.max_latency_us ) uart->stats.max_latency_us = us;
+	portEXIT_CRITICAL(&(uart->stats_mux));
 }
 
 /*
- * @brief: This function is used to send one byte to UART0 port.
+ * @brief: This function opens a UART port. Each port gets its own driver ring buffers, event queue and line buffer,
+ * so any of UART0-2 can run in parallel with the others.
  *
  * @param:
- * 1. char byt: The byte to send.
+ * 1. const util_uart_config * config - port configuration, see UTIL_UART_DEFAULT_CONFIG.
  *
- * @return: nothing.
+ * @return: util_uart_t *
+ * Handle of the port.
+ * NULL if the port is already open or could not be initialized.
  */
-void uart0Send(char byt)
+util_uart_t * uartBegin(const util_uart_config * config)
 {
-	uart_write_bytes(UART_NUM_0, &byt, 1);
+	esp_err_t _err;
+
+	if( config == NULL || config->port < 0 || config->port >= UART_NUM_MAX ) return NULL;
+	if( open_ports[config->port] != NULL ) return NULL;
+
+	// the driver needs ring buffers larger than the hardware FIFO, a TX ring of 0 makes writes blocking
+	if( config->rx_ring_size <= UART_FIFO_LEN ) return NULL;
+	if( config->tx_ring_size != 0 && config->tx_ring_size <= UART_FIFO_LEN ) return NULL;
+	if( config->line_size < 2 ) return NULL;
+
+	util_uart_t * uart = (util_uart_t *)calloc(1, sizeof(util_uart_t));
+	if( uart == NULL ) return NULL;
+
+	uart->line = (char *)calloc(config->line_size, sizeof(char));
+	if( uart->line == NULL )
+	{
+		free(uart);
+		return NULL;
+	}
+
+	uart->port = config->port;
+	uart->config = *config;
+	uart->stats_mux = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
+
+	uart_config_t uart_config = {
+	        .baud_rate = config->baud,
+	        .data_bits = UART_DATA_8_BITS,
+	        .parity    = UART_PARITY_DISABLE,
+	        .stop_bits = UART_STOP_BITS_1,
+	        .flow_ctrl = config->flow_ctrl,
+	        .rx_flow_ctrl_thresh = config->rx_flow_ctrl_thresh,
+	        .source_clk = UART_SCLK_APB,
+	};
+
+	_err=uart_driver_install(uart->port, config->rx_ring_size, config->tx_ring_size, UART_EVENT_QUEUE_SIZE, &(uart->events), 0);
+	if(_err==ESP_OK)
+	{
+		_err=uart_param_config(uart->port, &uart_config);
+		if(_err==ESP_OK) _err=uart_set_pin(uart->port, config->tx_pin, config->rx_pin, config->rts_pin, config->cts_pin);
+		if(_err!=ESP_OK) uart_driver_delete(uart->port);
+	}
+
+	if(_err!=ESP_OK)
+	{
+		free(uart->line);
+		free(uart);
+		return NULL;
+	}
+
+	open_ports[uart->port] = uart;
+	return uart;
 }
 
 /*
- * @brief: This function is used to send one byte to UART2 port.
+ * @brief: This function stops the line reader, deletes the driver and frees the handle of a port.
  *
  * @param:
- * 1. char byt: The byte to send.
+ * 1. util_uart_t * uart - port handle.
  *
- * @return: nothing.
+ * @return:
+ * NOTHING
  */
-void uart2Send(char byt)
+void uartEnd(util_uart_t * uart)
 {
-	uart_write_bytes(UART_NUM_2, &byt, 1);
+	if( uart == NULL ) return;
+
+	uartStopLineReader(uart);
+	uartStopFrameReader(uart);
+	uartBulkEnd(uart);
+	uart_driver_delete(uart->port);
+
+	uart_framer_free(uart);
+
+	if( uart->reader.lines != NULL ) vQueueDelete(uart->reader.lines);
+
+	open_ports[uart->port] = NULL;
+	free(uart->line);
+	free(uart);
 }
 
 /*
- * @brief: This function is used to send bytes to UART0 port.
+ * @brief: This function is used to send one byte.
  *
  * @param:
- * 1. char * byts: Pointer to byte string.
- * 2. len : Number of bytes in the string.
+ * 1. util_uart_t * uart - port handle.
+ * 2. char byt: The byte to send.
  *
  * @return: nothing.
  */
-void uart0SendBytes(char * byts, uint16_t len)
+void uartSend(util_uart_t * uart, char byt)
 {
-	uart_write_bytes(UART_NUM_0, byts, len);
+	uart_write(uart, &byt, 1);
 }
 
 /*
- * @brief: This function is used to send bytes to UART2 port.
+ * @brief: This function is used to send bytes.
  *
  * @param:
- * 1. char * byts: Pointer to byte string.
- * 2. len : Number of bytes in the string.
+ * 1. util_uart_t * uart - port handle.
+ * 2. const char * byts: Pointer to byte string.
+ * 3. len : Number of bytes in the string.
  *
  * @return: nothing.
  */
-void uart2SendBytes(char * byts, uint16_t len)
+void uartSendBytes(util_uart_t * uart, const char * byts, uint16_t len)
 {
-	uart_write_bytes(UART_NUM_2, byts, len);
+	uart_write(uart, byts, len);
 }
 
 /*
- * @brief: This function is used to send a '\0' terminated string to UART0 port.
+ * @brief: This function is used to send a '\0' terminated string.
  *
  * @param:
- * 1. char * str: Pointer to character string.
+ * 1. util_uart_t * uart - port handle.
+ * 2. const char * str: Pointer to character string.
  *
  * @return: nothing.
  */
-void uart0Print(char * str)
+void uartPrint(util_uart_t * uart, const char * str)
 {
-	uart0SendBytes(str, strlen(str));
+	uartSendBytes(uart, str, strlen(str));
 }
 
 /*
- * @brief: This function is used to send a '\0' terminated string to UART2 port.
+ * @brief: This function is used to send a '\0' terminated string. Newline character is automatically appended.
  *
  * @param:
- * 1. char * str: Pointer to character string.
+ * 1. util_uart_t * uart - port handle.
+ * 2. const char * str: Pointer to character string.
  *
  * @return: nothing.
  */
-void uart2Print(char * str)
+void uartPrintln(util_uart_t * uart, const char * str)
 {
-	uart2SendBytes(str, strlen(str));
+	char buff[UART_PRINT_BUFFER_SIZE];
+	size_t len = strlen(str);
+
+	// short lines go out with their newline in a single write
+	if( len < sizeof(buff) )
+	{
+		memcpy(buff, str, len);
+		buff[len++] = '\n';
+		uartSendBytes(uart, buff, len);
+	}
+	else
+	{
+		uartSendBytes(uart, str, len);
+		uartSend(uart, '\n');
+	}
 }
 
 /*
- * @brief: This function is used to send a '\0' terminated string to UART0 port. Newline character is automatically appended.
+ * @brief: This function formats text into a local buffer and sends it with one write.
  *
  * @param:
- * 1. char * str: Pointer to character string.
+ * 1. util_uart_t * uart - port handle.
+ * 2. const char * format: printf style format string.
+ * 3. va_list args: The arguments.
  *
- * @return: nothing.
+ * @return: int
+ * Number of bytes sent.
  */
-void uart0Println(char * str)
+static int uart_vprintf(util_uart_t * uart, const char * format, va_list args)
 {
-	uart0SendBytes(str, strlen(str));
-	uart0Send('\n');
+	char buff[UART_PRINT_BUFFER_SIZE];
+
+	int len = vsnprintf(buff, sizeof(buff), format, args);
+
+	if( len <= 0 ) return 0;
+	if( len >= sizeof(buff) ) len = sizeof(buff) - 1;
+
+	uartSendBytes(uart, buff, len);
+	return len;
 }
 
 /*
- * @brief: This function is used to send a '\0' terminated string to UART2 port. Newline character is automatically appended.
+ * @brief: This function is used to send formatted text. The text is built in a local buffer and sent with one
+ * write, output longer than UART_PRINT_BUFFER_SIZE - 1 characters is truncated.
  *
  * @param:
- * 1. char * str: Pointer to character string.
+ * 1. util_uart_t * uart - port handle.
+ * 2. const char * format: printf style format string.
  *
- * @return: nothing.
+ * @return: int
+ * Number of bytes sent.
  */
-void uart2Println(char * str)
+int uartPrintf(util_uart_t * uart, const char * format, ...)
 {
-	uart2SendBytes(str, strlen(str));
-	uart2Send('\n');
+	va_list args;
+
+	va_start(args, format);
+	int len = uart_vprintf(uart, format, args);
+	va_end(args);
+
+	return len;
 }
 
 /*
- * @brief: This function is used to read one byte from UART0 receive buffer.
+ * @brief: This function is used to print a byte array as space separated HEX values followed by a newline. The
+ * output is built in a local buffer and sent with one write per UART_PRINT_BUFFER_SIZE bytes of text.
  *
  * @param:
- * NONE
+ * 1. util_uart_t * uart - port handle.
+ * 2. const uint8_t * data: Pointer to the bytes.
+ * 3. size_t len: Number of bytes.
  *
- * @return: uart_char (a custom structure)
+ * @return: nothing.
  */
-uart_char uart0Read(void)
+void uartPrintHexBytes(util_uart_t * uart, const uint8_t * data, size_t len)
 {
-	uart_char ch = { 0, 0};
-	uint16_t len=uart_read_bytes(UART_NUM_0, &(ch.character), 1, 20 / portTICK_RATE_MS);
-	if(len==1)
+	char buff[UART_PRINT_BUFFER_SIZE];
+	size_t n = 0;
+
+	for( size_t i=0; i<len; i++ )
 	{
-		ch.flag=1;
+		if( n + 5 > sizeof(buff) )
+		{
+			uartSendBytes(uart, buff, n);
+			n = 0;
+		}
+		buff[n++] = '0';
+		buff[n++] = 'X';
+		buff[n++] = hex_digits[data[i] >> 4];
+		buff[n++] = hex_digits[data[i] & 0X0F];
+		buff[n++] = ' ';
 	}
-	return ch;
+	if( n + 1 > sizeof(buff) )
+	{
+		uartSendBytes(uart, buff, n);
+		n = 0;
+	}
+	buff[n++] = '\n';
+	uartSendBytes(uart, buff, n);
 }
 
 /*
- * @brief: This function is used to read one byte from UART2 receive buffer.
+ * @brief: This function is used to read one byte from the receive buffer.
  *
  * @param:
- * NONE
+ * 1. util_uart_t * uart - port handle.
  *
  * @return: uart_char (a custom structure)
  */
-uart_char uart2Read(void)
+uart_char uartRead(util_uart_t * uart)
 {
 	uart_char ch = { 0, 0};
-	uint16_t len=uart_read_bytes(UART_NUM_2, &(ch.character), 1, 20 / portTICK_RATE_MS);
+	uart_event_t event;
+
+	// nobody else consumes driver events when polling, draining them keeps overflow events from being dropped
+	if( !uart_reader_busy(uart) )
+	{
+		while( xQueueReceive(uart->events, &event, 0) == pdTRUE ) uart_note_event(uart, event.type);
+	}
+
+	int len=uart_read(uart, &(ch.character), 1, 20 / portTICK_RATE_MS);
 	if(len==1)
 	{
 		ch.flag=1;
@@ -259,253 +430,1592 @@ uart_char uart2Read(void)
 }
 
 /*
- * @brief: This function is used to read a series of bytes until a particular byte, from UART0 port.
+ * @brief: This function is used to read a series of bytes until a particular byte. The bytes are collected in the
+ * line buffer of the port.
  *
  * @param:
- * 1. char delimiter : the delimiter byte
+ * 1. util_uart_t * uart - port handle.
+ * 2. char delimiter : the delimiter byte
  *
  * @return: char *
- * Pointer to read bytes.
+ * Pointer to read bytes, an empty string until the delimiter is received.
  */
-char * uart0ReadBytesUntil(char delimiter)
+char * uartReadBytesUntil(util_uart_t * uart, char delimiter)
 {
-	if(ind0 < (UART0_RX_BUFFER_SIZE-1)){
-		uart_char CH=uart0Read();
+	if(uart->index < (uart->config.line_size-1)){
+		uart_char CH=uartRead(uart);
 		if(CH.flag){
 			if(CH.character!=delimiter){
-				STRING0[ind0++]=CH.character;
-				return empty_string0;
+				uart->line[uart->index++]=CH.character;
+				return empty_string;
 			}
 			else{
-				STRING0[ind0]='\0';
-				ind0=0;
-				return STRING0;
+				uart->line[uart->index]='\0';
+				uart->index=0;
+				uart_count(uart, &(uart->stats.lines), 1);
+				return uart->line;
 			}
 		}
 		else
-			return empty_string0;
+			return empty_string;
 	}
 	else{
-		STRING0[UART0_RX_BUFFER_SIZE-1]='\0';
-		ind0=0;
-		return STRING0;
+		uart->line[uart->config.line_size-1]='\0';
+		uart->index=0;
+		uart_count(uart, &(uart->stats.truncated_lines), 1);
+		return uart->line;
 	}
 }
 
 /*
- *  @brief: This function is used to read a series of bytes until a particular byte, from UART2 port.
+ * @brief: This function resets the line buffer of a port.
  *
- *  @param:
- *  1. char delimiter : the delimiter byte
+ * @param:
+ * 1. util_uart_t * uart - port handle.
  *
- *  @return:
- *  Pointer to read bytes.
+ * @return:
+ * NOTHING
  */
-char * uart2ReadBytesUntil(char delimiter)
+void uartInputReset(util_uart_t * uart)
 {
-	if(ind2< (UART2_RX_BUFFER_SIZE-1)){
-		uart_char CH=uart2Read();
-		if(CH.flag){
-			if(CH.character!=delimiter){
-				STRING2[ind2++]=CH.character;
-				return empty_string2;
-			}
-			else{
-				STRING2[ind2]='\0';
-				ind2=0;
-				return STRING2;
-			}
-		}
-		else
-			return empty_string2;
+	memset(uart->line, 0, uart->config.line_size);
+	uart->index=0;
+}
+
+/*
+ * @brief: This function writes the decimal digits of a 32 bit value backwards, ending just before 'end'.
+ *
+ * @param:
+ * 1. char * end : Pointer one past the last digit.
+ * 2. uint32_t value : The value.
+ *
+ * @return: uint8_t
+ * Number of digits written.
+ */
+static uint8_t format_decimal32(char * end, uint32_t value)
+{
+	char * p = end;
+
+	while( value >= 100 )
+	{
+		uint32_t r = value % 100;
+		value /= 100;
+		p -= 2;
+		memcpy(p, &decimal_pairs[r * 2], 2);
 	}
-	else{
-		STRING2[UART2_RX_BUFFER_SIZE-1]='\0';
-		ind2=0;
-		return STRING2;
+	if( value >= 10 )
+	{
+		p -= 2;
+		memcpy(p, &decimal_pairs[value * 2], 2);
 	}
+	else *--p = '0' + value;
+
+	return end - p;
 }
 
 /*
- * @brief: This function resets the storage array associated with UART0 port.
+ * @brief: This function writes the decimal digits of a 64 bit value backwards, ending just before 'end'. Only the
+ * part above 32 bits needs 64 bit divisions, one per 8 digits.
  *
  * @param:
- * NONE
+ * 1. char * end : Pointer one past the last digit.
+ * 2. uint64_t value : The value.
  *
- * @return:
- * NOTHING
+ * @return: uint8_t
+ * Number of digits written.
+ */
+static uint8_t format_decimal64(char * end, uint64_t value)
+{
+	char * p = end;
+
+	while( value > UINT32_MAX )
+	{
+		uint32_t low = value % 100000000;
+		value /= 100000000;
+
+		uint8_t n = format_decimal32(p, low);
+		p -= n;
+		memset(p - (8 - n), '0', 8 - n);
+		p -= 8 - n;
+	}
+	p -= format_decimal32(p, (uint32_t)value);
+
+	return end - p;
+}
+
+/*
+ * @brief: This function is used to format an unsigned integer of any width in decimal.
+ *
+ * @param:
+ * 1. char * buff : Destination, at least max(width, UART_MAX_INTEGER_DIGITS) + 1 bytes.
+ * 2. uint64_t value : The value, 8, 16 and 32 bit values are passed widened.
+ * 3. uint8_t width : Minimum number of characters, shorter numbers are padded on the left.
+ * 4. char pad : The padding character, usually '0' or ' '.
+ *
+ * @return: uint8_t
+ * Number of characters written, not counting the terminating '\0'.
  */
-void uart0InputReset(void){
-	memset(STRING0, 0, UART0_RX_BUFFER_SIZE);
-	ind0=0;
+uint8_t uartFormatUnsigned(char * buff, uint64_t value, uint8_t width, char pad)
+{
+	char digits[UART_MAX_INTEGER_DIGITS];
+	uint8_t n = format_decimal64(digits + sizeof(digits), value);
+	uint8_t fill = ( width > n ) ? width - n : 0;
+
+	memset(buff, pad, fill);
+	memcpy(buff + fill, digits + sizeof(digits) - n, n);
+	buff[fill + n] = '\0';
+
+	return fill + n;
 }
 
 /*
- * @brief: This function resets the storage array associated with UART2 port.
+ * @brief: This function is used to format a signed integer of any width in decimal. With '0' padding the sign is
+ * placed before the zeros.
  *
  * @param:
- * NONE
+ * 1. char * buff : Destination, at least max(width, UART_MAX_INTEGER_DIGITS) + 2 bytes.
+ * 2. int64_t value : The value, 8, 16 and 32 bit values are passed widened.
+ * 3. uint8_t width : Minimum number of characters including the sign.
+ * 4. char pad : The padding character, usually '0' or ' '.
+ *
+ * @return: uint8_t
+ * Number of characters written, not counting the terminating '\0'.
+ */
+uint8_t uartFormatSigned(char * buff, int64_t value, uint8_t width, char pad)
+{
+	char digits[UART_MAX_INTEGER_DIGITS];
+	uint8_t negative = value < 0;
+	uint64_t magnitude = negative ? (uint64_t)0 - (uint64_t)value : (uint64_t)value;
+	uint8_t n = format_decimal64(digits + sizeof(digits), magnitude);
+	uint8_t len = n + negative;
+	uint8_t fill = ( width > len ) ? width - len : 0;
+	char * p = buff;
+
+	if( pad == '0' )
+	{
+		if( negative ) *p++ = '-';
+		memset(p, '0', fill);
+		p += fill;
+	}
+	else
+	{
+		memset(p, pad, fill);
+		p += fill;
+		if( negative ) *p++ = '-';
+	}
+	memcpy(p, digits + sizeof(digits) - n, n);
+	p[n] = '\0';
+
+	return fill + len;
+}
+
+/*
+ * @brief: This function is used to format an integer in upper case HEX without prefix. Signed values are formatted
+ * as their two's complement, so they should be cast to the unsigned type of their width first.
+ *
+ * @param:
+ * 1. char * buff : Destination, at least max(width, 16) + 1 bytes.
+ * 2. uint64_t value : The value.
+ * 3. uint8_t width : Minimum number of digits, shorter numbers are padded with '0'.
+ *
+ * @return: uint8_t
+ * Number of characters written, not counting the terminating '\0'.
+ */
+uint8_t uartFormatHex(char * buff, uint64_t value, uint8_t width)
+{
+	uint8_t n = value ? (67 - __builtin_clzll(value)) / 4 : 1;
+	if( width > n ) n = width;
+
+	buff[n] = '\0';
+	for( int16_t i=n-1; i>=0; i-- )
+	{
+		buff[i] = hex_digits[value & 0X0F];
+		value >>= 4;
+	}
+
+	return n;
+}
+
+/*
+ * @brief: This function is used to print an integer.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ * 2. int num: The integer to send
  *
  * @return:
  * NOTHING
  */
-void uart2InputReset(void){
-	memset(STRING2, 0, UART2_RX_BUFFER_SIZE);
-	ind2=0;
+void uartPrintInteger(util_uart_t * uart, int num)
+{
+	char buff[UART_MAX_INTEGER_DIGITS+2];
+	uartSendBytes(uart, buff, uartFormatSigned(buff, num, 0, ' '));
 }
 
 /*
- * @brief: This function is used to print an integer to UART0 port.
+ * @brief: This function is used to print a signed integer of any width, padded to a fixed width.
  *
  * @param:
- * 1. int num: The integer to send
+ * 1. util_uart_t * uart - port handle.
+ * 2. int64_t num: The integer to send
+ * 3. uint8_t width: Minimum number of characters
+ * 4. char pad: The padding character
  *
  * @return:
  * NOTHING
  */
-void uart0PrintInteger(int num)
+void uartPrintSigned(util_uart_t * uart, int64_t num, uint8_t width, char pad)
 {
-	char buff[UART_MAX_INTEGER_DIGITS+1]={0};
-	itoa(num, buff, 10);
-	uart0Print(buff);
+	char buff[UART_PRINT_BUFFER_SIZE];
+	if( width > UART_PRINT_BUFFER_SIZE - 2 ) width = UART_PRINT_BUFFER_SIZE - 2;
+	uartSendBytes(uart, buff, uartFormatSigned(buff, num, width, pad));
 }
 
 /*
- * @brief: This function is used to print an integer to UART2 port.
+ * @brief: This function is used to print an unsigned integer of any width, padded to a fixed width.
  *
  * @param:
- * 1. int num: The integer to send
+ * 1. util_uart_t * uart - port handle.
+ * 2. uint64_t num: The integer to send
+ * 3. uint8_t width: Minimum number of characters
+ * 4. char pad: The padding character
  *
  * @return:
  * NOTHING
  */
-void uart2PrintInteger(int num)
+void uartPrintUnsigned(util_uart_t * uart, uint64_t num, uint8_t width, char pad)
 {
-	char buff[UART_MAX_INTEGER_DIGITS+1]={0};
-	itoa(num, buff, 10);
-	uart2Print(buff);
+	char buff[UART_PRINT_BUFFER_SIZE];
+	if( width > UART_PRINT_BUFFER_SIZE - 2 ) width = UART_PRINT_BUFFER_SIZE - 2;
+	uartSendBytes(uart, buff, uartFormatUnsigned(buff, num, width, pad));
 }
 
 /**
- * @brief : This function is used to print an integer to UART0 port in HEX form.
+ * @brief : This function is used to print an integer in HEX form. Negative numbers are printed as their 32 bit
+ * two's complement.
  *
  * @param :
- * 1. int num : The integer to send
+ * 1. util_uart_t * uart - port handle.
+ * 2. int num : The integer to send
  *
  * @return :
  * NOTHING
  */
-void uart0PrintHex(int num)
+void uartPrintHex(util_uart_t * uart, int num)
+{
+	char buff[2 + 16 + 1] = "0X";
+	uartSendBytes(uart, buff, 2 + uartFormatHex(buff + 2, (uint32_t)num, num ? 1 : 2));
+}
+
+/**
+ * @brief : This function is used to print an integer of any width in HEX form with a fixed number of digits.
+ *
+ * @param :
+ * 1. util_uart_t * uart - port handle.
+ * 2. uint64_t num : The integer to send, signed values cast to the unsigned type of their width
+ * 3. uint8_t width : Minimum number of digits
+ *
+ * @return :
+ * NOTHING
+ */
+void uartPrintHexPadded(util_uart_t * uart, uint64_t num, uint8_t width)
+{
+	char buff[UART_PRINT_BUFFER_SIZE] = "0X";
+	if( width > UART_PRINT_BUFFER_SIZE - 3 ) width = UART_PRINT_BUFFER_SIZE - 3;
+	uartSendBytes(uart, buff, 2 + uartFormatHex(buff + 2, num, width));
+}
+
+/*
+ * @brief: This function is used to print a byte array as a hex dump. Each line shows the offset, 16 bytes in HEX
+ * and their printable characters, and is sent with one write.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ * 2. const uint8_t * data: Pointer to the bytes.
+ * 3. size_t len: Number of bytes.
+ *
+ * @return: nothing.
+ */
+void uartHexDump(util_uart_t * uart, const uint8_t * data, size_t len)
 {
-	if(num > 0)
+	// "OOOOOOOO  XX XX ... XX  |cccccccccccccccc|\n"
+	char line[8 + 2 + 16 * 3 + 1 + 16 + 2 + 1];
+
+	for( size_t offset=0; offset<len; offset+=16 )
 	{
-		char Buff[25]={0};
-		int8_t ind=0;
+		size_t count = ( len - offset < 16 ) ? len - offset : 16;
+		char * p = line;
 
-		char ch;
-		while( num > 0)
+		p += uartFormatHex(p, offset, 8);
+		*p++ = ' ';
+		*p++ = ' ';
+
+		for( size_t i=0; i<16; i++ )
 		{
-			ch = (num & 0X0F);
-			switch(ch)
+			if( i < count )
+			{
+				*p++ = hex_digits[data[offset + i] >> 4];
+				*p++ = hex_digits[data[offset + i] & 0X0F];
+			}
+			else
 			{
-				case 0:
-				case 1:
-				case 2:
-				case 3:
-				case 4:
-				case 5:
-				case 6:
-				case 7:
-				case 8:
-				case 9:
-					Buff[ind++]=ch+48;
-					break;
-
-				case 10:
-				case 11:
-				case 12:
-				case 13:
-				case 14:
-				case 15:
-					Buff[ind++]=ch+55;
-					break;
+				*p++ = ' ';
+				*p++ = ' ';
 			}
-			num=num>>4;
+			*p++ = ' ';
 		}
 
-		Buff[ind++]='X';
-		Buff[ind]='0';
-
-		for(;ind>=0;ind--)
+		*p++ = '|';
+		for( size_t i=0; i<count; i++ )
 		{
-			uart0Send(Buff[ind]);
+			uint8_t c = data[offset + i];
+			*p++ = ( c >= 0X20 && c < 0X7F ) ? c : '.';
 		}
+		*p++ = '|';
+		*p++ = '\n';
+
+		uartSendBytes(uart, line, p - line);
 	}
-	else if(num==0)
+}
+
+/*
+ * @brief: This function hands a complete line to the consumer of a line reader.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ * 2. uart_line * line : The line.
+ *
+ * @return:
+ * nothing
+ */
+static void uart_deliver_line(util_uart_t * uart, uart_line * line)
+{
+	uart_count(uart, &(uart->stats.lines), 1);
+
+	if( uart->reader.callback != NULL )
 	{
-		uart0Print("0X00");
+		uart_note_latency(uart, line->time_us);
+		uart->reader.callback(uart->port, line->text, line->len);
 	}
+	else xQueueSend(uart->reader.lines, line, 0);
 }
 
-/**
- * @brief : This function is used to print an integer to UART2 port in HEX form.
+/*
+ * @brief: This task waits on the UART driver event queue and reads whole lines when the driver's pattern detection
+ * reports a delimiter. It blocks until the driver posts an event, waking every UART_READER_STOP_POLL_MS only to
+ * check the stop flag.
  *
- * @param :
- * 1. int num : The integer to send
+ * @param:
+ * 1. void * arg : The port handle.
  *
- * @return :
- * NOTHING
+ * @return:
+ * nothing
  */
-void uart2PrintHex(int num)
+static void uart_line_reader_task(void * arg)
 {
-	if(num > 0)
+	util_uart_t * uart = (util_uart_t *)arg;
+	uart_port_t port = uart->port;
+	uart_event_t event;
+	uart_line line;
+	size_t buffered;
+
+	// the line buffer of the port may be smaller than the one of a queued line
+	int size = ( uart->config.line_size < UART_LINE_MAX_LENGTH ) ? uart->config.line_size : UART_LINE_MAX_LENGTH;
+
+	while( !uart->reader.stop )
 	{
-		char Buff[25]={0};
-		int8_t ind=0;
+		if( xQueueReceive(uart->events, &event, pdMS_TO_TICKS(UART_READER_STOP_POLL_MS)) != pdTRUE ) continue;
 
-		char ch;
-		while( num > 0)
+		switch( event.type )
+		{
+		case UART_PATTERN_DET:
 		{
-			ch = (num & 0X0F);
-			switch(ch)
+			int pos = uart_pattern_pop_pos(port);
+			if( pos < 0 )
 			{
-				case 0:
-				case 1:
-				case 2:
-				case 3:
-				case 4:
-				case 5:
-				case 6:
-				case 7:
-				case 8:
-				case 9:
-					Buff[ind++]=ch+48;
-					break;
-
-				case 10:
-				case 11:
-				case 12:
-				case 13:
-				case 14:
-				case 15:
-					Buff[ind++]=ch+55;
-					break;
+				// the pattern position queue overflowed, positions are no longer reliable
+				uart_flush_input(port);
+				break;
 			}
-			num=num>>4;
-		}
 
-		Buff[ind++]='X';
-		Buff[ind]='0';
+			// bytes received after the delimiter tell how long ago it arrived
+			line.time_us = esp_timer_get_time();
+			if( uart_get_buffered_data_len(port, &buffered) == ESP_OK && buffered > pos + 1 )
+				line.time_us -= (int64_t)(buffered - pos - 1) * 10 * 1000000 / uart->config.baud;
 
-		for(;ind>=0;ind--)
-		{
-			uart2Send(Buff[ind]);
-		}
-	}
-	else if(num==0)
-	{
-		uart2Print("0X00");
-	}
-}
+			// read the line and the delimiter in one call, or as much of the line as fits and discard the rest
+			int len = uart_read(uart, line.text, (pos < size) ? pos + 1 : size - 1, 0);
+			if( len <= 0 ) break;
 
+			if( pos >= size )
+			{
+				char discard[32];
+				for( int left = pos + 1 - len; left > 0; )
+				{
+					int n = uart_read(uart, discard, (left < sizeof(discard)) ? left : sizeof(discard), 0);
+					if( n <= 0 ) break;
+					left -= n;
+				}
+				uart_count(uart, &(uart->stats.truncated_lines), 1);
+				line.len = len;
+			}
+			else line.len = len - 1;
+
+			line.text[line.len] = '\0';
+			uart_deliver_line(uart, &line);
+			break;
+		}
+
+		case UART_DATA:
+			// a line longer than the line buffer is delivered in pieces instead of filling the ring buffer
+			if( uart_pattern_get_pos(port) < 0 && uart_get_buffered_data_len(port, &buffered) == ESP_OK && buffered >= size - 1 )
+			{
+				int len = uart_read(uart, line.text, size - 1, 0);
+				if( len <= 0 ) break;
+				uart_count(uart, &(uart->stats.truncated_lines), 1);
+				line.time_us = esp_timer_get_time();
+				line.len = len;
+				line.text[len] = '\0';
+				uart_deliver_line(uart, &line);
+			}
+			break;
+
+		case UART_FIFO_OVF:
+		case UART_BUFFER_FULL:
+			uart_note_event(uart, event.type);
+			uart_flush_input(port);
+			xQueueReset(uart->events);
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	uart->reader.task = NULL;
+	vTaskDelete(NULL);
+}
+
+/*
+ * @brief: This function starts a task that reads lines as soon as the delimiter is received, using the driver's
+ * pattern detection. Lines are passed to the callback, or queued for uartReadLine() if it is NULL.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ * 2. char delimiter : the delimiter byte
+ * 3. uart_line_callback callback : function called from the reader task for every line, may be NULL
+ *
+ * @return: esp_err_t
+ * ESP_OK - if the reader is started.
+ * Error code otherwise.
+ */
+esp_err_t uartStartLineReader(util_uart_t * uart, char delimiter, uart_line_callback callback)
+{
+	esp_err_t _err;
+	uart_line_reader * reader = &(uart->reader);
+
+	if( uart_reader_busy(uart) ) return ESP_ERR_INVALID_STATE;
+
+	if( callback == NULL && reader->lines == NULL )
+	{
+		reader->lines = xQueueCreate(UART_LINE_QUEUE_SIZE, sizeof(uart_line));
+		if( reader->lines == NULL ) return ESP_ERR_NO_MEM;
+	}
+	reader->callback = callback;
+	reader->delimiter = delimiter;
+	reader->stop = 0;
+
+	// a single delimiter byte, no idle time required around it
+	_err = uart_enable_pattern_det_baud_intr(uart->port, delimiter, 1, 1, 0, 0);
+	if( _err != ESP_OK ) return _err;
+
+	_err = uart_pattern_queue_reset(uart->port, UART_PATTERN_QUEUE_SIZE);
+	if( _err != ESP_OK ) return _err;
+
+	if( xTaskCreate(uart_line_reader_task, "uart_line_reader", UART_LINE_READER_STACK_SIZE, uart, UART_LINE_READER_PRIORITY, &(reader->task)) != pdPASS )
+	{
+		uart_disable_pattern_det_intr(uart->port);
+		reader->task = NULL;
+		return ESP_ERR_NO_MEM;
+	}
+
+	return ESP_OK;
+}
+
+/*
+ * @brief: This function stops the line reader of a port.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ *
+ * @return:
+ * NOTHING
+ */
+void uartStopLineReader(util_uart_t * uart)
+{
+	if( uart->reader.task == NULL ) return;
+
+	uart_disable_pattern_det_intr(uart->port);
+
+	// the event only wakes the task early, an overflow may reset the queue and drop it, the flag is what stops it
+	uart_event_t wake = { .type = UART_EVENT_MAX };
+	uart->reader.stop = 1;
+	xQueueSend(uart->events, &wake, 0);
+	while( uart->reader.task != NULL ) vTaskDelay(1);
+}
+
+/*
+ * @brief: This function waits for the next line queued by the line reader.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ * 2. uart_line * line : Pointer to structure where the line will be stored.
+ * 3. TickType_t wait : Maximum number of ticks to block.
+ *
+ * @return: uint8_t
+ * 1 if a line was received, 0 on timeout
+ */
+uint8_t uartReadLine(util_uart_t * uart, uart_line * line, TickType_t wait)
+{
+	if( uart->reader.lines == NULL ) return 0;
+	if( xQueueReceive(uart->reader.lines, line, wait) != pdTRUE ) return 0;
+
+	uart_note_latency(uart, line->time_us);
+	return 1;
+}
+
+/*
+ * @brief: This function returns the traffic counters of a port: bytes in and out, overflows, complete and
+ * truncated lines, the highest RX ring occupancy and the delimiter-to-delivery latency histogram of the line reader.
+ * The delimiter time is estimated from the bytes received after it, at 10 bits per byte.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ * 2. uart_port_stats * stats : Pointer to structure where the counters will be stored.
+ *
+ * @return: esp_err_t
+ * ESP_OK - on success.
+ * ESP_ERR_INVALID_ARG - if the handle is NULL.
+ */
+esp_err_t uartGetStats(util_uart_t * uart, uart_port_stats * stats)
+{
+	if( uart == NULL ) return ESP_ERR_INVALID_ARG;
+
+	portENTER_CRITICAL(&(uart->stats_mux));
+	*stats = uart->stats;
+	portEXIT_CRITICAL(&(uart->stats_mux));
+
+	return ESP_OK;
+}
+
+/*
+ * @brief: This function clears the traffic counters of a port.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ *
+ * @return:
+ * NOTHING
+ */
+void uartResetStats(util_uart_t * uart)
+{
+	portENTER_CRITICAL(&(uart->stats_mux));
+	memset(&(uart->stats), 0, sizeof(uart_port_stats));
+	portEXIT_CRITICAL(&(uart->stats_mux));
+}
+
+/*
+ * @brief : CRC-16/CCITT-FALSE table (polynomial 0X1021), used to check frames.
+ */
+static const uint16_t crc16_table[256] = {
+	0X0000, 0X1021, 0X2042, 0X3063, 0X4084, 0X50A5, 0X60C6, 0X70E7,
+	0X8108, 0X9129, 0XA14A, 0XB16B, 0XC18C, 0XD1AD, 0XE1CE, 0XF1EF,
+	0X1231, 0X0210, 0X3273, 0X2252, 0X52B5, 0X4294, 0X72F7, 0X62D6,
+	0X9339, 0X8318, 0XB37B, 0XA35A, 0XD3BD, 0XC39C, 0XF3FF, 0XE3DE,
+	0X2462, 0X3443, 0X0420, 0X1401, 0X64E6, 0X74C7, 0X44A4, 0X5485,
+	0XA56A, 0XB54B, 0X8528, 0X9509, 0XE5EE, 0XF5CF, 0XC5AC, 0XD58D,
+	0X3653, 0X2672, 0X1611, 0X0630, 0X76D7, 0X66F6, 0X5695, 0X46B4,
+	0XB75B, 0XA77A, 0X9719, 0X8738, 0XF7DF, 0XE7FE, 0XD79D, 0XC7BC,
+	0X48C4, 0X58E5, 0X6886, 0X78A7, 0X0840, 0X1861, 0X2802, 0X3823,
+	0XC9CC, 0XD9ED, 0XE98E, 0XF9AF, 0X8948, 0X9969, 0XA90A, 0XB92B,
+	0X5AF5, 0X4AD4, 0X7AB7, 0X6A96, 0X1A71, 0X0A50, 0X3A33, 0X2A12,
+	0XDBFD, 0XCBDC, 0XFBBF, 0XEB9E, 0X9B79, 0X8B58, 0XBB3B, 0XAB1A,
+	0X6CA6, 0X7C87, 0X4CE4, 0X5CC5, 0X2C22, 0X3C03, 0X0C60, 0X1C41,
+	0XEDAE, 0XFD8F, 0XCDEC, 0XDDCD, 0XAD2A, 0XBD0B, 0X8D68, 0X9D49,
+	0X7E97, 0X6EB6, 0X5ED5, 0X4EF4, 0X3E13, 0X2E32, 0X1E51, 0X0E70,
+	0XFF9F, 0XEFBE, 0XDFDD, 0XCFFC, 0XBF1B, 0XAF3A, 0X9F59, 0X8F78,
+	0X9188, 0X81A9, 0XB1CA, 0XA1EB, 0XD10C, 0XC12D, 0XF14E, 0XE16F,
+	0X1080, 0X00A1, 0X30C2, 0X20E3, 0X5004, 0X4025, 0X7046, 0X6067,
+	0X83B9, 0X9398, 0XA3FB, 0XB3DA, 0XC33D, 0XD31C, 0XE37F, 0XF35E,
+	0X02B1, 0X1290, 0X22F3, 0X32D2, 0X4235, 0X5214, 0X6277, 0X7256,
+	0XB5EA, 0XA5CB, 0X95A8, 0X8589, 0XF56E, 0XE54F, 0XD52C, 0XC50D,
+	0X34E2, 0X24C3, 0X14A0, 0X0481, 0X7466, 0X6447, 0X5424, 0X4405,
+	0XA7DB, 0XB7FA, 0X8799, 0X97B8, 0XE75F, 0XF77E, 0XC71D, 0XD73C,
+	0X26D3, 0X36F2, 0X0691, 0X16B0, 0X6657, 0X7676, 0X4615, 0X5634,
+	0XD94C, 0XC96D, 0XF90E, 0XE92F, 0X99C8, 0X89E9, 0XB98A, 0XA9AB,
+	0X5844, 0X4865, 0X7806, 0X6827, 0X18C0, 0X08E1, 0X3882, 0X28A3,
+	0XCB7D, 0XDB5C, 0XEB3F, 0XFB1E, 0X8BF9, 0X9BD8, 0XABBB, 0XBB9A,
+	0X4A75, 0X5A54, 0X6A37, 0X7A16, 0X0AF1, 0X1AD0, 0X2AB3, 0X3A92,
+	0XFD2E, 0XED0F, 0XDD6C, 0XCD4D, 0XBDAA, 0XAD8B, 0X9DE8, 0X8DC9,
+	0X7C26, 0X6C07, 0X5C64, 0X4C45, 0X3CA2, 0X2C83, 0X1CE0, 0X0CC1,
+	0XEF1F, 0XFF3E, 0XCF5D, 0XDF7C, 0XAF9B, 0XBFBA, 0X8FD9, 0X9FF8,
+	0X6E17, 0X7E36, 0X4E55, 0X5E74, 0X2E93, 0X3EB2, 0X0ED1, 0X1EF0,
+};
+
+/*
+ * @brief: This function computes the CRC-16/CCITT-FALSE of a byte array, one table lookup per byte.
+ *
+ * @param:
+ * 1. const uint8_t * data: Pointer to the bytes.
+ * 2. size_t len: Number of bytes.
+ *
+ * @return: uint16_t
+ * The CRC.
+ */
+uint16_t uartCrc16(const uint8_t * data, size_t len)
+{
+	uint16_t crc = 0XFFFF;
+
+	for( size_t i=0; i<len; i++ ) crc = (crc << 8) ^ crc16_table[(crc >> 8) ^ data[i]];
+
+	return crc;
+}
+
+/*
+ * @brief : State of a COBS encoder writing into a caller's buffer.
+ */
+typedef struct cobs_encoder { uint8_t * out; uint16_t len; uint16_t code_at; }cobs_encoder;
+
+/*
+ * @brief: This function appends one byte to a COBS encoded block. Zero bytes close the current block, so the
+ * encoded data never contains the 0X00 frame delimiter.
+ *
+ * @param:
+ * 1. cobs_encoder * enc : The encoder.
+ * 2. uint8_t byt : The byte.
+ *
+ * @return:
+ * nothing
+ */
+static inline void cobs_put(cobs_encoder * enc, uint8_t byt)
+{
+	if( byt != 0 )
+	{
+		enc->out[enc->len++] = byt;
+		if( enc->len - enc->code_at != 0XFF ) return;
+	}
+	enc->out[enc->code_at] = enc->len - enc->code_at;
+	enc->code_at = enc->len++;
+}
+
+/*
+ * @brief: This function encodes and sends one frame with a single write. On the wire a frame is
+ * 0X00, COBS(type, sequence, payload, CRC-16), 0X00. The leading delimiter makes the receiver drop any partial frame
+ * left over from line noise.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ * 2. uint8_t type : frame type and flags.
+ * 3. uint8_t seq : sequence number.
+ * 4. const uint8_t * data : payload, may be NULL if len is 0.
+ * 5. uint16_t len : payload length, at most UART_FRAME_MAX_PAYLOAD.
+ *
+ * @return:
+ * nothing
+ */
+static void uart_frame_send(util_uart_t * uart, uint8_t type, uint8_t seq, const uint8_t * data, uint16_t len)
+{
+	uint8_t buff[UART_FRAME_MAX_ENCODED];
+	uint8_t head[2] = { type, seq };
+	cobs_encoder enc = { .out = buff, .len = 2, .code_at = 1 };
+
+	buff[0] = 0;
+
+	uint16_t crc = uartCrc16(head, sizeof(head));
+	for( uint16_t i=0; i<len; i++ ) crc = (crc << 8) ^ crc16_table[(crc >> 8) ^ data[i]];
+
+	cobs_put(&enc, type);
+	cobs_put(&enc, seq);
+	for( uint16_t i=0; i<len; i++ ) cobs_put(&enc, data[i]);
+	cobs_put(&enc, crc >> 8);
+	cobs_put(&enc, crc & 0XFF);
+
+	buff[enc.code_at] = enc.len - enc.code_at;
+	buff[enc.len++] = 0;
+
+	uart_write(uart, buff, enc.len);
+	if( uart->framer != NULL ) uart->framer->stats.sent++;
+}
+
+/*
+ * @brief: This function checks a decoded frame and acts on it: ACKs wake a waiting sender, data frames are
+ * acknowledged if requested and handed to the consumer unless they are a retransmission.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ *
+ * @return:
+ * nothing
+ */
+static void uart_frame_process(util_uart_t * uart)
+{
+	uart_framer * framer = uart->framer;
+
+	if( framer->rx_len < UART_FRAME_OVERHEAD )
+	{
+		framer->stats.crc_errors++;
+		return;
+	}
+
+	uint16_t len = framer->rx_len - 2;
+	uint16_t crc = (framer->rx[len] << 8) | framer->rx[len + 1];
+	if( uartCrc16(framer->rx, len) != crc )
+	{
+		framer->stats.crc_errors++;
+		return;
+	}
+
+	uint8_t type = framer->rx[0];
+	uint8_t seq = framer->rx[1];
+
+	switch( type & ~UART_FRAME_FLAG_ACK_REQUEST )
+	{
+	case UART_FRAME_TYPE_ACK:
+		xQueueSend(framer->acks, &seq, 0);
+		break;
+
+	case UART_FRAME_TYPE_DATA:
+		if( type & UART_FRAME_FLAG_ACK_REQUEST )
+		{
+			uart_frame_send(uart, UART_FRAME_TYPE_ACK, seq, NULL, 0);
+
+			// the sender did not get our last ACK and sent the frame again
+			if( framer->rx_seq == seq )
+			{
+				framer->stats.duplicates++;
+				break;
+			}
+			framer->rx_seq = seq;
+		}
+
+		framer->stats.received++;
+		if( framer->callback != NULL ) framer->callback(uart->port, framer->rx + 2, len - 2);
+		else
+		{
+			uart_frame frame;
+			frame.len = len - 2;
+			memcpy(frame.data, framer->rx + 2, frame.len);
+			xQueueSend(framer->frames, &frame, 0);
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+/*
+ * @brief: This function runs received bytes through the COBS decoder. Bytes are decoded straight into the frame
+ * buffer, the encoded frame is never stored.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ * 2. const uint8_t * data : received bytes.
+ * 3. int len : number of bytes.
+ *
+ * @return:
+ * nothing
+ */
+static void uart_frame_decode(util_uart_t * uart, const uint8_t * data, int len)
+{
+	uart_framer * framer = uart->framer;
+
+	for( int i=0; i<len; i++ )
+	{
+		uint8_t byt = data[i];
+
+		if( byt == 0 )
+		{
+			// a complete frame ends exactly at the end of a block, empty frames are just delimiters
+			if( !framer->discard && framer->code != 0 && framer->left == 0 ) uart_frame_process(uart);
+			else if( !framer->discard && framer->code != 0 ) framer->stats.crc_errors++;
+
+			framer->rx_len = 0;
+			framer->code = 0;
+			framer->left = 0;
+			framer->discard = 0;
+			continue;
+		}
+
+		if( framer->discard ) continue;
+
+		if( framer->left == 0 )
+		{
+			// a new block starts, every block shorter than 254 bytes stood for a zero byte
+			if( framer->code != 0 && framer->code != 0XFF )
+			{
+				if( framer->rx_len == sizeof(framer->rx) ) goto oversized;
+				framer->rx[framer->rx_len++] = 0;
+			}
+			framer->code = byt;
+			framer->left = byt - 1;
+			continue;
+		}
+
+		if( framer->rx_len == sizeof(framer->rx) ) goto oversized;
+		framer->rx[framer->rx_len++] = byt;
+		framer->left--;
+		continue;
+
+oversized:
+		framer->stats.oversized++;
+		framer->discard = 1;
+	}
+}
+
+/*
+ * @brief: This task waits on the UART driver event queue and decodes frames as data arrives.
+ *
+ * @param:
+ * 1. void * arg : The port handle.
+ *
+ * @return:
+ * nothing
+ */
+static void uart_frame_reader_task(void * arg)
+{
+	util_uart_t * uart = (util_uart_t *)arg;
+	uart_framer * framer = uart->framer;
+	uart_port_t port = uart->port;
+	uart_event_t event;
+	uint8_t chunk[128];
+
+	while( !framer->stop )
+	{
+		if( xQueueReceive(uart->events, &event, pdMS_TO_TICKS(UART_READER_STOP_POLL_MS)) != pdTRUE ) continue;
+
+		switch( event.type )
+		{
+		case UART_DATA:
+			for(;;)
+			{
+				int len = uart_read(uart, chunk, sizeof(chunk), 0);
+				if( len <= 0 ) break;
+				uart_frame_decode(uart, chunk, len);
+			}
+			break;
+
+		case UART_FIFO_OVF:
+		case UART_BUFFER_FULL:
+			// the frame in progress lost bytes, the next delimiter resynchronizes the decoder
+			uart_note_event(uart, event.type);
+			uart_flush_input(port);
+			xQueueReset(uart->events);
+			framer->stats.overruns++;
+			framer->discard = 1;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	framer->task = NULL;
+	vTaskDelete(NULL);
+}
+
+/*
+ * @brief: This function frees the framing state of a port. The frame reader must be stopped.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ *
+ * @return:
+ * nothing
+ */
+static void uart_framer_free(util_uart_t * uart)
+{
+	uart_framer * framer = uart->framer;
+
+	if( framer == NULL ) return;
+
+	if( framer->frames != NULL ) vQueueDelete(framer->frames);
+	if( framer->acks != NULL ) vQueueDelete(framer->acks);
+	if( framer->send_lock != NULL ) vSemaphoreDelete(framer->send_lock);
+	free(framer);
+	uart->framer = NULL;
+}
+
+/*
+ * @brief: This function starts a task that receives binary frames. Frames are COBS encoded, so payloads may contain
+ * any byte value, and carry a CRC-16. Good frames are passed to the callback, or queued for uartReadFrame() if it
+ * is NULL. The line reader and the frame reader share the driver event queue, only one of them can run.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ * 2. uart_frame_callback callback : function called from the reader task for every frame, may be NULL
+ *
+ * @return: esp_err_t
+ * ESP_OK - if the reader is started.
+ * Error code otherwise.
+ */
+esp_err_t uartStartFrameReader(util_uart_t * uart, uart_frame_callback callback)
+{
+	if( uart_reader_busy(uart) ) return ESP_ERR_INVALID_STATE;
+
+	if( uart->framer == NULL )
+	{
+		uart->framer = (uart_framer *)calloc(1, sizeof(uart_framer));
+		if( uart->framer == NULL ) return ESP_ERR_NO_MEM;
+
+		uart->framer->acks = xQueueCreate(UART_FRAME_ACK_QUEUE_SIZE, sizeof(uint8_t));
+		uart->framer->send_lock = xSemaphoreCreateMutex();
+		if( uart->framer->acks == NULL || uart->framer->send_lock == NULL )
+		{
+			uart_framer_free(uart);
+			return ESP_ERR_NO_MEM;
+		}
+	}
+
+	uart_framer * framer = uart->framer;
+
+	if( callback == NULL && framer->frames == NULL )
+	{
+		framer->frames = xQueueCreate(UART_FRAME_QUEUE_SIZE, sizeof(uart_frame));
+		if( framer->frames == NULL ) return ESP_ERR_NO_MEM;
+	}
+	framer->callback = callback;
+	framer->rx_len = 0;
+	framer->code = 0;
+	framer->left = 0;
+	framer->discard = 0;
+	framer->rx_seq = -1;
+	framer->stop = 0;
+
+	if( xTaskCreate(uart_frame_reader_task, "uart_frame_reader", UART_FRAME_READER_STACK_SIZE, uart, UART_FRAME_READER_PRIORITY, &(framer->task)) != pdPASS )
+	{
+		framer->task = NULL;
+		return ESP_ERR_NO_MEM;
+	}
+
+	return ESP_OK;
+}
+
+/*
+ * @brief: This function stops the frame reader of a port.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ *
+ * @return:
+ * NOTHING
+ */
+void uartStopFrameReader(util_uart_t * uart)
+{
+	if( uart->framer == NULL || uart->framer->task == NULL ) return;
+
+	// as for the line reader, the event only wakes the task early
+	uart_event_t wake = { .type = UART_EVENT_MAX };
+	uart->framer->stop = 1;
+	xQueueSend(uart->events, &wake, 0);
+	while( uart->framer->task != NULL ) vTaskDelay(1);
+}
+
+/*
+ * @brief: This function sends one frame without waiting for an acknowledgement. It does not need the frame reader.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ * 2. const uint8_t * data : payload.
+ * 3. uint16_t len : payload length, at most UART_FRAME_MAX_PAYLOAD.
+ *
+ * @return: esp_err_t
+ * ESP_OK - if the frame is queued for sending.
+ * ESP_ERR_INVALID_SIZE - if the payload is too long.
+ */
+esp_err_t uartSendFrame(util_uart_t * uart, const uint8_t * data, uint16_t len)
+{
+	if( len > UART_FRAME_MAX_PAYLOAD ) return ESP_ERR_INVALID_SIZE;
+
+	uart_frame_send(uart, UART_FRAME_TYPE_DATA, 0, data, len);
+	return ESP_OK;
+}
+
+/*
+ * @brief: This function sends one frame and waits for the receiver to acknowledge it, sending it again on timeout.
+ * The frame reader must be running to receive the acknowledgement. Calls from several tasks are serialized.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ * 2. const uint8_t * data : payload.
+ * 3. uint16_t len : payload length, at most UART_FRAME_MAX_PAYLOAD.
+ * 4. TickType_t ack_timeout : ticks to wait for the acknowledgement of each attempt.
+ * 5. uint8_t retries : number of times the frame is sent again.
+ *
+ * @return: esp_err_t
+ * ESP_OK - if the frame was acknowledged.
+ * ESP_ERR_TIMEOUT - if no acknowledgement was received.
+ * Error code otherwise.
+ */
+esp_err_t uartSendFrameReliable(util_uart_t * uart, const uint8_t * data, uint16_t len, TickType_t ack_timeout, uint8_t retries)
+{
+	uart_framer * framer = uart->framer;
+	esp_err_t _err = ESP_ERR_TIMEOUT;
+	uint8_t acked;
+
+	if( framer == NULL || framer->task == NULL ) return ESP_ERR_INVALID_STATE;
+	if( len > UART_FRAME_MAX_PAYLOAD ) return ESP_ERR_INVALID_SIZE;
+
+	xSemaphoreTake(framer->send_lock, portMAX_DELAY);
+
+	uint8_t seq = framer->tx_seq++;
+	xQueueReset(framer->acks);
+
+	for( uint16_t attempt=0; attempt<=retries && _err!=ESP_OK; attempt++ )
+	{
+		if( attempt > 0 ) framer->stats.retransmits++;
+		uart_frame_send(uart, UART_FRAME_TYPE_DATA | UART_FRAME_FLAG_ACK_REQUEST, seq, data, len);
+
+		// late ACKs of earlier frames are skipped
+		while( xQueueReceive(framer->acks, &acked, ack_timeout) == pdTRUE )
+		{
+			if( acked == seq )
+			{
+				_err = ESP_OK;
+				break;
+			}
+		}
+	}
+
+	if( _err != ESP_OK ) framer->stats.ack_timeouts++;
+
+	xSemaphoreGive(framer->send_lock);
+	return _err;
+}
+
+/*
+ * @brief: This function waits for the next frame queued by the frame reader.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ * 2. uart_frame * frame : Pointer to structure where the frame will be stored.
+ * 3. TickType_t wait : Maximum number of ticks to block.
+ *
+ * @return: uint8_t
+ * 1 if a frame was received, 0 on timeout
+ */
+uint8_t uartReadFrame(util_uart_t * uart, uart_frame * frame, TickType_t wait)
+{
+	if( uart->framer == NULL || uart->framer->frames == NULL ) return 0;
+	return xQueueReceive(uart->framer->frames, frame, wait) == pdTRUE;
+}
+
+/*
+ * @brief: This function returns the framing counters of a port.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ * 2. uart_frame_stats * stats : Pointer to structure where the counters will be stored.
+ *
+ * @return: esp_err_t
+ * ESP_OK - on success.
+ * ESP_ERR_INVALID_STATE - if the frame reader was never started.
+ */
+esp_err_t uartGetFrameStats(util_uart_t * uart, uart_frame_stats * stats)
+{
+	if( uart->framer == NULL ) return ESP_ERR_INVALID_STATE;
+	*stats = uart->framer->stats;
+	return ESP_OK;
+}
+
+/*
+ * @brief: This function tells whether a consumer of the driver event queue (line reader, frame reader or bulk mode)
+ * is running on a port. Only one of them can run at a time.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ *
+ * @return: uint8_t
+ * 1 if the port is busy, 0 otherwise
+ */
+static uint8_t uart_reader_busy(util_uart_t * uart)
+{
+	return ( uart->reader.task != NULL ) || ( uart->framer != NULL && uart->framer->task != NULL ) || ( uart->bulk != NULL );
+}
+
+/*
+ * @brief: This function drains the driver event queue of a port in bulk mode and counts overflows. Data events carry
+ * no information bulk mode needs.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ *
+ * @return:
+ * nothing
+ */
+static void uart_bulk_count_events(util_uart_t * uart)
+{
+	uart_event_t event;
+
+	while( xQueueReceive(uart->events, &event, 0) == pdTRUE )
+	{
+		uart_note_event(uart, event.type);
+
+		if( event.type == UART_FIFO_OVF )
+		{
+			// the driver resets the hardware FIFO, at most its contents are lost
+			portENTER_CRITICAL(&(uart->stats_mux));
+			uart->bulk->stats.fifo_overflows++;
+			uart->bulk->stats.dropped_bytes += UART_FIFO_LEN;
+			portEXIT_CRITICAL(&(uart->stats_mux));
+		}
+		else if( event.type == UART_BUFFER_FULL ) uart_count(uart, &(uart->bulk->stats.ring_overflows), 1);
+	}
+}
+
+/*
+ * @brief: This task moves received bytes from the driver ring buffer into the bulk buffers with large reads. A buffer
+ * is handed over when it is full, or when no byte has arrived for the configured idle time, while the application
+ * works on the other one. A stall is counted once each time the task has to wait for the application to release a
+ * buffer.
+ *
+ * @param:
+ * 1. void * arg : The port handle.
+ *
+ * @return:
+ * nothing
+ */
+static void uart_bulk_reader_task(void * arg)
+{
+	util_uart_t * uart = (util_uart_t *)arg;
+	uart_bulk * bulk = uart->bulk;
+	uart_bulk_buffer buffer;
+	uint8_t stalled = 0;
+
+	while( !bulk->stop )
+	{
+		// no free buffer means the application is slower than the line, the driver ring absorbs the difference
+		if( xQueueReceive(bulk->empty, &buffer, 0) != pdTRUE )
+		{
+			if( !stalled ) uart_count(uart, &(bulk->stats.stalls), 1);
+			stalled = 1;
+			if( xQueueReceive(bulk->empty, &buffer, bulk->idle) != pdTRUE ) continue;
+		}
+		stalled = 0;
+
+		int len = 0;
+		while( len < bulk->buffer_size && !bulk->stop )
+		{
+			// take everything already received, then wait up to one idle period for the next byte
+			int n = uart_read(uart, buffer.data + len, bulk->buffer_size - len, 0);
+			if( n <= 0 ) n = uart_read(uart, buffer.data + len, 1, bulk->idle);
+			if( n <= 0 ) break;
+			len += n;
+		}
+		uart_bulk_count_events(uart);
+
+		if( len <= 0 )
+		{
+			xQueueSend(bulk->empty, &buffer, 0);
+			continue;
+		}
+
+		int64_t now = esp_timer_get_time();
+		portENTER_CRITICAL(&(uart->stats_mux));
+		if( bulk->stats.bytes == 0 ) bulk->stats.started_us = now;
+		bulk->stats.bytes += len;
+		bulk->stats.buffers++;
+		portEXIT_CRITICAL(&(uart->stats_mux));
+
+		buffer.len = len;
+		xQueueSend(bulk->filled, &buffer, portMAX_DELAY);
+	}
+
+	bulk->task = NULL;
+	vTaskDelete(NULL);
+}
+
+/*
+ * @brief: This function frees the bulk mode state of a port. The reader task must be stopped.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ *
+ * @return:
+ * nothing
+ */
+static void uart_bulk_free(util_uart_t * uart)
+{
+	uart_bulk * bulk = uart->bulk;
+
+	if( bulk == NULL ) return;
+
+	if( bulk->filled != NULL ) vQueueDelete(bulk->filled);
+	if( bulk->empty != NULL ) vQueueDelete(bulk->empty);
+	free(bulk->memory);
+	free(bulk);
+	uart->bulk = NULL;
+}
+
+/*
+ * @brief: This function switches a port to bulk receive mode for high baud rates. Received data is collected with
+ * large driver reads into UART_BULK_BUFFER_COUNT buffers, so the application processes one buffer while the next
+ * one fills. The RX FIFO interrupt threshold is lowered to leave more time to empty the FIFO before it overflows.
+ * The driver RX ring (rx_ring_size) should hold at least two buffers.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ * 2. size_t buffer_size : size of each buffer in bytes.
+ * 3. TickType_t idle : a partly filled buffer is handed over after this many ticks without data.
+ *
+ * @return: esp_err_t
+ * ESP_OK - if bulk mode is started.
+ * Error code otherwise.
+ */
+esp_err_t uartBulkBegin(util_uart_t * uart, size_t buffer_size, TickType_t idle)
+{
+	if( uart_reader_busy(uart) ) return ESP_ERR_INVALID_STATE;
+	if( buffer_size == 0 ) return ESP_ERR_INVALID_ARG;
+
+	uart_bulk * bulk = (uart_bulk *)calloc(1, sizeof(uart_bulk));
+	if( bulk == NULL ) return ESP_ERR_NO_MEM;
+	uart->bulk = bulk;
+
+	bulk->buffer_size = buffer_size;
+	bulk->idle = ( idle > 0 ) ? idle : 1;
+	bulk->memory = (uint8_t *)malloc(buffer_size * UART_BULK_BUFFER_COUNT);
+	bulk->filled = xQueueCreate(UART_BULK_BUFFER_COUNT, sizeof(uart_bulk_buffer));
+	bulk->empty = xQueueCreate(UART_BULK_BUFFER_COUNT, sizeof(uart_bulk_buffer));
+	if( bulk->memory == NULL || bulk->filled == NULL || bulk->empty == NULL )
+	{
+		uart_bulk_free(uart);
+		return ESP_ERR_NO_MEM;
+	}
+
+	for( uint8_t i=0; i<UART_BULK_BUFFER_COUNT; i++ )
+	{
+		uart_bulk_buffer buffer = { .data = bulk->memory + i * buffer_size, .len = 0 };
+		xQueueSend(bulk->empty, &buffer, 0);
+	}
+
+	uart_set_rx_full_threshold(uart->port, UART_BULK_RX_FULL_THRESHOLD);
+	xQueueReset(uart->events);
+
+	if( xTaskCreate(uart_bulk_reader_task, "uart_bulk_reader", UART_BULK_READER_STACK_SIZE, uart, UART_BULK_READER_PRIORITY, &(bulk->task)) != pdPASS )
+	{
+		uart_set_rx_full_threshold(uart->port, UART_RX_FULL_THRESHOLD_DEFAULT);
+		uart_bulk_free(uart);
+		return ESP_ERR_NO_MEM;
+	}
+
+	return ESP_OK;
+}
+
+/*
+ * @brief: This function leaves bulk receive mode and frees the buffers. Buffers held by the application become
+ * invalid.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ *
+ * @return:
+ * NOTHING
+ */
+void uartBulkEnd(util_uart_t * uart)
+{
+	if( uart->bulk == NULL ) return;
+
+	uart->bulk->stop = 1;
+	while( uart->bulk->task != NULL ) vTaskDelay(1);
+
+	uart_set_rx_full_threshold(uart->port, UART_RX_FULL_THRESHOLD_DEFAULT);
+	uart_bulk_free(uart);
+}
+
+/*
+ * @brief: This function waits for the next filled bulk buffer. The buffer belongs to the application until it is
+ * returned with uartBulkRelease().
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ * 2. uart_bulk_buffer * buffer : Pointer to structure where the buffer will be stored.
+ * 3. TickType_t wait : Maximum number of ticks to block.
+ *
+ * @return: uint8_t
+ * 1 if a buffer was received, 0 on timeout
+ */
+uint8_t uartBulkReceive(util_uart_t * uart, uart_bulk_buffer * buffer, TickType_t wait)
+{
+	if( uart->bulk == NULL ) return 0;
+	return xQueueReceive(uart->bulk->filled, buffer, wait) == pdTRUE;
+}
+
+/*
+ * @brief: This function returns a buffer obtained from uartBulkReceive() so it can be filled again.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ * 2. uart_bulk_buffer * buffer : The buffer.
+ *
+ * @return:
+ * NOTHING
+ */
+void uartBulkRelease(util_uart_t * uart, uart_bulk_buffer * buffer)
+{
+	if( uart->bulk == NULL ) return;
+
+	buffer->len = 0;
+	xQueueSend(uart->bulk->empty, buffer, 0);
+}
+
+/*
+ * @brief: This function returns the bulk mode counters of a port, with the throughput measured since the first byte
+ * after start or the last reset.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ * 2. uart_bulk_stats * stats : Pointer to structure where the counters will be stored.
+ *
+ * @return: esp_err_t
+ * ESP_OK - on success.
+ * ESP_ERR_INVALID_STATE - if the port is not in bulk mode.
+ */
+esp_err_t uartBulkGetStats(util_uart_t * uart, uart_bulk_stats * stats)
+{
+	if( uart->bulk == NULL ) return ESP_ERR_INVALID_STATE;
+
+	portENTER_CRITICAL(&(uart->stats_mux));
+	*stats = uart->bulk->stats;
+	portEXIT_CRITICAL(&(uart->stats_mux));
+
+	int64_t elapsed = esp_timer_get_time() - stats->started_us;
+	stats->bytes_per_second = ( stats->bytes > 0 && elapsed > 0 ) ? (uint32_t)(stats->bytes * 1000000 / elapsed) : 0;
+
+	return ESP_OK;
+}
+
+/*
+ * @brief: This function clears the bulk mode counters of a port, for example between benchmark runs.
+ *
+ * @param:
+ * 1. util_uart_t * uart - port handle.
+ *
+ * @return:
+ * NOTHING
+ */
+void uartBulkResetStats(util_uart_t * uart)
+{
+	if( uart->bulk == NULL ) return;
+
+	portENTER_CRITICAL(&(uart->stats_mux));
+	memset(&(uart->bulk->stats), 0, sizeof(uart_bulk_stats));
+	portEXIT_CRITICAL(&(uart->stats_mux));
+}
+
+/*
+ * @brief: This function returns the handle used by the uart0 functions.
+ *
+ * @param:
+ * NONE
+ *
+ * @return: util_uart_t *
+ * Handle of UART0, NULL if uart0_begin() was not called.
+ */
+util_uart_t * uart0Handle(void)
+{
+	return uart0_handle;
+}
+
+/*
+ * @brief: This function returns the handle used by the uart2 functions.
+ *
+ * @param:
+ * NONE
+ *
+ * @return: util_uart_t *
+ * Handle of UART2, NULL if uart2_begin() was not called.
+ */
+util_uart_t * uart2Handle(void)
+{
+	return uart2_handle;
+}
+
+/*
+ * @brief: This function initializes UART0 port for communication.
+ *
+ * @param:
+ * 1. int _baud - baud rate.
+ *
+ * @return: esp_err_t
+ * ESP_OK - if everything initialization is successful.
+ * Error code otherwise.
+ */
+esp_err_t uart0_begin(int _baud)
+{
+	if( uart0_handle != NULL ) return ESP_FAIL;
+
+	util_uart_config config = UTIL_UART_DEFAULT_CONFIG(UART_NUM_0, _baud);
+	config.tx_pin = 1;
+	config.rx_pin = 3;
+	config.rx_ring_size = UART0_RX_BUFFER_SIZE * 2;
+	config.tx_ring_size = UART0_TX_BUFFER_SIZE;
+	config.line_size = UART0_RX_BUFFER_SIZE;
+
+	uart0_handle = uartBegin(&config);
+
+	return ( uart0_handle != NULL ) ? ESP_OK : ESP_FAIL;
+}
+
+/*
+ * @brief: This function initializes UART2 port for communication.
+ *
+ * @param:
+ * 1. int _baud - baud rate.
+ *
+ * @return: esp_err_t
+ * ESP_OK - if everything initialization is successful.
+ * Error code otherwise.
+ */
+esp_err_t uart2_begin(int _baud)
+{
+	if( uart2_handle != NULL ) return ESP_FAIL;
+
+	util_uart_config config = UTIL_UART_DEFAULT_CONFIG(UART_NUM_2, _baud);
+	config.tx_pin = 17;
+	config.rx_pin = 16;
+	config.rx_ring_size = UART2_RX_BUFFER_SIZE * 2;
+	config.tx_ring_size = UART2_TX_BUFFER_SIZE;
+	config.line_size = UART2_RX_BUFFER_SIZE;
+
+	uart2_handle = uartBegin(&config);
+
+	return ( uart2_handle != NULL ) ? ESP_OK : ESP_FAIL;
+}
+
+/*
+ * @brief: This function is used to delete the driver for UART0 port.
+ *
+ * @param:
+ * NONE
+ *
+ * @return:
+ * NOTHING
+ */
+void uart0End(void)
+{
+	uartEnd(uart0_handle);
+	uart0_handle = NULL;
+}
+
+/*
+ * @brief: This function is used to delete the driver for UART2 port.
+ *
+ * @param:
+ * NONE
+ *
+ * @return:
+ * NOTHING
+ */
+void uart2End(void)
+{
+	uartEnd(uart2_handle);
+	uart2_handle = NULL;
+}
+
+/*
+ * @brief: The functions below keep the fixed uart0 and uart2 interface of earlier versions, and only that interface.
+ * They forward to the port handles created by uart0_begin() and uart2_begin() and do nothing until the port is
+ * initialized.
+ */
+void uart0Send(char byt)
+{
+	if( uart0_handle != NULL ) uartSend(uart0_handle, byt);
+}
+
+void uart2Send(char byt)
+{
+	if( uart2_handle != NULL ) uartSend(uart2_handle, byt);
+}
+
+void uart0SendBytes(char * byts, uint16_t len)
+{
+	if( uart0_handle != NULL ) uartSendBytes(uart0_handle, byts, len);
+}
+
+void uart2SendBytes(char * byts, uint16_t len)
+{
+	if( uart2_handle != NULL ) uartSendBytes(uart2_handle, byts, len);
+}
+
+void uart0Print(char * str)
+{
+	if( uart0_handle != NULL ) uartPrint(uart0_handle, str);
+}
+
+void uart2Print(char * str)
+{
+	if( uart2_handle != NULL ) uartPrint(uart2_handle, str);
+}
+
+void uart0Println(char * str)
+{
+	if( uart0_handle != NULL ) uartPrintln(uart0_handle, str);
+}
+
+void uart2Println(char * str)
+{
+	if( uart2_handle != NULL ) uartPrintln(uart2_handle, str);
+}
+
+uart_char uart0Read(void)
+{
+	uart_char ch = { 0, 0};
+	return ( uart0_handle != NULL ) ? uartRead(uart0_handle) : ch;
+}
+
+uart_char uart2Read(void)
+{
+	uart_char ch = { 0, 0};
+	return ( uart2_handle != NULL ) ? uartRead(uart2_handle) : ch;
+}
+
+char * uart0ReadBytesUntil(char delimiter)
+{
+	return ( uart0_handle != NULL ) ? uartReadBytesUntil(uart0_handle, delimiter) : empty_string;
+}
+
+char * uart2ReadBytesUntil(char delimiter)
+{
+	return ( uart2_handle != NULL ) ? uartReadBytesUntil(uart2_handle, delimiter) : empty_string;
+}
+
+void uart0InputReset(void)
+{
+	if( uart0_handle != NULL ) uartInputReset(uart0_handle);
+}
+
+void uart2InputReset(void)
+{
+	if( uart2_handle != NULL ) uartInputReset(uart2_handle);
+}
+
+void uart0PrintInteger(int num)
+{
+	if( uart0_handle != NULL ) uartPrintInteger(uart0_handle, num);
+}
+
+void uart2PrintInteger(int num)
+{
+	if( uart2_handle != NULL ) uartPrintInteger(uart2_handle, num);
+}
+
+void uart0PrintHex(int num)
+{
+	if( uart0_handle != NULL ) uartPrintHex(uart0_handle, num);
+}
+
+void uart2PrintHex(int num)
+{
+	if( uart2_handle != NULL ) uartPrintHex(uart2_handle, num);
+}
 
@@ -10,24 +10,198 @@
 #define COMPONENTS_UTIL_UART_UTIL_UART_H_
 
 #include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "driver/uart.h"
+#include "esp_timer.h"
 
 #define UART_MAX_INTEGER_DIGITS 20
 
 #define UART0_RX_BUFFER_SIZE 200
 #define UART2_RX_BUFFER_SIZE 200
 
+#define UART0_TX_BUFFER_SIZE 1024
+#define UART2_TX_BUFFER_SIZE 1024
+
+#define UART_PRINT_BUFFER_SIZE 256
+
 #define UART0_TASK_STACK_SIZE 2048
 #define UART2_TASK_STACK_SIZE 2048
 
+#define UART_EVENT_QUEUE_SIZE 20
+#define UART_PATTERN_QUEUE_SIZE 16
+
+#define UART_READER_STOP_POLL_MS 100
+
+#define UART_LINE_MAX_LENGTH 200
+#define UART_LINE_QUEUE_SIZE 8
+#define UART_LINE_READER_STACK_SIZE 3072
+#define UART_LINE_READER_PRIORITY 10
+
+#define UART_FRAME_MAX_PAYLOAD 256
+#define UART_FRAME_OVERHEAD 4
+#define UART_FRAME_MAX_ENCODED (2 + UART_FRAME_MAX_PAYLOAD + UART_FRAME_OVERHEAD + (UART_FRAME_MAX_PAYLOAD + UART_FRAME_OVERHEAD) / 254 + 1)
+#define UART_FRAME_QUEUE_SIZE 4
+#define UART_FRAME_ACK_QUEUE_SIZE 4
+#define UART_FRAME_READER_STACK_SIZE 3072
+#define UART_FRAME_READER_PRIORITY 10
+
+#define UART_LATENCY_BUCKETS 12
+#define UART_LATENCY_MIN_SHIFT 7
+
+#define UART_BULK_BUFFER_COUNT 2
+#define UART_BULK_READER_STACK_SIZE 2048
+#define UART_BULK_READER_PRIORITY 12
+#define UART_BULK_RX_FULL_THRESHOLD 64
+#define UART_RX_FULL_THRESHOLD_DEFAULT 120
+
+#define UART_FRAME_TYPE_DATA 0X01
+#define UART_FRAME_TYPE_ACK 0X02
+#define UART_FRAME_FLAG_ACK_REQUEST 0X80
+
 typedef struct uart_char { char character; char flag; }uart_char;
 
+typedef struct uart_line { uint16_t len; int64_t time_us; char text[UART_LINE_MAX_LENGTH]; }uart_line;
+
+typedef void (*uart_line_callback)(uart_port_t, char *, uint16_t);
+
+typedef struct uart_line_reader { TaskHandle_t task; QueueHandle_t lines; uart_line_callback callback; char delimiter; volatile uint8_t stop; }uart_line_reader;
+
+typedef struct uart_frame { uint16_t len; uint8_t data[UART_FRAME_MAX_PAYLOAD]; }uart_frame;
+
+typedef void (*uart_frame_callback)(uart_port_t, const uint8_t *, uint16_t);
+
+typedef struct uart_frame_stats { uint32_t sent; uint32_t received; uint32_t crc_errors; uint32_t oversized; uint32_t overruns; uint32_t duplicates; uint32_t retransmits; uint32_t ack_timeouts; }uart_frame_stats;
+
+typedef struct uart_framer { TaskHandle_t task; volatile uint8_t stop; QueueHandle_t frames; QueueHandle_t acks; SemaphoreHandle_t send_lock; uart_frame_callback callback; uint8_t rx[UART_FRAME_MAX_PAYLOAD + UART_FRAME_OVERHEAD]; uint16_t rx_len; uint8_t code; uint8_t left; uint8_t discard; uint8_t tx_seq; int16_t rx_seq; uart_frame_stats stats; }uart_framer;
+
+typedef struct uart_bulk_buffer { uint8_t * data; size_t len; }uart_bulk_buffer;
+
+typedef struct uart_bulk_stats { uint64_t bytes; uint32_t buffers; uint32_t fifo_overflows; uint32_t ring_overflows; uint32_t dropped_bytes; uint32_t stalls; int64_t started_us; uint32_t bytes_per_second; }uart_bulk_stats;
+
+typedef struct uart_bulk { TaskHandle_t task; QueueHandle_t filled; QueueHandle_t empty; uint8_t * memory; size_t buffer_size; TickType_t idle; volatile uint8_t stop; uart_bulk_stats stats; }uart_bulk;
+
+typedef struct uart_port_stats { uint64_t bytes_in; uint64_t bytes_out; uint32_t fifo_overflows; uint32_t ring_overflows; uint32_t lines; uint32_t truncated_lines; uint32_t max_ring_used; uint32_t max_latency_us; uint32_t latency[UART_LATENCY_BUCKETS]; }uart_port_stats;
+
+typedef struct util_uart_config { uart_port_t port; int baud; int tx_pin; int rx_pin; int rts_pin; int cts_pin; uart_hw_flowcontrol_t flow_ctrl; uint8_t rx_flow_ctrl_thresh; uint16_t rx_ring_size; uint16_t tx_ring_size; uint16_t line_size; }util_uart_config;
+
+typedef struct util_uart_t { uart_port_t port; util_uart_config config; QueueHandle_t events; uart_line_reader reader; uart_framer * framer; uart_bulk * bulk; uart_port_stats stats; portMUX_TYPE stats_mux; char * line; uint16_t index; }util_uart_t;
+
+/*
+ * @brief : Default port configuration, pins are left as they are and flow control is disabled.
+ */
+#define UTIL_UART_DEFAULT_CONFIG(_port, _baud) { \
+	.port = (_port), \
+	.baud = (_baud), \
+	.tx_pin = UART_PIN_NO_CHANGE, \
+	.rx_pin = UART_PIN_NO_CHANGE, \
+	.rts_pin = UART_PIN_NO_CHANGE, \
+	.cts_pin = UART_PIN_NO_CHANGE, \
+	.flow_ctrl = UART_HW_FLOWCTRL_DISABLE, \
+	.rx_flow_ctrl_thresh = 0, \
+	.rx_ring_size = 512, \
+	.tx_ring_size = 1024, \
+	.line_size = UART_LINE_MAX_LENGTH, \
+}
+
+util_uart_t * uartBegin(const util_uart_config *);
+
+void uartEnd(util_uart_t *);
+
+void uartSend(util_uart_t *, char);
+
+void uartSendBytes(util_uart_t *, const char *, uint16_t);
+
+void uartPrint(util_uart_t *, const char *);
+
+void uartPrintln(util_uart_t *, const char *);
+
+int uartPrintf(util_uart_t *, const char *, ...) __attribute__((format(printf, 2, 3)));
+
+void uartPrintHexBytes(util_uart_t *, const uint8_t *, size_t);
+
+uart_char uartRead(util_uart_t *);
+
+char * uartReadBytesUntil(util_uart_t *, char);
+
+void uartInputReset(util_uart_t *);
+
+void uartPrintInteger(util_uart_t *, int);
+
+void uartPrintHex(util_uart_t *, int);
+
+uint8_t uartFormatUnsigned(char *, uint64_t, uint8_t, char);
+
+uint8_t uartFormatSigned(char *, int64_t, uint8_t, char);
+
+uint8_t uartFormatHex(char *, uint64_t, uint8_t);
+
+void uartPrintSigned(util_uart_t *, int64_t, uint8_t, char);
+
+void uartPrintUnsigned(util_uart_t *, uint64_t, uint8_t, char);
+
+void uartPrintHexPadded(util_uart_t *, uint64_t, uint8_t);
+
+void uartHexDump(util_uart_t *, const uint8_t *, size_t);
+
+esp_err_t uartStartLineReader(util_uart_t *, char, uart_line_callback);
+
+void uartStopLineReader(util_uart_t *);
+
+uint8_t uartReadLine(util_uart_t *, uart_line *, TickType_t);
+
+esp_err_t uartGetStats(util_uart_t *, uart_port_stats *);
+
+void uartResetStats(util_uart_t *);
+
+uint16_t uartCrc16(const uint8_t *, size_t);
+
+esp_err_t uartStartFrameReader(util_uart_t *, uart_frame_callback);
+
+void uartStopFrameReader(util_uart_t *);
+
+esp_err_t uartSendFrame(util_uart_t *, const uint8_t *, uint16_t);
+
+esp_err_t uartSendFrameReliable(util_uart_t *, const uint8_t *, uint16_t, TickType_t, uint8_t);
+
+uint8_t uartReadFrame(util_uart_t *, uart_frame *, TickType_t);
+
+esp_err_t uartGetFrameStats(util_uart_t *, uart_frame_stats *);
+
+esp_err_t uartBulkBegin(util_uart_t *, size_t, TickType_t);
+
+void uartBulkEnd(util_uart_t *);
+
+uint8_t uartBulkReceive(util_uart_t *, uart_bulk_buffer *, TickType_t);
+
+void uartBulkRelease(util_uart_t *, uart_bulk_buffer *);
+
+esp_err_t uartBulkGetStats(util_uart_t *, uart_bulk_stats *);
+
+void uartBulkResetStats(util_uart_t *);
+
+/*
+ * @brief : Fixed uart0/uart2 interface kept from earlier versions. New functionality is only added to the handle based
+ * API above; use uart0Handle()/uart2Handle() to reach it, or uartBegin() for any port including UART1.
+ */
+util_uart_t * uart0Handle(void);
+
+util_uart_t * uart2Handle(void);
+
 esp_err_t uart0_begin(int);
 
 esp_err_t uart2_begin(int);
 
+void uart0End(void);
+
+void uart2End(void);
+
 void uart0Send(char);
 
 void uart2Send(char);
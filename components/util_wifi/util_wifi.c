@@ -7,6 +7,10 @@
  */
 
 #include "util_wifi.h"
+#include "lwip/sockets.h"
+#include "esp_log.h"
+
+static const char * TAG = "util_wifi";
 
 static uint8_t tcpipInitialized = 0;
 
@@ -47,7 +51,9 @@ static esp_err_t create_default_event_loop()
 {
 	if( !eventLoop )
 	{
-		ESP_ERROR_CHECK(esp_event_loop_create_default());
+		// the application may have created the default loop already
+		esp_err_t _err = esp_event_loop_create_default();
+		if( _err != ESP_ERR_INVALID_STATE ) ESP_ERROR_CHECK(_err);
 		eventLoop = 1;
 
 	}
@@ -89,7 +95,7 @@ static esp_netif_t * sta_netif_obj = NULL;
  */
 static void register_sta_handlers()
 {
-	sta_netif_obj = esp_netif_create_default_wifi_sta();
+	if( sta_netif_obj == NULL ) sta_netif_obj = esp_netif_create_default_wifi_sta();
 }
 
 /*
@@ -125,7 +131,7 @@ static esp_netif_t * ap_netif_obj = NULL;
  */
 static void register_ap_handlers()
 {
-	ap_netif_obj = esp_netif_create_default_wifi_ap();
+	if( ap_netif_obj == NULL ) ap_netif_obj = esp_netif_create_default_wifi_ap();
 }
 
 /*
@@ -150,29 +156,104 @@ static esp_err_t unregister_ap_handlers()
 }
 
 /*
- * @brief : This variable holds maximum number of station that can connect to chip when in access point mode.
+ * @brief : This variable holds the softAP settings: channel (0 selects the least occupied one), maximum number of
+ * stations, bandwidth, beacon interval, authentication mode and whether the SSID is hidden.
  */
-static uint8_t ESP_AP_MAX_STA_CONN = 3;
+static wifi_ap_settings ap_settings = WIFI_AP_SETTINGS_DEFAULT();
 
 /*
- * @brief : This variable holds the WiFi channel number.
+ * @brief : softAP client counters and the function called when a client connects or disconnects.
  */
-static uint8_t ESP_AP_WIFI_CHANNEL = 11;
+static wifi_ap_stats ap_stats;
+static wifi_ap_client_callback ap_client_callback = NULL;
 
 /*
  * @brief : This variable holds the current WiFi mode.
  */
 static wifi_mode_t wifi_current_mode = WIFI_MODE_NULL;
 
-static esp_event_handler_instance_t wifi_event_handler;
+ESP_EVENT_DEFINE_BASE(UTIL_WIFI_EVENT);
 
-static esp_event_handler_instance_t network_event_handler;
+/*
+ * @brief : Handler instances of the WIFI_EVENT, IP_EVENT and UTIL_WIFI_EVENT registrations, NULL while not registered.
+ */
+static esp_event_handler_instance_t wifi_event_instance = NULL;
+static esp_event_handler_instance_t ip_event_instance = NULL;
+static esp_event_handler_instance_t util_event_instance = NULL;
 
 /*
  * @brief : This variable holds the whether WiFi is connected to an access point or not.
  */
 static uint8_t wifi_sta_connected = 0;
 
+/*
+ * @brief : Event group with WIFI_CONNECTED_BIT and WIFI_GOT_IP_BIT, so tasks can block until the network is ready.
+ * It is created once and never deleted, waiting tasks stay valid across stop_wifi().
+ */
+static EventGroupHandle_t wifi_event_group = NULL;
+static StaticEventGroup_t wifi_event_group_buffer;
+
+/*
+ * @brief : Reconnect policy, its state and statistics. Reconnects are scheduled on a one shot esp_timer, so an access
+ * point that is down does not cause a reconnect storm.
+ */
+static wifi_reconnect_policy reconnect_policy = WIFI_RECONNECT_POLICY_DEFAULT();
+static wifi_reconnect_stats reconnect_stats;
+static esp_timer_handle_t reconnect_timer = NULL;
+static uint32_t reconnect_delay_ms = 0;
+static int64_t sta_outage_start_us = 0;
+
+/*
+ * @brief : Modem sleep mode of the station and the listen interval, in beacon intervals, used with
+ * WIFI_PS_MAX_MODEM. WIFI_PS_MIN_MODEM is the driver default.
+ */
+static wifi_ps_type_t sta_ps_mode = WIFI_PS_MIN_MODEM;
+static uint16_t sta_listen_interval = WIFI_DEFAULT_LISTEN_INTERVAL;
+
+/*
+ * @brief : Cleared by stop_wifi() so the disconnect it causes is not answered with a reconnect.
+ */
+static uint8_t sta_reconnect_enabled = 0;
+
+/*
+ * @brief : Set while switch_wifi_mode() adds a station. The driver posts WIFI_EVENT_STA_START as soon as the mode is
+ * set, before the station configuration is, so that event is skipped and the switch connects itself.
+ */
+static volatile uint8_t sta_start_ignore = 0;
+
+/*
+ * @brief : Scan cache, sorted by RSSI with the strongest network first. It is filled from the event loop task and
+ * read by any task, so it is guarded by a spinlock. scan_records only receives the driver results.
+ */
+static wifi_scan_entry scan_cache[WIFI_SCAN_MAX_RESULTS];
+static uint8_t scan_cache_count = 0;
+static int64_t scan_completed_us = 0;
+static uint8_t scan_in_progress = 0;
+static wifi_ap_record_t scan_records[WIFI_SCAN_MAX_RESULTS];
+static portMUX_TYPE scan_cache_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/*
+ * @brief : Set while the fallback to the softAP waits for the scan that picks its channel.
+ */
+static uint8_t ap_fallback_scan = 0;
+
+/*
+ * @brief : Link telemetry ring buffer, written by a periodic esp_timer and read by any task. The byte counters are
+ * fed by the application through wifi_telemetry_count_bytes().
+ */
+static wifi_telemetry_sample telemetry_ring[WIFI_TELEMETRY_SAMPLES];
+static uint16_t telemetry_head = 0;
+static uint16_t telemetry_count = 0;
+static esp_timer_handle_t telemetry_timer = NULL;
+static uint32_t telemetry_tx_bytes = 0;
+static uint32_t telemetry_rx_bytes = 0;
+static portMUX_TYPE telemetry_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/*
+ * @brief : Functions called on IP_EVENT_STA_GOT_IP and when the IP is lost.
+ */
+static wifi_connection_callback connection_callbacks[WIFI_MAX_CONNECTION_CALLBACKS];
+
 /*
  * @brief : SSID of access point to connect to when in station mode
  */
@@ -195,6 +276,30 @@ static char ap_password[64];
 
 esp_netif_ip_info_t sta_ip_info;
 
+/*
+ * @brief : Fast connect settings. When enabled, the BSSID, channel and IP lease of the last successful connection are
+ * kept in NVS and used to skip the scan on the next start.
+ */
+static uint8_t sta_fast_connect = 0;
+static uint8_t sta_fast_static_ip = 0;
+
+/*
+ * @brief : Set while a connection attempt uses the cached BSSID and channel, cleared on success or fallback.
+ */
+static uint8_t sta_fast_attempt = 0;
+
+/*
+ * @brief : Cache loaded from NVS at start, and the values of the current connection to be saved on IP_EVENT_STA_GOT_IP.
+ */
+static wifi_sta_cache sta_cache;
+static wifi_sta_cache sta_pending_cache;
+
+/*
+ * @brief : Time begin_wifi_sta() was called, and the connection time metrics.
+ */
+static int64_t sta_connect_start_us = 0;
+static wifi_connect_metrics sta_metrics;
+
 /*
  * @brief: This function is used to set SSID of external access point
  *
@@ -265,203 +370,226 @@ void set_ap_password(char * password)
 }
 
 /*
- * @brief: Event handler for WiFi and Network events
+ * @brief: This function creates the connection event group on first use.
  *
  * @param:
- * 1. void * arg
- * 2. esp_event_base_t event_base
- * 3. int32_t event_id
- * 4. void * event_data
+ * none
  *
  * @return:
  * nothing
  */
-static void wifi_network_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
+static void create_wifi_event_group()
 {
-	if(event_base == WIFI_EVENT)
-	{
-		switch(event_id)
-		{
-		case WIFI_EVENT_STA_START:
-			esp_wifi_connect();
-			break;
-
-		case WIFI_EVENT_STA_CONNECTED:
-			wifi_sta_connected = 1;
-			break;
-
-		case WIFI_EVENT_STA_DISCONNECTED:
-			wifi_sta_connected = 0;
-			esp_wifi_connect();
-			break;
-
-		case WIFI_EVENT_AP_STACONNECTED:
-			break;
-
-		case WIFI_EVENT_AP_STADISCONNECTED:
-			break;
+	if( wifi_event_group == NULL ) wifi_event_group = xEventGroupCreateStatic(&wifi_event_group_buffer);
+}
 
-		}
-	}
-	else if(event_base == IP_EVENT)
+/*
+ * @brief: This function calls the registered connection callbacks.
+ *
+ * @param:
+ * 1. wifi_connection_state state : the new state.
+ * 2. const esp_netif_ip_info_t * ip_info : the IP configuration, NULL when the IP is lost.
+ *
+ * @return:
+ * nothing
+ */
+static void notify_connection_callbacks(wifi_connection_state state, const esp_netif_ip_info_t * ip_info)
+{
+	for( uint8_t i=0; i<WIFI_MAX_CONNECTION_CALLBACKS; i++ )
 	{
-		ip_event_got_ip_t* event;
-		switch(event_id)
-		{
-		case IP_EVENT_STA_GOT_IP:
-	        event = (ip_event_got_ip_t*) event_data;
-	        sta_ip_info = event->ip_info;
-			break;
-		}
+		if( connection_callbacks[i] != NULL ) connection_callbacks[i](state, ip_info);
 	}
 }
 
 /*
- * @brief: This function is used to initialize WiFi in station mode
+ * @brief: This function marks the station IP as lost and tells the callbacks, if it was up.
  *
  * @param:
  * none
  *
- * @return: esp_err_t
- * ESP_OK if the WiFi has initialized in station mode
- * ESP_FAIL if WiFi was already initialized
+ * @return:
+ * nothing
  */
-esp_err_t begin_wifi_sta()
+static void station_ip_lost()
 {
-	// If the WiFi is already in AP or STA mode then, exit the function
-	if( wifi_current_mode != WIFI_MODE_NULL)
-		return ESP_FAIL;
-
-	// initialize the TCP/IP stack
-	initialize_tcpip();
-
-	// create the default event loop
-	create_default_event_loop();
-
-	// register handlers
-	register_sta_handlers();
-
-
-	// WiFi configuration object with default settings
-	wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+	if( wifi_event_group == NULL ) return;
 
-	// initialize the WiFi driver
-	ESP_ERROR_CHECK(esp_wifi_init(&cfg));
-
-	// register more handlers
-	ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,ESP_EVENT_ANY_ID,&wifi_network_event_handler,NULL,&wifi_event_handler));
-	ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,ESP_EVENT_ANY_ID,&wifi_network_event_handler,NULL,&wifi_event_handler));
-
-	wifi_config_t wifi_config =
-    {
-        .sta = {
-			.threshold.authmode = WIFI_AUTH_WPA2_PSK,
+	EventBits_t bits = xEventGroupClearBits(wifi_event_group, WIFI_CONNECTED_BIT | WIFI_GOT_IP_BIT);
+	if( bits & WIFI_GOT_IP_BIT ) notify_connection_callbacks(WIFI_STATE_LOST_IP, NULL);
+}
 
-            .pmf_cfg = {
-                .capable = true,
-                .required = false
-            },
-        },
-    };
+/*
+ * @brief: This function blocks the calling task until the station has an IP address. Unlike polling
+ * isStationConnected(), which turns 1 as soon as the link is up, it returns only once the network can be used.
+ *
+ * @param:
+ * 1. TickType_t timeout : Maximum number of ticks to wait, portMAX_DELAY to wait forever.
+ *
+ * @return: esp_err_t
+ * ESP_OK if the station has an IP address
+ * ESP_ERR_TIMEOUT if the timeout expired
+ * ESP_ERR_INVALID_STATE if station mode was never started
+ */
+esp_err_t wifi_wait_for_ip(TickType_t timeout)
+{
+	if( wifi_event_group == NULL ) return ESP_ERR_INVALID_STATE;
 
-    memset( &(wifi_config.sta.ssid[0]), 0, 32);
-    memset( &(wifi_config.sta.password[0]), 0, 64);
+	EventBits_t bits = xEventGroupWaitBits(wifi_event_group, WIFI_GOT_IP_BIT, pdFALSE, pdTRUE, timeout);
+	return ( bits & WIFI_GOT_IP_BIT ) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
 
-    for(int i=0;i<strlen(sta_ssid);i++)
-    {
-    	wifi_config.sta.ssid[i]=sta_ssid[i];
-    }
-    for(int i=0;i<strlen(sta_password);i++)
-    {
-    	wifi_config.sta.password[i]=sta_password[i];
-    }
+/*
+ * @brief: This function registers a function to be called from the event loop task when the station gets or loses
+ * its IP address. Callbacks must not block.
+ *
+ * @param:
+ * 1. wifi_connection_callback callback : the function.
+ *
+ * @return: esp_err_t
+ * ESP_OK if the callback is registered or already was
+ * ESP_ERR_NO_MEM if WIFI_MAX_CONNECTION_CALLBACKS callbacks are registered
+ */
+esp_err_t register_wifi_connection_callback(wifi_connection_callback callback)
+{
+	int8_t slot = -1;
 
-	// setting the WiFi mode
-	ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+	for( int8_t i=0; i<WIFI_MAX_CONNECTION_CALLBACKS; i++ )
+	{
+		if( connection_callbacks[i] == callback ) return ESP_OK;
+		if( connection_callbacks[i] == NULL && slot < 0 ) slot = i;
+	}
+	if( slot < 0 ) return ESP_ERR_NO_MEM;
 
-	ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+	connection_callbacks[slot] = callback;
+	return ESP_OK;
+}
 
-	// start WiFi as per current settings
-	ESP_ERROR_CHECK(esp_wifi_start());
+/*
+ * @brief: This function unregisters a connection callback.
+ *
+ * @param:
+ * 1. wifi_connection_callback callback : the function.
+ *
+ * @return:
+ * nothing
+ */
+void unregister_wifi_connection_callback(wifi_connection_callback callback)
+{
+	for( uint8_t i=0; i<WIFI_MAX_CONNECTION_CALLBACKS; i++ )
+	{
+		if( connection_callbacks[i] == callback ) connection_callbacks[i] = NULL;
+	}
+}
 
-	// set the current mode variable to STA
-	wifi_current_mode = WIFI_MODE_STA;
+/*
+ * @brief: This function is used to enable fast connect in station mode. On the next begin_wifi_sta() the BSSID and
+ * channel of the last successful connection are used directly, without a full scan. If that connection fails a
+ * normal scan follows.
+ *
+ * @param:
+ * 1. uint8_t use_static_ip : if 1, the last IP lease is also configured statically, skipping DHCP.
+ *
+ * @return:
+ * nothing
+ */
+void enable_wifi_fast_connect(uint8_t use_static_ip)
+{
+	sta_fast_connect = 1;
+	sta_fast_static_ip = use_static_ip;
+}
 
-	return ESP_OK;
+/*
+ * @brief: This function is used to disable fast connect in station mode. The cache in NVS is kept.
+ *
+ * @param:
+ * none
+ *
+ * @return:
+ * nothing
+ */
+void disable_wifi_fast_connect()
+{
+	sta_fast_connect = 0;
+	sta_fast_static_ip = 0;
 }
 
 /*
- * @brief: This function is used to initialize WiFi in access point mode
+ * @brief: This function is used to erase the fast connect cache, for example after the access point was replaced.
  *
  * @param:
  * none
  *
  * @return: esp_err_t
- * ESP_OK if the WiFi has initialized in station mode
- * ESP_FAIL if WiFi was already initialized
+ * ESP_OK if the cache is erased
+ * ESP_FAIL otherwise
  */
-esp_err_t begin_wifi_ap()
+esp_err_t clear_wifi_fast_connect_cache()
 {
-	// If the WiFi is already in AP or STA mode then, exit the function
-	if( wifi_current_mode != WIFI_MODE_NULL)
-		return ESP_FAIL;
-
-	// initialize the TCP/IP stack
-	initialize_tcpip();
-
-	// create the default event loop
-	create_default_event_loop();
-
-	// register handlers
-	register_ap_handlers();
-
+	memset(&sta_cache, 0, sizeof(sta_cache));
+	return NVSStoreBlob(WIFI_NVS_NAMESPACE, WIFI_STA_CACHE_KEY, &sta_cache, sizeof(sta_cache));
+}
 
-	// WiFi configuration object with default settings
-	wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+/*
+ * @brief: This function is used to get the time-to-IP metrics of station mode connections.
+ *
+ * @param:
+ * 1. wifi_connect_metrics * metrics : Pointer to structure where the metrics will be stored.
+ *
+ * @return:
+ * nothing
+ */
+void get_wifi_connect_metrics(wifi_connect_metrics * metrics)
+{
+	*metrics = sta_metrics;
+}
 
-	// initialize the WiFi driver
-	ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+/*
+ * @brief: This function loads the fast connect cache from NVS and checks that it belongs to the configured SSID.
+ *
+ * @param:
+ * none
+ *
+ * @return: uint8_t
+ * 1 if a usable cache was loaded
+ * 0 otherwise
+ */
+static uint8_t load_sta_cache()
+{
+	size_t len = sizeof(sta_cache);
 
-	// register more handlers
-	ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,ESP_EVENT_ANY_ID,&wifi_network_event_handler,NULL,&wifi_event_handler));
-	ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,ESP_EVENT_ANY_ID,&wifi_network_event_handler,NULL,&wifi_event_handler));
-
-	wifi_config_t wifi_config = {
-		            .ap = {
-		                .ssid_len = strlen(ap_ssid),
-		                .channel = ESP_AP_WIFI_CHANNEL,
-		                .max_connection = ESP_AP_MAX_STA_CONN,
-		                .authmode = WIFI_AUTH_WPA_WPA2_PSK
-		            },
-	};
-
-	memset( &(wifi_config.ap.ssid[0]), 0, 32);
-	memset( &(wifi_config.ap.password[0]), 0, 64);
-	for(int i=0;i<strlen(ap_ssid);i++)
-	{
-		wifi_config.ap.ssid[i]=ap_ssid[i];
-	}
-	for(int i=0;i<strlen(ap_password);i++)
-	{
-		wifi_config.ap.password[i]=ap_password[i];
-	}
+	if( NVSReadBlob(WIFI_NVS_NAMESPACE, WIFI_STA_CACHE_KEY, &sta_cache, &len) != ESP_OK || len != sizeof(sta_cache) )
+		return 0;
 
-	// setting the WiFi mode
-	ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_AP));
+	if( sta_cache.magic != WIFI_STA_CACHE_MAGIC || strncmp(sta_cache.ssid, sta_ssid, sizeof(sta_cache.ssid)) != 0 )
+		return 0;
 
-	ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_AP, &wifi_config));
+	return sta_cache.channel != 0;
+}
 
-	// start WiFi as per current settings
-	ESP_ERROR_CHECK(esp_wifi_start());
+/*
+ * @brief: This function saves the BSSID, channel and IP lease of the current connection, only if they changed, so a
+ * device reconnecting to the same access point does not wear the flash.
+ *
+ * @param:
+ * none
+ *
+ * @return:
+ * nothing
+ */
+static void save_sta_cache()
+{
+	sta_pending_cache.magic = WIFI_STA_CACHE_MAGIC;
+	memcpy(sta_pending_cache.ssid, sta_ssid, sizeof(sta_pending_cache.ssid));
 
-	// set the current mode variable to AP
-	wifi_current_mode = WIFI_MODE_AP;
+	if( memcmp(&sta_pending_cache, &sta_cache, sizeof(sta_cache)) == 0 ) return;
 
-	return ESP_OK;
+	if( NVSStoreBlob(WIFI_NVS_NAMESPACE, WIFI_STA_CACHE_KEY, &sta_pending_cache, sizeof(sta_pending_cache)) == ESP_OK )
+		sta_cache = sta_pending_cache;
 }
 
 /*
- * @brief: This function is used to stop WiFi
+ * @brief: This function drops the cached BSSID, channel and static IP after a failed fast connect, so the next
+ * attempt scans all channels and uses DHCP.
  *
  * @param:
  * none
@@ -469,36 +597,1727 @@ esp_err_t begin_wifi_ap()
  * @return:
  * nothing
  */
-void stop_wifi()
+static void fast_connect_fallback()
 {
-	if( wifi_current_mode == WIFI_MODE_STA )
-	{
-		esp_wifi_disconnect();
-		esp_wifi_stop();
-		esp_wifi_deinit();
+	wifi_config_t wifi_config;
 
-		esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, wifi_event_handler);
-		esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, network_event_handler);
+	sta_fast_attempt = 0;
+	sta_metrics.fallbacks++;
+	sta_metrics.fast_path = 0;
 
-		unregister_sta_handlers();
+	if( esp_wifi_get_config(WIFI_IF_STA, &wifi_config) == ESP_OK )
+	{
+		wifi_config.sta.bssid_set = 0;
+		wifi_config.sta.channel = 0;
+		esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+	}
 
-		wifi_sta_connected = 0;
+	if( sta_fast_static_ip && sta_netif_obj != NULL ) esp_netif_dhcpc_start(sta_netif_obj);
+}
 
-		wifi_current_mode = WIFI_MODE_NULL;
+/*
+ * @brief: This function configures the station to connect to the cached access point directly.
+ *
+ * @param:
+ * 1. wifi_config_t * wifi_config : station configuration to update.
+ *
+ * @return:
+ * nothing
+ */
+static void apply_sta_cache(wifi_config_t * wifi_config)
+{
+	wifi_config->sta.bssid_set = 1;
+	memcpy(wifi_config->sta.bssid, sta_cache.bssid, sizeof(sta_cache.bssid));
+	wifi_config->sta.channel = sta_cache.channel;
 
-	}
-	else if( wifi_current_mode == WIFI_MODE_AP )
+	if( sta_fast_static_ip && sta_cache.ip_info.ip.addr != 0 )
 	{
-		esp_wifi_stop();
-		esp_wifi_deinit();
+		esp_netif_dns_info_t dns = { .ip = { .u_addr = { .ip4 = sta_cache.dns }, .type = ESP_IPADDR_TYPE_V4 } };
 
-		esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, wifi_event_handler);
-		esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, network_event_handler);
+		esp_netif_dhcpc_stop(sta_netif_obj);
+		esp_netif_set_ip_info(sta_netif_obj, &sta_cache.ip_info);
+		if( sta_cache.dns.addr != 0 ) esp_netif_set_dns_info(sta_netif_obj, ESP_NETIF_DNS_MAIN, &dns);
+	}
 
-		unregister_ap_handlers();
+	sta_fast_attempt = 1;
+	sta_metrics.fast_path = 1;
+	sta_metrics.fast_attempts++;
+}
 
-		wifi_current_mode = WIFI_MODE_NULL;
-	}
+/*
+ * @brief: This function maps a disconnect reason code to its slot in the statistics. Reasons 1 to 63 come from
+ * 802.11, 200 and above are reported by the ESP32 WiFi driver, slot 0 collects the others.
+ *
+ * @param:
+ * 1. uint8_t reason : the reason code.
+ *
+ * @return: uint8_t
+ * The slot.
+ */
+static uint8_t reason_slot(uint8_t reason)
+{
+	if( reason < 64 ) return reason;
+	if( reason >= 200 && reason < 200 + WIFI_REASON_SLOTS - 64 ) return 64 + reason - 200;
+	return 0;
+}
+
+/*
+ * @brief: This function is used to set the reconnect policy of station mode. It applies from the next disconnect.
+ *
+ * @param:
+ * 1. const wifi_reconnect_policy * policy : the policy, see WIFI_RECONNECT_POLICY_DEFAULT. A max_attempts of 0
+ * retries forever, fallback_to_ap starts the softAP once max_attempts reconnects have failed.
+ *
+ * @return:
+ * nothing
+ */
+void set_wifi_reconnect_policy(const wifi_reconnect_policy * policy)
+{
+	reconnect_policy = *policy;
+	if( reconnect_policy.multiplier == 0 ) reconnect_policy.multiplier = 1;
+	if( reconnect_policy.jitter_percent > 100 ) reconnect_policy.jitter_percent = 100;
+}
+
+/*
+ * @brief: This function is used to get the reconnect statistics of station mode.
+ *
+ * @param:
+ * 1. wifi_reconnect_stats * stats : Pointer to structure where the statistics will be stored.
+ *
+ * @return:
+ * nothing
+ */
+void get_wifi_reconnect_stats(wifi_reconnect_stats * stats)
+{
+	*stats = reconnect_stats;
+}
+
+/*
+ * @brief: This function is used to get how many disconnects had a given reason code.
+ *
+ * @param:
+ * 1. uint8_t reason : the reason code, see wifi_err_reason_t.
+ *
+ * @return: uint16_t
+ * Number of disconnects with this reason. Codes without their own slot share slot 0.
+ */
+uint16_t get_wifi_disconnect_count(uint8_t reason)
+{
+	return reconnect_stats.reasons[reason_slot(reason)];
+}
+
+/*
+ * @brief: This function switches from station mode to softAP mode once the reconnect attempts are used up. The
+ * driver keeps running, only the station interface is dropped. It runs in the event loop task, like the handling of
+ * the station events whose state it changes.
+ *
+ * @param:
+ * none
+ *
+ * @return:
+ * nothing
+ */
+static void fallback_to_ap()
+{
+	// the station may have been stopped or reconnected while the event was queued
+	if( !sta_reconnect_enabled || wifi_sta_connected ) return;
+
+	reconnect_stats.fallbacks_to_ap++;
+	switch_wifi_mode(WIFI_MODE_AP);
+}
+
+/*
+ * @brief: Reconnect timer callback, runs in the esp_timer task.
+ *
+ * @param:
+ * 1. void * arg : unused.
+ *
+ * @return:
+ * nothing
+ */
+static void reconnect_timer_callback(void * arg)
+{
+	if( !sta_reconnect_enabled ) return;
+
+	if( reconnect_policy.max_attempts != 0 && reconnect_stats.consecutive_failures >= reconnect_policy.max_attempts )
+	{
+		// the mode switch is left to the event loop task, a full event queue only delays it
+		if( reconnect_policy.fallback_to_ap && esp_event_post(UTIL_WIFI_EVENT, UTIL_WIFI_EVENT_FALLBACK_TO_AP, NULL, 0, 0) != ESP_OK )
+			esp_timer_start_once(reconnect_timer, (uint64_t)reconnect_policy.initial_delay_ms * 1000);
+		return;
+	}
+
+	reconnect_stats.attempts++;
+	esp_wifi_connect();
+}
+
+/*
+ * @brief: This function schedules the next reconnect. The delay grows by the policy multiplier after each failure,
+ * up to the maximum, with random jitter so that many devices do not retry in lock step.
+ *
+ * @param:
+ * none
+ *
+ * @return:
+ * nothing
+ */
+static void schedule_reconnect()
+{
+	if( reconnect_delay_ms == 0 ) reconnect_delay_ms = reconnect_policy.initial_delay_ms;
+	else
+	{
+		uint64_t next = (uint64_t)reconnect_delay_ms * reconnect_policy.multiplier;
+		reconnect_delay_ms = ( next > reconnect_policy.max_delay_ms ) ? reconnect_policy.max_delay_ms : (uint32_t)next;
+	}
+
+	uint32_t delay = reconnect_delay_ms;
+	uint32_t jitter = (uint64_t)delay * reconnect_policy.jitter_percent / 100;
+	if( jitter > 0 ) delay = delay - jitter + esp_random() % (2 * jitter + 1);
+
+	reconnect_stats.next_delay_ms = delay;
+
+	if( reconnect_timer == NULL )
+	{
+		esp_timer_create_args_t args = {
+			.callback = &reconnect_timer_callback,
+			.name = "wifi_reconnect",
+		};
+		if( esp_timer_create(&args, &reconnect_timer) != ESP_OK )
+		{
+			reconnect_timer = NULL;
+			esp_wifi_connect();
+			return;
+		}
+	}
+
+	esp_timer_stop(reconnect_timer);
+	esp_timer_start_once(reconnect_timer, (uint64_t)delay * 1000);
+}
+
+/*
+ * @brief: This function records a station disconnect and decides when to reconnect.
+ *
+ * @param:
+ * 1. uint8_t reason : the disconnect reason code.
+ *
+ * @return:
+ * nothing
+ */
+static void station_disconnected(uint8_t reason)
+{
+	reconnect_stats.disconnects++;
+	reconnect_stats.last_reason = reason;
+	reconnect_stats.reasons[reason_slot(reason)]++;
+
+	if( !sta_reconnect_enabled ) return;
+
+	if( sta_outage_start_us == 0 ) sta_outage_start_us = esp_timer_get_time();
+
+	// a failed fast connect is not an outage, the full scan is tried right away
+	if( sta_fast_attempt )
+	{
+		fast_connect_fallback();
+		reconnect_stats.attempts++;
+		esp_wifi_connect();
+		return;
+	}
+
+	reconnect_stats.consecutive_failures++;
+	schedule_reconnect();
+}
+
+/*
+ * @brief: This function resets the backoff once the station has an IP address.
+ *
+ * @param:
+ * none
+ *
+ * @return:
+ * nothing
+ */
+static void station_reconnected()
+{
+	if( sta_outage_start_us != 0 )
+	{
+		uint32_t outage = (esp_timer_get_time() - sta_outage_start_us) / 1000;
+		if( outage > reconnect_stats.longest_outage_ms ) reconnect_stats.longest_outage_ms = outage;
+		sta_outage_start_us = 0;
+	}
+	reconnect_stats.consecutive_failures = 0;
+	reconnect_stats.next_delay_ms = 0;
+	reconnect_delay_ms = 0;
+}
+
+/*
+ * @brief: This function is used to select the modem sleep mode of the station. WIFI_PS_NONE gives the lowest latency,
+ * WIFI_PS_MIN_MODEM wakes for every DTIM beacon and WIFI_PS_MAX_MODEM only every listen_interval beacons, trading
+ * latency for power. The mode applies immediately if station mode is running, the listen interval from the next
+ * association with the access point.
+ *
+ * @param:
+ * 1. wifi_ps_type_t mode : WIFI_PS_NONE, WIFI_PS_MIN_MODEM or WIFI_PS_MAX_MODEM.
+ * 2. uint16_t listen_interval : beacon intervals between wake ups in WIFI_PS_MAX_MODEM, 0 for the default of 3.
+ *
+ * @return: esp_err_t
+ * ESP_OK if the mode is set
+ * Error code of the WiFi driver otherwise
+ */
+esp_err_t set_wifi_power_save(wifi_ps_type_t mode, uint16_t listen_interval)
+{
+	wifi_config_t wifi_config;
+
+	sta_ps_mode = mode;
+	sta_listen_interval = ( listen_interval != 0 ) ? listen_interval : WIFI_DEFAULT_LISTEN_INTERVAL;
+
+	if( wifi_current_mode != WIFI_MODE_STA ) return ESP_OK;
+
+	if( esp_wifi_get_config(WIFI_IF_STA, &wifi_config) == ESP_OK && wifi_config.sta.listen_interval != sta_listen_interval )
+	{
+		wifi_config.sta.listen_interval = sta_listen_interval;
+		esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+	}
+
+	return esp_wifi_set_ps(mode);
+}
+
+/*
+ * @brief: This function is used to get the modem sleep mode of the station.
+ *
+ * @param:
+ * none
+ *
+ * @return: wifi_ps_type_t
+ * The mode.
+ */
+wifi_ps_type_t get_wifi_power_save()
+{
+	return sta_ps_mode;
+}
+
+/*
+ * @brief: This function measures the round trip time of UDP packets sent to an echo server, for example
+ * test_programs/udp_echo.py. Each packet carries a sequence number, late replies to earlier packets are skipped.
+ * It blocks the calling task for up to count * (interval_ms + timeout_ms).
+ *
+ * @param:
+ * 1. const char * host : IPv4 address of the echo server.
+ * 2. uint16_t port : UDP port of the echo server.
+ * 3. uint16_t count : number of packets.
+ * 4. uint32_t interval_ms : pause after each packet, long enough lets the modem go to sleep in between.
+ * 5. uint32_t timeout_ms : time to wait for each reply.
+ * 6. wifi_rtt_result * result : Pointer to structure where the result will be stored.
+ *
+ * @return: esp_err_t
+ * ESP_OK if at least one reply was received
+ * ESP_ERR_TIMEOUT if no reply was received
+ * ESP_ERR_INVALID_ARG if the address is invalid
+ * ESP_FAIL if the socket could not be created
+ */
+esp_err_t wifi_measure_udp_rtt(const char * host, uint16_t port, uint16_t count, uint32_t interval_ms, uint32_t timeout_ms, wifi_rtt_result * result)
+{
+	struct sockaddr_in dest;
+	struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+	uint8_t packet[WIFI_RTT_PAYLOAD_SIZE];
+	uint8_t reply[WIFI_RTT_PAYLOAD_SIZE];
+	uint64_t total = 0;
+
+	memset(&dest, 0, sizeof(dest));
+	dest.sin_family = AF_INET;
+	dest.sin_port = htons(port);
+	if( inet_aton(host, &dest.sin_addr) == 0 ) return ESP_ERR_INVALID_ARG;
+
+	int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+	if( sock < 0 ) return ESP_FAIL;
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	memset(result, 0, sizeof(wifi_rtt_result));
+	result->mode = sta_ps_mode;
+	result->listen_interval = sta_listen_interval;
+	result->min_us = UINT32_MAX;
+
+	memset(packet, 0, sizeof(packet));
+
+	for( uint16_t seq=0; seq<count; seq++ )
+	{
+		memcpy(packet, &seq, sizeof(seq));
+
+		int64_t start = esp_timer_get_time();
+		if( sendto(sock, packet, sizeof(packet), 0, (struct sockaddr *)&dest, sizeof(dest)) < 0 ) continue;
+		result->sent++;
+
+		for(;;)
+		{
+			int len = recvfrom(sock, reply, sizeof(reply), 0, NULL, NULL);
+			if( len < 0 ) break;
+			if( len < sizeof(seq) || memcmp(reply, &seq, sizeof(seq)) != 0 ) continue;
+
+			uint32_t rtt = esp_timer_get_time() - start;
+			if( rtt < result->min_us ) result->min_us = rtt;
+			if( rtt > result->max_us ) result->max_us = rtt;
+			total += rtt;
+			result->received++;
+			break;
+		}
+
+		if( interval_ms > 0 ) vTaskDelay(pdMS_TO_TICKS(interval_ms));
+	}
+
+	close(sock);
+
+	if( result->received == 0 )
+	{
+		result->min_us = 0;
+		return ESP_ERR_TIMEOUT;
+	}
+	result->avg_us = total / result->received;
+	return ESP_OK;
+}
+
+/*
+ * @brief: This function runs wifi_measure_udp_rtt() once in each modem sleep mode and restores the current mode.
+ * Packets are sent every 500 ms so the modem sleeps between them. Supply current has to be measured externally while
+ * each mode runs, the results say which mode was active.
+ *
+ * @param:
+ * 1. const char * host : IPv4 address of the echo server.
+ * 2. uint16_t port : UDP port of the echo server.
+ * 3. uint16_t count : number of packets per mode.
+ * 4. uint16_t listen_interval : listen interval for WIFI_PS_MAX_MODEM.
+ * 5. wifi_rtt_result * results : array of 3 results, for WIFI_PS_NONE, WIFI_PS_MIN_MODEM and WIFI_PS_MAX_MODEM.
+ *
+ * @return: esp_err_t
+ * ESP_OK if every mode got replies
+ * Error code of the first failing mode otherwise
+ */
+esp_err_t wifi_benchmark_power_modes(const char * host, uint16_t port, uint16_t count, uint16_t listen_interval, wifi_rtt_result * results)
+{
+	const wifi_ps_type_t modes[3] = { WIFI_PS_NONE, WIFI_PS_MIN_MODEM, WIFI_PS_MAX_MODEM };
+	wifi_ps_type_t saved_mode = sta_ps_mode;
+	uint16_t saved_interval = sta_listen_interval;
+	esp_err_t _err = ESP_OK;
+
+	if( wifi_current_mode != WIFI_MODE_STA ) return ESP_ERR_INVALID_STATE;
+
+	for( uint8_t i=0; i<3; i++ )
+	{
+		set_wifi_power_save(modes[i], listen_interval);
+		esp_err_t mode_err = wifi_measure_udp_rtt(host, port, count, 500, 1000, &results[i]);
+		if( _err == ESP_OK ) _err = mode_err;
+	}
+
+	set_wifi_power_save(saved_mode, saved_interval);
+	return _err;
+}
+
+/*
+ * @brief: This function merges the results of a finished scan into the cache. Networks seen again are updated,
+ * new ones replace the oldest entries once the cache is full, then the cache is sorted by RSSI.
+ *
+ * @param:
+ * none
+ *
+ * @return:
+ * nothing
+ */
+static void store_scan_results()
+{
+	uint16_t number = WIFI_SCAN_MAX_RESULTS;
+	int64_t now = esp_timer_get_time();
+
+	if( esp_wifi_scan_get_ap_records(&number, scan_records) != ESP_OK ) number = 0;
+
+	portENTER_CRITICAL(&scan_cache_mux);
+
+	for( uint16_t i=0; i<number; i++ )
+	{
+		uint8_t slot = scan_cache_count;
+
+		for( uint8_t j=0; j<scan_cache_count; j++ )
+		{
+			if( memcmp(scan_cache[j].bssid, scan_records[i].bssid, 6) == 0 )
+			{
+				slot = j;
+				break;
+			}
+		}
+		if( slot == WIFI_SCAN_MAX_RESULTS )
+		{
+			slot = 0;
+			for( uint8_t j=1; j<scan_cache_count; j++ )
+			{
+				if( scan_cache[j].seen_us < scan_cache[slot].seen_us ) slot = j;
+			}
+		}
+		if( slot == scan_cache_count ) scan_cache_count++;
+
+		wifi_scan_entry * entry = &scan_cache[slot];
+		memcpy(entry->bssid, scan_records[i].bssid, 6);
+		memcpy(entry->ssid, scan_records[i].ssid, sizeof(entry->ssid));
+		entry->ssid[sizeof(entry->ssid) - 1] = '\0';
+		entry->channel = scan_records[i].primary;
+		entry->rssi = scan_records[i].rssi;
+		entry->authmode = scan_records[i].authmode;
+		entry->seen_us = now;
+	}
+
+	// insertion sort, the cache is small and mostly sorted already
+	for( uint8_t i=1; i<scan_cache_count; i++ )
+	{
+		wifi_scan_entry entry = scan_cache[i];
+		int8_t j = i - 1;
+		while( j >= 0 && scan_cache[j].rssi < entry.rssi )
+		{
+			scan_cache[j + 1] = scan_cache[j];
+			j--;
+		}
+		scan_cache[j + 1] = entry;
+	}
+
+	scan_completed_us = now;
+	scan_in_progress = 0;
+
+	portEXIT_CRITICAL(&scan_cache_mux);
+
+	xEventGroupSetBits(wifi_event_group, WIFI_SCAN_DONE_BIT);
+}
+
+/*
+ * @brief: This function starts a scan unless the cache is fresh, see start_wifi_scan(). The driver must be running
+ * with a station interface.
+ *
+ * @param:
+ * 1. const wifi_scan_options * options : the scan options, NULL for an active scan of all channels.
+ * 2. uint32_t max_age_ms : freshness window of the cache, 0 to always scan.
+ *
+ * @return: esp_err_t
+ * ESP_OK if a scan is started or the cache is fresh
+ * ESP_ERR_INVALID_STATE if a scan is already in progress
+ * Error code of the WiFi driver otherwise
+ */
+static esp_err_t start_scan(const wifi_scan_options * options, uint32_t max_age_ms)
+{
+	wifi_scan_config_t scan_config;
+	esp_err_t _err;
+
+	portENTER_CRITICAL(&scan_cache_mux);
+	uint8_t busy = scan_in_progress;
+	uint8_t fresh = ( max_age_ms != 0 && scan_completed_us != 0 && esp_timer_get_time() - scan_completed_us < (int64_t)max_age_ms * 1000 );
+	if( !busy && !fresh ) scan_in_progress = 1;
+	portEXIT_CRITICAL(&scan_cache_mux);
+
+	if( busy ) return ESP_ERR_INVALID_STATE;
+	if( fresh )
+	{
+		xEventGroupSetBits(wifi_event_group, WIFI_SCAN_DONE_BIT);
+		return ESP_OK;
+	}
+
+	memset(&scan_config, 0, sizeof(scan_config));
+	if( options != NULL )
+	{
+		scan_config.channel = options->channel;
+		scan_config.show_hidden = options->show_hidden;
+		scan_config.scan_type = options->passive ? WIFI_SCAN_TYPE_PASSIVE : WIFI_SCAN_TYPE_ACTIVE;
+		if( options->passive ) scan_config.scan_time.passive = options->dwell_ms;
+		else scan_config.scan_time.active.max = options->dwell_ms;
+	}
+
+	xEventGroupClearBits(wifi_event_group, WIFI_SCAN_DONE_BIT);
+
+	_err = esp_wifi_scan_start(&scan_config, false);
+	if( _err != ESP_OK ) scan_in_progress = 0;
+
+	return _err;
+}
+
+/*
+ * @brief: This function is used to start a scan without blocking. If the last scan finished less than max_age_ms ago
+ * the cache is fresh and no scan is started. Results are read with get_wifi_scan_results() once wait_wifi_scan()
+ * returns. A passive scan or a single channel shortens the scan considerably.
+ *
+ * @param:
+ * 1. const wifi_scan_options * options : passive or active, channel (0 for all), time per channel in ms (0 for the
+ * driver default) and whether hidden networks are reported. NULL for an active scan of all channels.
+ * 2. uint32_t max_age_ms : freshness window of the cache, 0 to always scan.
+ *
+ * @return: esp_err_t
+ * ESP_OK if a scan is started or the cache is fresh
+ * ESP_ERR_INVALID_STATE if no station interface is running or a scan is already in progress
+ * Error code of the WiFi driver otherwise
+ */
+esp_err_t start_wifi_scan(const wifi_scan_options * options, uint32_t max_age_ms)
+{
+	if( wifi_current_mode != WIFI_MODE_STA && wifi_current_mode != WIFI_MODE_APSTA ) return ESP_ERR_INVALID_STATE;
+
+	return start_scan(options, max_age_ms);
+}
+
+/*
+ * @brief: This function blocks the calling task until the scan started by start_wifi_scan() is finished.
+ *
+ * @param:
+ * 1. TickType_t timeout : Maximum number of ticks to wait.
+ *
+ * @return: esp_err_t
+ * ESP_OK if the scan is finished
+ * ESP_ERR_TIMEOUT if the timeout expired
+ * ESP_ERR_INVALID_STATE if WiFi was never started in station mode
+ */
+esp_err_t wait_wifi_scan(TickType_t timeout)
+{
+	if( wifi_event_group == NULL ) return ESP_ERR_INVALID_STATE;
+
+	EventBits_t bits = xEventGroupWaitBits(wifi_event_group, WIFI_SCAN_DONE_BIT, pdFALSE, pdTRUE, timeout);
+	return ( bits & WIFI_SCAN_DONE_BIT ) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+/*
+ * @brief: This function is used to read networks from the scan cache, strongest first, without scanning.
+ *
+ * @param:
+ * 1. wifi_scan_entry * results : destination array.
+ * 2. uint8_t max : size of the destination array.
+ * 3. uint32_t max_age_ms : only networks seen within this many ms are returned, 0 for all.
+ *
+ * @return: uint8_t
+ * Number of networks stored in results.
+ */
+uint8_t get_wifi_scan_results(wifi_scan_entry * results, uint8_t max, uint32_t max_age_ms)
+{
+	int64_t oldest = esp_timer_get_time() - (int64_t)max_age_ms * 1000;
+	uint8_t count = 0;
+
+	portENTER_CRITICAL(&scan_cache_mux);
+	for( uint8_t i=0; i<scan_cache_count && count<max; i++ )
+	{
+		if( max_age_ms != 0 && scan_cache[i].seen_us < oldest ) continue;
+		results[count++] = scan_cache[i];
+	}
+	portEXIT_CRITICAL(&scan_cache_mux);
+
+	return count;
+}
+
+/*
+ * @brief: This function is used to look up the strongest access point of a network in the scan cache.
+ *
+ * @param:
+ * 1. const char * ssid : SSID of the network.
+ * 2. uint32_t max_age_ms : only access points seen within this many ms are considered, 0 for all.
+ * 3. wifi_scan_entry * result : Pointer to structure where the access point will be stored.
+ *
+ * @return: esp_err_t
+ * ESP_OK if the network was found
+ * ESP_ERR_NOT_FOUND otherwise
+ */
+esp_err_t find_wifi_network(const char * ssid, uint32_t max_age_ms, wifi_scan_entry * result)
+{
+	int64_t oldest = esp_timer_get_time() - (int64_t)max_age_ms * 1000;
+	esp_err_t _err = ESP_ERR_NOT_FOUND;
+
+	portENTER_CRITICAL(&scan_cache_mux);
+	for( uint8_t i=0; i<scan_cache_count; i++ )
+	{
+		if( max_age_ms != 0 && scan_cache[i].seen_us < oldest ) continue;
+		if( strcmp(scan_cache[i].ssid, ssid) == 0 )
+		{
+			*result = scan_cache[i];
+			_err = ESP_OK;
+			break;
+		}
+	}
+	portEXIT_CRITICAL(&scan_cache_mux);
+
+	return _err;
+}
+
+/*
+ * @brief: This function checks whether a scan finished within the last max_age_ms.
+ *
+ * @param:
+ * 1. uint32_t max_age_ms : freshness window, 0 for any scan since boot.
+ *
+ * @return: uint8_t
+ * 1 fresh
+ * 0 no scan or too old
+ */
+static uint8_t scan_cache_fresh(uint32_t max_age_ms)
+{
+	portENTER_CRITICAL(&scan_cache_mux);
+	uint8_t fresh = ( scan_completed_us != 0 && ( max_age_ms == 0 || esp_timer_get_time() - scan_completed_us < (int64_t)max_age_ms * 1000 ) );
+	portEXIT_CRITICAL(&scan_cache_mux);
+
+	return fresh;
+}
+
+/*
+ * @brief: This function picks the least occupied 2.4 GHz channel from the scan cache. Every network adds its signal
+ * strength to the channels its 20 MHz overlaps (4 channels either side), fading with distance. Channels 1, 6 and
+ * 11 are preferred when scores are equal. A scan that found no network at all gives channel 1.
+ *
+ * @param:
+ * 1. uint32_t max_age_ms : only a scan that finished within this many ms is used, 0 for any.
+ *
+ * @return: uint8_t
+ * The channel, 1 to 13.
+ * 0 if no scan finished within max_age_ms, scan from station or AP+STA mode first.
+ */
+uint8_t select_wifi_ap_channel(uint32_t max_age_ms)
+{
+	const uint8_t candidates[13] = { 1, 6, 11, 2, 3, 4, 5, 7, 8, 9, 10, 12, 13 };
+	uint32_t score[14];
+	int64_t oldest = esp_timer_get_time() - (int64_t)max_age_ms * 1000;
+
+	if( !scan_cache_fresh(max_age_ms) ) return 0;
+
+	memset(score, 0, sizeof(score));
+
+	portENTER_CRITICAL(&scan_cache_mux);
+	for( uint8_t i=0; i<scan_cache_count; i++ )
+	{
+		if( max_age_ms != 0 && scan_cache[i].seen_us < oldest ) continue;
+
+		// -100 dBm counts as nothing, -30 dBm as 70
+		int16_t strength = scan_cache[i].rssi + 100;
+		if( strength <= 0 ) continue;
+
+		for( uint8_t c=1; c<=13; c++ )
+		{
+			uint8_t distance = ( c > scan_cache[i].channel ) ? c - scan_cache[i].channel : scan_cache[i].channel - c;
+			if( distance < 5 ) score[c] += strength * (5 - distance);
+		}
+	}
+	portEXIT_CRITICAL(&scan_cache_mux);
+
+	uint8_t best = candidates[0];
+	for( uint8_t i=1; i<13; i++ )
+	{
+		if( score[candidates[i]] < score[best] ) best = candidates[i];
+	}
+
+	return best;
+}
+
+/*
+ * @brief: This function makes sure a scan recent enough to pick the softAP channel is in the cache, running a passive
+ * scan of all channels if there is none. The station interface must be running and idle.
+ *
+ * @param:
+ * none
+ *
+ * @return: esp_err_t
+ * ESP_OK if the cache is fresh
+ * ESP_ERR_INVALID_STATE if called from the event loop task, which stores the scan results and can not wait for them
+ * ESP_ERR_TIMEOUT if the scan did not finish in WIFI_AP_CHANNEL_SCAN_TIMEOUT_MS
+ * Error code of the WiFi driver otherwise, for example while the station connects
+ */
+static esp_err_t scan_ap_channels()
+{
+	wifi_scan_options options = { .passive = 1, .channel = 0, .dwell_ms = WIFI_AP_CHANNEL_SCAN_DWELL_MS, .show_hidden = 1 };
+	esp_err_t _err;
+
+	if( scan_cache_fresh(WIFI_AP_CHANNEL_MAX_AGE_MS) ) return ESP_OK;
+	if( xTaskGetCurrentTaskHandle() == xTaskGetHandle("sys_evt") ) return ESP_ERR_INVALID_STATE;
+
+	create_wifi_event_group();
+
+	_err = start_scan(&options, 0);
+	if( _err == ESP_OK ) _err = wait_wifi_scan(pdMS_TO_TICKS(WIFI_AP_CHANNEL_SCAN_TIMEOUT_MS));
+	if( _err == ESP_ERR_TIMEOUT )
+	{
+		esp_wifi_scan_stop();
+		portENTER_CRITICAL(&scan_cache_mux);
+		scan_in_progress = 0;
+		portEXIT_CRITICAL(&scan_cache_mux);
+	}
+
+	return _err;
+}
+
+/*
+ * @brief: This function starts the scan the fallback to the softAP needs for an automatic channel. It runs in the
+ * event loop task, which can not wait for the scan: the switch is made when WIFI_EVENT_SCAN_DONE is handled.
+ *
+ * @param:
+ * none
+ *
+ * @return: uint8_t
+ * 1 the fallback waits for a scan
+ * 0 the fallback can switch now
+ */
+static uint8_t start_ap_fallback_scan()
+{
+	wifi_scan_options options = { .passive = 1, .channel = 0, .dwell_ms = WIFI_AP_CHANNEL_SCAN_DWELL_MS, .show_hidden = 1 };
+
+	if( !sta_reconnect_enabled || wifi_sta_connected ) return 0;
+	if( ap_settings.channel != 0 || scan_cache_fresh(WIFI_AP_CHANNEL_MAX_AGE_MS) ) return 0;
+
+	// one scan at a time, a fallback posted again while it runs is answered when it is done
+	if( ap_fallback_scan ) return 1;
+
+	if( start_scan(&options, 0) != ESP_OK ) return 0;
+	ap_fallback_scan = 1;
+	return 1;
+}
+
+/*
+ * @brief: Telemetry timer callback, runs in the esp_timer task. It samples the link of the station and appends the
+ * sample to the ring buffer, overwriting the oldest one.
+ *
+ * @param:
+ * 1. void * arg : unused.
+ *
+ * @return:
+ * nothing
+ */
+static void telemetry_timer_callback(void * arg)
+{
+	wifi_telemetry_sample sample;
+	wifi_ap_record_t ap_info;
+
+	memset(&sample, 0, sizeof(sample));
+	sample.time_us = esp_timer_get_time();
+
+	if( wifi_sta_connected && esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK )
+	{
+		sample.connected = 1;
+		sample.rssi = ap_info.rssi;
+		sample.channel = ap_info.primary;
+		sample.phy = ( ap_info.phy_11b ? WIFI_PHY_11B : 0 ) | ( ap_info.phy_11g ? WIFI_PHY_11G : 0 ) |
+				( ap_info.phy_11n ? WIFI_PHY_11N : 0 ) | ( ap_info.phy_lr ? WIFI_PHY_LR : 0 );
+	}
+
+	sample.last_reason = reconnect_stats.last_reason;
+	sample.disconnects = reconnect_stats.disconnects;
+
+	portENTER_CRITICAL(&telemetry_mux);
+	sample.tx_bytes = telemetry_tx_bytes;
+	sample.rx_bytes = telemetry_rx_bytes;
+	telemetry_ring[telemetry_head] = sample;
+	telemetry_head = ( telemetry_head + 1 ) % WIFI_TELEMETRY_SAMPLES;
+	if( telemetry_count < WIFI_TELEMETRY_SAMPLES ) telemetry_count++;
+	portEXIT_CRITICAL(&telemetry_mux);
+}
+
+/*
+ * @brief: This function is used to start sampling link telemetry: RSSI, channel, PHY modes of the access point,
+ * disconnect count and last reason, and the byte counters. The last WIFI_TELEMETRY_SAMPLES samples are kept.
+ *
+ * @param:
+ * 1. uint32_t period_ms : sampling period.
+ *
+ * @return: esp_err_t
+ * ESP_OK if sampling is started
+ * ESP_ERR_INVALID_ARG if the period is 0
+ * Error code of esp_timer otherwise
+ */
+esp_err_t start_wifi_telemetry(uint32_t period_ms)
+{
+	esp_err_t _err;
+
+	if( period_ms == 0 ) return ESP_ERR_INVALID_ARG;
+
+	if( telemetry_timer == NULL )
+	{
+		esp_timer_create_args_t args = {
+			.callback = &telemetry_timer_callback,
+			.name = "wifi_telemetry",
+		};
+		_err = esp_timer_create(&args, &telemetry_timer);
+		if( _err != ESP_OK )
+		{
+			telemetry_timer = NULL;
+			return _err;
+		}
+	}
+
+	esp_timer_stop(telemetry_timer);
+	return esp_timer_start_periodic(telemetry_timer, (uint64_t)period_ms * 1000);
+}
+
+/*
+ * @brief: This function is used to stop sampling link telemetry. Collected samples are kept.
+ *
+ * @param:
+ * none
+ *
+ * @return:
+ * nothing
+ */
+void stop_wifi_telemetry()
+{
+	if( telemetry_timer != NULL ) esp_timer_stop(telemetry_timer);
+}
+
+/*
+ * @brief: This function is used to add to the byte counters of the telemetry, for example from the code that sends
+ * and receives on the network. The counters wrap around, consumers should use differences between samples.
+ *
+ * @param:
+ * 1. uint32_t tx : bytes sent.
+ * 2. uint32_t rx : bytes received.
+ *
+ * @return:
+ * nothing
+ */
+void wifi_telemetry_count_bytes(uint32_t tx, uint32_t rx)
+{
+	portENTER_CRITICAL(&telemetry_mux);
+	telemetry_tx_bytes += tx;
+	telemetry_rx_bytes += rx;
+	portEXIT_CRITICAL(&telemetry_mux);
+}
+
+/*
+ * @brief: This function is used to read the most recent telemetry samples, oldest first.
+ *
+ * @param:
+ * 1. wifi_telemetry_sample * samples : destination array.
+ * 2. uint16_t max : size of the destination array.
+ *
+ * @return: uint16_t
+ * Number of samples stored.
+ */
+uint16_t get_wifi_telemetry(wifi_telemetry_sample * samples, uint16_t max)
+{
+	portENTER_CRITICAL(&telemetry_mux);
+
+	uint16_t count = ( max < telemetry_count ) ? max : telemetry_count;
+	uint16_t index = ( telemetry_head + WIFI_TELEMETRY_SAMPLES - count ) % WIFI_TELEMETRY_SAMPLES;
+
+	for( uint16_t i=0; i<count; i++ )
+	{
+		samples[i] = telemetry_ring[index];
+		index = ( index + 1 ) % WIFI_TELEMETRY_SAMPLES;
+	}
+
+	portEXIT_CRITICAL(&telemetry_mux);
+	return count;
+}
+
+/*
+ * @brief: This function formats a telemetry sample as one line of comma separated key=value pairs, ready to be sent
+ * over UART or vispr.
+ *
+ * @param:
+ * 1. const wifi_telemetry_sample * sample : the sample.
+ * 2. char * buff : destination.
+ * 3. size_t size : size of the destination.
+ *
+ * @return: int
+ * Number of characters written, as snprintf.
+ */
+int format_wifi_telemetry(const wifi_telemetry_sample * sample, char * buff, size_t size)
+{
+	return snprintf(buff, size, "t=%lld,up=%u,rssi=%d,ch=%u,phy=%s%s%s%s,disc=%u,reason=%u,tx=%u,rx=%u",
+			(long long)(sample->time_us / 1000), sample->connected, sample->rssi, sample->channel,
+			( sample->phy & WIFI_PHY_11B ) ? "b" : "", ( sample->phy & WIFI_PHY_11G ) ? "g" : "",
+			( sample->phy & WIFI_PHY_11N ) ? "n" : "", ( sample->phy & WIFI_PHY_LR ) ? "l" : "",
+			(unsigned)sample->disconnects, sample->last_reason, (unsigned)sample->tx_bytes, (unsigned)sample->rx_bytes);
+}
+
+/*
+ * @brief: Event handler for WiFi and Network events
+ *
+ * @param:
+ * 1. void * arg
+ * 2. esp_event_base_t event_base
+ * 3. int32_t event_id
+ * 4. void * event_data
+ *
+ * @return:
+ * nothing
+ */
+static void wifi_network_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
+{
+	if(event_base == WIFI_EVENT)
+	{
+		switch(event_id)
+		{
+		case WIFI_EVENT_SCAN_DONE:
+			store_scan_results();
+			if( ap_fallback_scan )
+			{
+				ap_fallback_scan = 0;
+				fallback_to_ap();
+			}
+			break;
+
+		case WIFI_EVENT_STA_START:
+			if( sta_start_ignore )
+			{
+				sta_start_ignore = 0;
+				break;
+			}
+			reconnect_stats.attempts++;
+			esp_wifi_connect();
+			break;
+
+		case WIFI_EVENT_STA_CONNECTED:
+		{
+			wifi_event_sta_connected_t * connected = (wifi_event_sta_connected_t *) event_data;
+			memcpy(sta_pending_cache.bssid, connected->bssid, sizeof(sta_pending_cache.bssid));
+			sta_pending_cache.channel = connected->channel;
+			wifi_sta_connected = 1;
+			xEventGroupSetBits(wifi_event_group, WIFI_CONNECTED_BIT);
+			break;
+		}
+
+		case WIFI_EVENT_STA_DISCONNECTED:
+			wifi_sta_connected = 0;
+			station_ip_lost();
+			station_disconnected(((wifi_event_sta_disconnected_t *) event_data)->reason);
+			break;
+
+		case WIFI_EVENT_AP_STACONNECTED:
+		{
+			wifi_event_ap_staconnected_t * client = (wifi_event_ap_staconnected_t *) event_data;
+			ap_stats.connects++;
+			ap_stats.clients++;
+			if( ap_stats.clients > ap_stats.max_clients ) ap_stats.max_clients = ap_stats.clients;
+			if( ap_client_callback != NULL ) ap_client_callback(1, client->mac, client->aid);
+			break;
+		}
+
+		case WIFI_EVENT_AP_STADISCONNECTED:
+		{
+			wifi_event_ap_stadisconnected_t * client = (wifi_event_ap_stadisconnected_t *) event_data;
+			ap_stats.disconnects++;
+			if( ap_stats.clients > 0 ) ap_stats.clients--;
+			if( ap_client_callback != NULL ) ap_client_callback(0, client->mac, client->aid);
+			break;
+		}
+
+		}
+	}
+	else if(event_base == IP_EVENT)
+	{
+		ip_event_got_ip_t* event;
+		switch(event_id)
+		{
+		case IP_EVENT_STA_GOT_IP:
+	        event = (ip_event_got_ip_t*) event_data;
+	        sta_ip_info = event->ip_info;
+
+			if( sta_connect_start_us != 0 )
+			{
+				sta_metrics.time_to_ip_us = esp_timer_get_time() - sta_connect_start_us;
+				if( sta_metrics.fast_path ) sta_metrics.last_fast_us = sta_metrics.time_to_ip_us;
+				else sta_metrics.last_full_us = sta_metrics.time_to_ip_us;
+				sta_connect_start_us = 0;
+			}
+			if( sta_fast_attempt )
+			{
+				sta_fast_attempt = 0;
+				sta_metrics.fast_successes++;
+			}
+
+			if( sta_fast_connect )
+			{
+				esp_netif_dns_info_t dns;
+				sta_pending_cache.ip_info = event->ip_info;
+				sta_pending_cache.dns.addr = 0;
+				if( esp_netif_get_dns_info(event->esp_netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK ) sta_pending_cache.dns = dns.ip.u_addr.ip4;
+				save_sta_cache();
+			}
+
+			station_reconnected();
+			xEventGroupSetBits(wifi_event_group, WIFI_GOT_IP_BIT);
+			notify_connection_callbacks(WIFI_STATE_GOT_IP, &event->ip_info);
+			break;
+
+		case IP_EVENT_STA_LOST_IP:
+			station_ip_lost();
+			break;
+
+		case IP_EVENT_AP_STAIPASSIGNED:
+			ap_stats.ips_assigned++;
+			break;
+		}
+	}
+	else if(event_base == UTIL_WIFI_EVENT)
+	{
+		if( event_id == UTIL_WIFI_EVENT_FALLBACK_TO_AP && !start_ap_fallback_scan() ) fallback_to_ap();
+		else if( event_id == UTIL_WIFI_EVENT_STOPPED ) xEventGroupSetBits(wifi_event_group, WIFI_STOPPED_BIT);
+	}
+}
+
+/*
+ * @brief: This function unregisters one event handler. A handler the event loop refuses to unregister keeps its
+ * handle, so it is still counted by get_wifi_event_handler_count(), not registered twice by the next start and
+ * retried by the next stop.
+ *
+ * @param:
+ * 1. esp_event_base_t base : the event base the handler was registered for.
+ * 2. esp_event_handler_instance_t * instance : the handle of the registration, NULL if not registered.
+ *
+ * @return:
+ * nothing
+ */
+static void unregister_event_handler(esp_event_base_t base, esp_event_handler_instance_t * instance)
+{
+	if( *instance == NULL ) return;
+
+	esp_err_t _err = esp_event_handler_instance_unregister(base, ESP_EVENT_ANY_ID, *instance);
+	if( _err == ESP_OK ) *instance = NULL;
+	else ESP_LOGE(TAG, "%s handler not unregistered (%s)", base, esp_err_to_name(_err));
+}
+
+/*
+ * @brief: This function unregisters the event handlers, each with the event base it was registered for. It does
+ * nothing for handlers that are not registered.
+ *
+ * @param:
+ * none
+ *
+ * @return:
+ * nothing
+ */
+static void unregister_event_handlers()
+{
+	unregister_event_handler(WIFI_EVENT, &wifi_event_instance);
+	unregister_event_handler(IP_EVENT, &ip_event_instance);
+	unregister_event_handler(UTIL_WIFI_EVENT, &util_event_instance);
+}
+
+/*
+ * @brief: This function waits until the default event loop has handled every event posted so far, so that the
+ * disconnect and stop events of the driver reach the handler before it is unregistered. The event loop is first in
+ * first out: once an event posted now is handled, all earlier ones are too. Called from the event loop task itself
+ * it can not wait and returns at once.
+ *
+ * @param:
+ * none
+ *
+ * @return:
+ * nothing
+ */
+static void drain_event_loop()
+{
+	if( xTaskGetCurrentTaskHandle() == xTaskGetHandle("sys_evt") ) return;
+
+	create_wifi_event_group();
+	xEventGroupClearBits(wifi_event_group, WIFI_STOPPED_BIT);
+
+	if( esp_event_post(UTIL_WIFI_EVENT, UTIL_WIFI_EVENT_STOPPED, NULL, 0, pdMS_TO_TICKS(WIFI_STOP_DRAIN_TIMEOUT_MS)) != ESP_OK ) return;
+	xEventGroupWaitBits(wifi_event_group, WIFI_STOPPED_BIT, pdTRUE, pdTRUE, pdMS_TO_TICKS(WIFI_STOP_DRAIN_TIMEOUT_MS));
+}
+
+/*
+ * @brief: This function registers the event handler for WiFi, IP and util_wifi events. Registrations that already
+ * exist are kept, so it can be called on every start without adding handlers.
+ *
+ * @param:
+ * none
+ *
+ * @return: esp_err_t
+ * ESP_OK if all handlers are registered
+ * Error code of the event loop otherwise, nothing stays registered then
+ */
+static esp_err_t register_event_handlers()
+{
+	esp_err_t _err = ESP_OK;
+
+	if( wifi_event_instance == NULL )
+	{
+		_err = esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_network_event_handler, NULL, &wifi_event_instance);
+		if( _err != ESP_OK ) wifi_event_instance = NULL;
+	}
+
+	if( _err == ESP_OK && ip_event_instance == NULL )
+	{
+		_err = esp_event_handler_instance_register(IP_EVENT, ESP_EVENT_ANY_ID, &wifi_network_event_handler, NULL, &ip_event_instance);
+		if( _err != ESP_OK ) ip_event_instance = NULL;
+	}
+
+	if( _err == ESP_OK && util_event_instance == NULL )
+	{
+		_err = esp_event_handler_instance_register(UTIL_WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_network_event_handler, NULL, &util_event_instance);
+		if( _err != ESP_OK ) util_event_instance = NULL;
+	}
+
+	if( _err != ESP_OK ) unregister_event_handlers();
+
+	return _err;
+}
+
+/*
+ * @brief: This function is used to get the number of event handlers util_wifi has registered, 0 while WiFi is
+ * stopped and 3 while it runs. A handler the event loop failed to unregister is still counted. It lets a start/stop
+ * soak test check that nothing leaks.
+ *
+ * @param:
+ * none
+ *
+ * @return: uint8_t
+ * Number of registered handlers.
+ */
+uint8_t get_wifi_event_handler_count()
+{
+	return ( wifi_event_instance != NULL ) + ( ip_event_instance != NULL ) + ( util_event_instance != NULL );
+}
+
+/*
+ * @brief: This function resets the per-connection state of station mode before it starts.
+ *
+ * @param:
+ * none
+ *
+ * @return:
+ * nothing
+ */
+static void reset_sta_state()
+{
+	sta_connect_start_us = esp_timer_get_time();
+	sta_metrics.fast_path = 0;
+	sta_fast_attempt = 0;
+	memset(&sta_pending_cache, 0, sizeof(sta_pending_cache));
+
+	sta_reconnect_enabled = 1;
+	sta_start_ignore = 0;
+	reconnect_delay_ms = 0;
+	sta_outage_start_us = 0;
+	reconnect_stats.consecutive_failures = 0;
+
+	create_wifi_event_group();
+	xEventGroupClearBits(wifi_event_group, WIFI_CONNECTED_BIT | WIFI_GOT_IP_BIT);
+}
+
+/*
+ * @brief: This function builds the station configuration from the SSID and password set by the user.
+ *
+ * @param:
+ * 1. wifi_config_t * wifi_config : the configuration to fill.
+ *
+ * @return:
+ * nothing
+ */
+static void build_sta_config(wifi_config_t * wifi_config)
+{
+	memset(wifi_config, 0, sizeof(wifi_config_t));
+
+	wifi_config->sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
+	wifi_config->sta.pmf_cfg.capable = true;
+	wifi_config->sta.pmf_cfg.required = false;
+
+    for(int i=0;i<strlen(sta_ssid);i++)
+    {
+    	wifi_config->sta.ssid[i]=sta_ssid[i];
+    }
+    for(int i=0;i<strlen(sta_password);i++)
+    {
+    	wifi_config->sta.password[i]=sta_password[i];
+    }
+
+    wifi_config->sta.listen_interval = sta_listen_interval;
+
+    // connect straight to the last access point, skipping the scan
+    if( sta_fast_connect && load_sta_cache() ) apply_sta_cache(wifi_config);
+}
+
+/*
+ * @brief: This function builds the access point configuration from the SSID and password set by the user.
+ *
+ * @param:
+ * 1. wifi_config_t * wifi_config : the configuration to fill.
+ *
+ * @return: esp_err_t
+ * ESP_OK if the configuration is built
+ * ESP_ERR_INVALID_STATE if the channel is automatic and no scan finished within WIFI_AP_CHANNEL_MAX_AGE_MS
+ */
+static esp_err_t build_ap_config(wifi_config_t * wifi_config)
+{
+	memset(wifi_config, 0, sizeof(wifi_config_t));
+
+	wifi_config->ap.ssid_len = strlen(ap_ssid);
+	wifi_config->ap.channel = ( ap_settings.channel != 0 ) ? ap_settings.channel : select_wifi_ap_channel(WIFI_AP_CHANNEL_MAX_AGE_MS);
+	if( wifi_config->ap.channel == 0 ) return ESP_ERR_INVALID_STATE;
+	wifi_config->ap.max_connection = ap_settings.max_connections;
+	wifi_config->ap.beacon_interval = ap_settings.beacon_interval;
+	wifi_config->ap.ssid_hidden = ap_settings.hidden;
+
+	// WPA needs a password of at least 8 characters, without one the access point is open
+	wifi_config->ap.authmode = ( strlen(ap_password) == 0 ) ? WIFI_AUTH_OPEN : ap_settings.authmode;
+
+	ap_stats.channel = wifi_config->ap.channel;
+
+	for(int i=0;i<strlen(ap_ssid);i++)
+	{
+		wifi_config->ap.ssid[i]=ap_ssid[i];
+	}
+	for(int i=0;i<strlen(ap_password);i++)
+	{
+		wifi_config->ap.password[i]=ap_password[i];
+	}
+
+	return ESP_OK;
+}
+
+/*
+ * @brief: This function is used to set the softAP parameters. If the access point is running the new settings are
+ * applied at once, which disconnects its clients.
+ *
+ * @param:
+ * 1. const wifi_ap_settings * settings : the settings, see WIFI_AP_SETTINGS_DEFAULT. A channel of 0 selects the least
+ * occupied channel from a scan at most WIFI_AP_CHANNEL_MAX_AGE_MS old. A running access point with a station
+ * alongside scans first if the cache is older, a softAP alone can not scan.
+ *
+ * @return: esp_err_t
+ * ESP_OK if the settings are stored
+ * ESP_ERR_INVALID_ARG if a value is out of range
+ * ESP_ERR_INVALID_STATE if the channel is automatic and the running access point has no recent scan to pick it from
+ * Error code of the WiFi driver if they could not be applied, the previous settings are kept then
+ */
+esp_err_t set_wifi_ap_settings(const wifi_ap_settings * settings)
+{
+	wifi_config_t wifi_config;
+	esp_err_t _err;
+
+	if( settings->channel > 13 ) return ESP_ERR_INVALID_ARG;
+	if( settings->max_connections == 0 || settings->max_connections > WIFI_AP_MAX_CONNECTIONS_LIMIT ) return ESP_ERR_INVALID_ARG;
+	if( settings->beacon_interval < 100 || settings->beacon_interval > 60000 ) return ESP_ERR_INVALID_ARG;
+	if( settings->bandwidth != WIFI_BW_HT20 && settings->bandwidth != WIFI_BW_HT40 ) return ESP_ERR_INVALID_ARG;
+
+	wifi_ap_settings previous = ap_settings;
+	ap_settings = *settings;
+
+	if( wifi_current_mode != WIFI_MODE_AP && wifi_current_mode != WIFI_MODE_APSTA ) return ESP_OK;
+
+	_err = ESP_OK;
+	if( ap_settings.channel == 0 && wifi_current_mode == WIFI_MODE_APSTA ) _err = scan_ap_channels();
+	if( _err == ESP_OK ) _err = build_ap_config(&wifi_config);
+	if( _err == ESP_OK ) _err = esp_wifi_set_config(WIFI_IF_AP, &wifi_config);
+	if( _err == ESP_OK ) _err = esp_wifi_set_bandwidth(WIFI_IF_AP, ap_settings.bandwidth);
+
+	// the driver refused them, the running access point keeps the previous settings
+	if( _err != ESP_OK )
+	{
+		ap_settings = previous;
+		if( build_ap_config(&wifi_config) == ESP_OK ) esp_wifi_set_config(WIFI_IF_AP, &wifi_config);
+		esp_wifi_set_bandwidth(WIFI_IF_AP, ap_settings.bandwidth);
+	}
+
+	return _err;
+}
+
+/*
+ * @brief: This function is used to get the softAP parameters.
+ *
+ * @param:
+ * 1. wifi_ap_settings * settings : Pointer to structure where the settings will be stored.
+ *
+ * @return:
+ * nothing
+ */
+void get_wifi_ap_settings(wifi_ap_settings * settings)
+{
+	*settings = ap_settings;
+}
+
+/*
+ * @brief: This function is used to set the function called from the event loop task when a client connects to or
+ * disconnects from the softAP. Its arguments are 1 for connect or 0 for disconnect, the MAC address of the client
+ * and its association id.
+ *
+ * @param:
+ * 1. wifi_ap_client_callback callback : the function, NULL to remove it.
+ *
+ * @return:
+ * nothing
+ */
+void set_wifi_ap_client_callback(wifi_ap_client_callback callback)
+{
+	ap_client_callback = callback;
+}
+
+/*
+ * @brief: This function is used to get the softAP client counters and the channel in use.
+ *
+ * @param:
+ * 1. wifi_ap_stats * stats : Pointer to structure where the counters will be stored.
+ *
+ * @return:
+ * nothing
+ */
+void get_wifi_ap_stats(wifi_ap_stats * stats)
+{
+	*stats = ap_stats;
+}
+
+/*
+ * @brief: This function runs the scan an automatic softAP channel is picked from, before the access point starts.
+ * Meanwhile the driver runs as a station alone, so the access point never comes up on a guessed channel.
+ *
+ * @param:
+ * none
+ *
+ * @return: esp_err_t
+ * ESP_OK if the scan cache is fresh
+ * Error code of scan_ap_channels() or of the WiFi driver otherwise
+ */
+static esp_err_t prescan_ap_channels()
+{
+	esp_err_t _err;
+
+	// the scanning station must not connect, its WIFI_EVENT_STA_START is skipped
+	sta_start_ignore = 1;
+
+	_err = esp_wifi_set_mode(WIFI_MODE_STA);
+	if( _err == ESP_OK ) _err = esp_wifi_start();
+	if( _err != ESP_OK )
+	{
+		sta_start_ignore = 0;
+		return _err;
+	}
+
+	_err = scan_ap_channels();
+	esp_wifi_stop();
+
+	return _err;
+}
+
+/*
+ * @brief: This function brings up the TCP/IP stack, the event loop and the WiFi driver in the given mode.
+ *
+ * @param:
+ * 1. wifi_mode_t mode : WIFI_MODE_STA, WIFI_MODE_AP or WIFI_MODE_APSTA.
+ *
+ * @return: esp_err_t
+ * ESP_OK if the WiFi has started
+ * Error code of the WiFi driver or the event loop otherwise, the driver is de-initialized again then
+ */
+static esp_err_t start_wifi(wifi_mode_t mode)
+{
+	wifi_config_t wifi_config;
+	esp_err_t _err;
+	uint8_t sta = ( mode == WIFI_MODE_STA || mode == WIFI_MODE_APSTA );
+	uint8_t ap = ( mode == WIFI_MODE_AP || mode == WIFI_MODE_APSTA );
+
+	if( sta ) reset_sta_state();
+
+	// initialize the TCP/IP stack
+	initialize_tcpip();
+
+	// create the default event loop
+	create_default_event_loop();
+
+	// register handlers
+	if( sta ) register_sta_handlers();
+	if( ap ) register_ap_handlers();
+
+	// WiFi configuration object with default settings
+	wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+
+	// initialize the WiFi driver
+	_err = esp_wifi_init(&cfg);
+	if( _err != ESP_OK ) goto fail_init;
+
+	// register more handlers
+	_err = register_event_handlers();
+	if( _err != ESP_OK ) goto fail;
+
+	// an automatic softAP channel is picked from a recent scan
+	if( ap && ap_settings.channel == 0 && !scan_cache_fresh(WIFI_AP_CHANNEL_MAX_AGE_MS) )
+	{
+		_err = prescan_ap_channels();
+		if( _err != ESP_OK ) goto fail;
+	}
+
+	// setting the WiFi mode
+	_err = esp_wifi_set_mode(mode);
+	if( _err != ESP_OK ) goto fail;
+
+	if( sta )
+	{
+		build_sta_config(&wifi_config);
+		_err = esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+		if( _err != ESP_OK ) goto fail;
+	}
+	if( ap )
+	{
+		ap_stats.clients = 0;
+		_err = build_ap_config(&wifi_config);
+		if( _err == ESP_OK ) _err = esp_wifi_set_config(WIFI_IF_AP, &wifi_config);
+		if( _err == ESP_OK ) _err = esp_wifi_set_bandwidth(WIFI_IF_AP, ap_settings.bandwidth);
+		if( _err != ESP_OK ) goto fail;
+	}
+
+	// start WiFi as per current settings
+	_err = esp_wifi_start();
+	if( _err != ESP_OK ) goto fail;
+
+	// modem sleep only applies to a station alone
+	if( mode == WIFI_MODE_STA ) esp_wifi_set_ps(sta_ps_mode);
+
+	// set the current mode variable
+	wifi_current_mode = mode;
+
+	return ESP_OK;
+
+fail:
+	unregister_event_handlers();
+	esp_wifi_deinit();
+fail_init:
+	unregister_sta_handlers();
+	unregister_ap_handlers();
+	sta_reconnect_enabled = 0;
+	return _err;
+}
+
+/*
+ * @brief: This function is used to initialize WiFi in station mode
+ *
+ * @param:
+ * none
+ *
+ * @return: esp_err_t
+ * ESP_OK if the WiFi has initialized in station mode
+ * ESP_FAIL if WiFi was already initialized
+ * Error code of the WiFi driver if it could not be started, e.g. for AP settings it refuses
+ */
+esp_err_t begin_wifi_sta()
+{
+	// If the WiFi is already running then, exit the function
+	if( wifi_current_mode != WIFI_MODE_NULL)
+		return ESP_FAIL;
+
+	return start_wifi(WIFI_MODE_STA);
+}
+
+/*
+ * @brief: This function is used to initialize WiFi in access point mode
+ *
+ * @param:
+ * none
+ *
+ * @return: esp_err_t
+ * ESP_OK if the WiFi has initialized in access point mode
+ * ESP_FAIL if WiFi was already initialized
+ * Error code of the WiFi driver if it could not be started, e.g. for AP settings it refuses
+ * ESP_ERR_TIMEOUT if the scan that picks an automatic channel did not finish
+ */
+esp_err_t begin_wifi_ap()
+{
+	// If the WiFi is already running then, exit the function
+	if( wifi_current_mode != WIFI_MODE_NULL)
+		return ESP_FAIL;
+
+	return start_wifi(WIFI_MODE_AP);
+}
+
+/*
+ * @brief: This function is used to initialize WiFi with the station and the access point running together. Both
+ * share the radio, so the access point follows the channel of the network the station joins.
+ *
+ * @param:
+ * none
+ *
+ * @return: esp_err_t
+ * ESP_OK if the WiFi has initialized in AP+STA mode
+ * ESP_FAIL if WiFi was already initialized
+ * Error code of the WiFi driver if it could not be started, e.g. for AP settings it refuses
+ * ESP_ERR_TIMEOUT if the scan that picks an automatic channel did not finish
+ */
+esp_err_t begin_wifi_apsta()
+{
+	// If the WiFi is already running then, exit the function
+	if( wifi_current_mode != WIFI_MODE_NULL)
+		return ESP_FAIL;
+
+	return start_wifi(WIFI_MODE_APSTA);
+}
+
+/*
+ * @brief: This function undoes a failed switch_wifi_mode(). The driver goes back to wifi_current_mode and the
+ * station is in the state it was before the switch.
+ *
+ * @param:
+ * 1. uint8_t mode_changed : 1 if the driver was already set to the new mode.
+ * 2. uint8_t had_sta : 1 if the previous mode has a station.
+ * 3. uint8_t sta : 1 if the new mode has a station.
+ *
+ * @return:
+ * nothing
+ */
+static void restore_wifi_mode(uint8_t mode_changed, uint8_t had_sta, uint8_t sta)
+{
+	// a station added by the switch never connected, its WIFI_EVENT_STA_START is only pending if the mode was set
+	if( sta && !had_sta )
+	{
+		sta_reconnect_enabled = 0;
+		if( !mode_changed ) sta_start_ignore = 0;
+	}
+	if( had_sta && !sta ) sta_reconnect_enabled = 1;
+
+	if( mode_changed )
+	{
+		// a dropped station comes back with WIFI_EVENT_STA_START and its old configuration, the handler connects it
+		esp_wifi_set_mode(wifi_current_mode);
+	}
+	else if( had_sta && !sta )
+	{
+		reconnect_stats.attempts++;
+		esp_wifi_connect();
+	}
+}
+
+/*
+ * @brief: This function is used to change the WiFi mode while the driver keeps running. Interfaces that stay up are
+ * not touched, so switching between STA, AP and APSTA takes milliseconds instead of a full stop_wifi() and
+ * restart. If WiFi is not running it is started in the requested mode.
+ *
+ * @param:
+ * 1. wifi_mode_t mode : WIFI_MODE_STA, WIFI_MODE_AP, WIFI_MODE_APSTA, or WIFI_MODE_NULL to stop WiFi.
+ *
+ * @return: esp_err_t
+ * ESP_OK if the mode is active
+ * ESP_ERR_INVALID_ARG if the mode is not valid
+ * ESP_ERR_INVALID_STATE if an access point with an automatic channel is added from the event loop task without a
+ * recent scan
+ * Error code of the WiFi driver otherwise, for example for a channel scan while the station connects
+ */
+esp_err_t switch_wifi_mode(wifi_mode_t mode)
+{
+	wifi_config_t wifi_config;
+	esp_err_t _err;
+
+	if( mode == WIFI_MODE_NULL )
+	{
+		stop_wifi();
+		return ESP_OK;
+	}
+	if( mode != WIFI_MODE_STA && mode != WIFI_MODE_AP && mode != WIFI_MODE_APSTA ) return ESP_ERR_INVALID_ARG;
+
+	if( wifi_current_mode == WIFI_MODE_NULL ) return start_wifi(mode);
+	if( wifi_current_mode == mode ) return ESP_OK;
+
+	uint8_t had_sta = ( wifi_current_mode == WIFI_MODE_STA || wifi_current_mode == WIFI_MODE_APSTA );
+	uint8_t had_ap = ( wifi_current_mode == WIFI_MODE_AP || wifi_current_mode == WIFI_MODE_APSTA );
+	uint8_t sta = ( mode == WIFI_MODE_STA || mode == WIFI_MODE_APSTA );
+	uint8_t ap = ( mode == WIFI_MODE_AP || mode == WIFI_MODE_APSTA );
+
+	// an automatic softAP channel is picked from a recent scan, the running station makes it before anything changes
+	if( ap && !had_ap && ap_settings.channel == 0 )
+	{
+		_err = scan_ap_channels();
+		if( _err != ESP_OK ) return _err;
+	}
+
+	// the station is going away, its disconnect must not be answered with a reconnect
+	if( had_sta && !sta )
+	{
+		sta_reconnect_enabled = 0;
+		if( reconnect_timer != NULL ) esp_timer_stop(reconnect_timer);
+		esp_wifi_disconnect();
+		wifi_sta_connected = 0;
+		station_ip_lost();
+	}
+
+	// interfaces are created once and kept until stop_wifi()
+	if( sta && sta_netif_obj == NULL ) register_sta_handlers();
+	if( ap && ap_netif_obj == NULL ) register_ap_handlers();
+	if( sta && !had_sta )
+	{
+		reset_sta_state();
+		// the new station connects below, once its configuration is set
+		sta_start_ignore = 1;
+	}
+
+	_err = esp_wifi_set_mode(mode);
+	if( _err != ESP_OK )
+	{
+		restore_wifi_mode(0, had_sta, sta);
+		return _err;
+	}
+
+	if( sta && !had_sta )
+	{
+		build_sta_config(&wifi_config);
+		_err = esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+		if( _err != ESP_OK )
+		{
+			restore_wifi_mode(1, had_sta, sta);
+			return _err;
+		}
+	}
+	if( ap && !had_ap )
+	{
+		ap_stats.clients = 0;
+		_err = build_ap_config(&wifi_config);
+		if( _err == ESP_OK ) _err = esp_wifi_set_config(WIFI_IF_AP, &wifi_config);
+		if( _err == ESP_OK ) _err = esp_wifi_set_bandwidth(WIFI_IF_AP, ap_settings.bandwidth);
+		if( _err != ESP_OK )
+		{
+			// go back to the previous mode, the access point could not be configured
+			restore_wifi_mode(1, had_sta, sta);
+			return _err;
+		}
+	}
+
+	if( sta && !had_sta )
+	{
+		reconnect_stats.attempts++;
+		esp_wifi_connect();
+	}
+
+	if( mode == WIFI_MODE_STA ) esp_wifi_set_ps(sta_ps_mode);
+
+	wifi_current_mode = mode;
+	return ESP_OK;
+}
+
+/*
+ * @brief: This function is used to get the current WiFi mode.
+ *
+ * @param:
+ * none
+ *
+ * @return: wifi_mode_t
+ * WIFI_MODE_NULL if WiFi is stopped, WIFI_MODE_STA, WIFI_MODE_AP or WIFI_MODE_APSTA otherwise.
+ */
+wifi_mode_t get_wifi_mode()
+{
+	return wifi_current_mode;
+}
+
+/*
+ * @brief: This function is used to stop WiFi
+ *
+ * @param:
+ * none
+ *
+ * @return:
+ * nothing
+ */
+void stop_wifi()
+{
+	if( wifi_current_mode == WIFI_MODE_NULL ) return;
+
+	if( wifi_current_mode == WIFI_MODE_STA || wifi_current_mode == WIFI_MODE_APSTA )
+	{
+		sta_reconnect_enabled = 0;
+		if( reconnect_timer != NULL ) esp_timer_stop(reconnect_timer);
+
+		esp_wifi_disconnect();
+	}
+
+	// the handlers stay registered until the disconnect and stop events of the driver have been handled
+	esp_wifi_stop();
+	drain_event_loop();
+	unregister_event_handlers();
+
+	esp_wifi_deinit();
+
+	// a hot mode switch may have left either interface behind
+	unregister_sta_handlers();
+	unregister_ap_handlers();
+
+	wifi_sta_connected = 0;
+	station_ip_lost();
+	scan_in_progress = 0;
+	ap_fallback_scan = 0;
+
+	wifi_current_mode = WIFI_MODE_NULL;
 }
 
 /*
@@ -10,6 +10,7 @@
 #ifndef COMPONENTS_UTIL_WIFI_UTIL_WIFI_H_
 #define COMPONENTS_UTIL_WIFI_UTIL_WIFI_H_
 
+#include <stdio.h>
 #include <string.h>
 #include <sys/unistd.h>
 #include <sys/stat.h>
@@ -19,10 +20,107 @@
 #include "esp_system.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
+#include "util_nvs.h"
 #include "lwip/err.h"
 #include "lwip/sys.h"
 
+#define WIFI_NVS_NAMESPACE "util_wifi"
+#define WIFI_STA_CACHE_KEY "sta_cache"
+#define WIFI_STA_CACHE_MAGIC 0X57464343
+
+#define WIFI_CONNECTED_BIT BIT0
+#define WIFI_GOT_IP_BIT BIT1
+#define WIFI_SCAN_DONE_BIT BIT2
+#define WIFI_STOPPED_BIT BIT3
+
+#define WIFI_STOP_DRAIN_TIMEOUT_MS 1000
+
+#define WIFI_SCAN_MAX_RESULTS 16
+
+typedef struct wifi_scan_options { uint8_t passive; uint8_t channel; uint16_t dwell_ms; uint8_t show_hidden; }wifi_scan_options;
+
+typedef struct wifi_scan_entry { uint8_t bssid[6]; char ssid[33]; uint8_t channel; int8_t rssi; wifi_auth_mode_t authmode; int64_t seen_us; }wifi_scan_entry;
+
+#define WIFI_MAX_CONNECTION_CALLBACKS 4
+
+#define WIFI_REASON_SLOTS 80
+
+typedef struct wifi_reconnect_policy { uint32_t initial_delay_ms; uint32_t max_delay_ms; uint8_t multiplier; uint8_t jitter_percent; uint16_t max_attempts; uint8_t fallback_to_ap; }wifi_reconnect_policy;
+
+/*
+ * @brief : Default reconnect policy: 0.5 s doubling up to 60 s, +/-20 % jitter, retrying forever.
+ */
+#define WIFI_RECONNECT_POLICY_DEFAULT() { \
+	.initial_delay_ms = 500, \
+	.max_delay_ms = 60000, \
+	.multiplier = 2, \
+	.jitter_percent = 20, \
+	.max_attempts = 0, \
+	.fallback_to_ap = 0, \
+}
+
+typedef struct wifi_reconnect_stats { uint32_t disconnects; uint32_t attempts; uint16_t consecutive_failures; uint8_t last_reason; uint32_t next_delay_ms; uint32_t longest_outage_ms; uint32_t fallbacks_to_ap; uint16_t reasons[WIFI_REASON_SLOTS]; }wifi_reconnect_stats;
+
+#define WIFI_DEFAULT_LISTEN_INTERVAL 3
+#define WIFI_RTT_PAYLOAD_SIZE 32
+
+typedef struct wifi_rtt_result { wifi_ps_type_t mode; uint16_t listen_interval; uint16_t sent; uint16_t received; uint32_t min_us; uint32_t avg_us; uint32_t max_us; }wifi_rtt_result;
+
+#define WIFI_TELEMETRY_SAMPLES 64
+
+#define WIFI_PHY_11B 0X01
+#define WIFI_PHY_11G 0X02
+#define WIFI_PHY_11N 0X04
+#define WIFI_PHY_LR 0X08
+
+typedef struct wifi_telemetry_sample { int64_t time_us; int8_t rssi; uint8_t channel; uint8_t phy; uint8_t connected; uint8_t last_reason; uint32_t disconnects; uint32_t tx_bytes; uint32_t rx_bytes; }wifi_telemetry_sample;
+
+#define WIFI_AP_MAX_CONNECTIONS_LIMIT 10
+
+/*
+ * @brief : A softAP channel of 0 is picked from a scan at most WIFI_AP_CHANNEL_MAX_AGE_MS old. When the cache is
+ * older the access point is brought up after a passive scan of WIFI_AP_CHANNEL_SCAN_DWELL_MS per channel.
+ */
+#define WIFI_AP_CHANNEL_MAX_AGE_MS 60000
+#define WIFI_AP_CHANNEL_SCAN_DWELL_MS 120
+#define WIFI_AP_CHANNEL_SCAN_TIMEOUT_MS 5000
+
+typedef struct wifi_ap_settings { uint8_t channel; uint8_t max_connections; wifi_bandwidth_t bandwidth; uint16_t beacon_interval; wifi_auth_mode_t authmode; uint8_t hidden; }wifi_ap_settings;
+
+/*
+ * @brief : Default softAP settings: channel 11, 3 clients, HT20, 100 ms beacons, WPA/WPA2.
+ */
+#define WIFI_AP_SETTINGS_DEFAULT() { \
+	.channel = 11, \
+	.max_connections = 3, \
+	.bandwidth = WIFI_BW_HT20, \
+	.beacon_interval = 100, \
+	.authmode = WIFI_AUTH_WPA_WPA2_PSK, \
+	.hidden = 0, \
+}
+
+typedef struct wifi_ap_stats { uint32_t connects; uint32_t disconnects; uint32_t ips_assigned; uint8_t clients; uint8_t max_clients; uint8_t channel; }wifi_ap_stats;
+
+typedef void (*wifi_ap_client_callback)(uint8_t, const uint8_t *, uint8_t);
+
+/*
+ * @brief : Events util_wifi posts to the default event loop for work that has to run in the event loop task.
+ */
+ESP_EVENT_DECLARE_BASE(UTIL_WIFI_EVENT);
+
+typedef enum util_wifi_event_id { UTIL_WIFI_EVENT_FALLBACK_TO_AP, UTIL_WIFI_EVENT_STOPPED }util_wifi_event_id;
+
+typedef enum wifi_connection_state { WIFI_STATE_GOT_IP, WIFI_STATE_LOST_IP }wifi_connection_state;
+
+typedef void (*wifi_connection_callback)(wifi_connection_state, const esp_netif_ip_info_t *);
+
+typedef struct wifi_sta_cache { uint32_t magic; char ssid[32]; uint8_t bssid[6]; uint8_t channel; esp_netif_ip_info_t ip_info; esp_ip4_addr_t dns; }wifi_sta_cache;
+
+typedef struct wifi_connect_metrics { uint8_t fast_path; int64_t time_to_ip_us; uint32_t fast_attempts; uint32_t fast_successes; uint32_t fallbacks; int64_t last_fast_us; int64_t last_full_us; }wifi_connect_metrics;
+
 void set_sta_ssid(char *);
 void set_sta_password(char *);
 
@@ -31,8 +129,47 @@ void set_ap_password(char *);
 
 esp_err_t begin_wifi_sta();
 esp_err_t begin_wifi_ap();
+esp_err_t begin_wifi_apsta();
+esp_err_t switch_wifi_mode(wifi_mode_t);
+wifi_mode_t get_wifi_mode();
+uint8_t get_wifi_event_handler_count();
 void stop_wifi();
 
+esp_err_t start_wifi_scan(const wifi_scan_options *, uint32_t);
+esp_err_t wait_wifi_scan(TickType_t);
+uint8_t get_wifi_scan_results(wifi_scan_entry *, uint8_t, uint32_t);
+esp_err_t find_wifi_network(const char *, uint32_t, wifi_scan_entry *);
+
+esp_err_t start_wifi_telemetry(uint32_t);
+void stop_wifi_telemetry();
+void wifi_telemetry_count_bytes(uint32_t, uint32_t);
+uint16_t get_wifi_telemetry(wifi_telemetry_sample *, uint16_t);
+int format_wifi_telemetry(const wifi_telemetry_sample *, char *, size_t);
+
+esp_err_t set_wifi_ap_settings(const wifi_ap_settings *);
+void get_wifi_ap_settings(wifi_ap_settings *);
+uint8_t select_wifi_ap_channel(uint32_t);
+void set_wifi_ap_client_callback(wifi_ap_client_callback);
+void get_wifi_ap_stats(wifi_ap_stats *);
+
 uint8_t isStationConnected();
 
+esp_err_t wifi_wait_for_ip(TickType_t);
+esp_err_t register_wifi_connection_callback(wifi_connection_callback);
+void unregister_wifi_connection_callback(wifi_connection_callback);
+
+void enable_wifi_fast_connect(uint8_t);
+void disable_wifi_fast_connect();
+esp_err_t clear_wifi_fast_connect_cache();
+void get_wifi_connect_metrics(wifi_connect_metrics *);
+
+void set_wifi_reconnect_policy(const wifi_reconnect_policy *);
+void get_wifi_reconnect_stats(wifi_reconnect_stats *);
+uint16_t get_wifi_disconnect_count(uint8_t);
+
+esp_err_t set_wifi_power_save(wifi_ps_type_t, uint16_t);
+wifi_ps_type_t get_wifi_power_save();
+esp_err_t wifi_measure_udp_rtt(const char *, uint16_t, uint16_t, uint32_t, uint32_t, wifi_rtt_result *);
+esp_err_t wifi_benchmark_power_modes(const char *, uint16_t, uint16_t, uint16_t, wifi_rtt_result *);
+
 #endif
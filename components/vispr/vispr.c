@@ -9,7 +9,7 @@
 
 static vispr_talker talker = {.socket=-1,};
 
-#define LOG_AS_HEX(pt, len) { for(unsigned int k=0; k<len; k++){ uart0PrintHex( *(pt+k) ); uart0Send(' '); } uart0Println(""); }
+#define LOG_AS_HEX(pt, len) uartPrintHexBytes( uart0Handle(), (const uint8_t *)(pt), (len) )
 
 
 /**
@@ -251,23 +251,28 @@ static char utilGenerateMAC(char * msg, int msgLen, char * buff)
 }
 
 /**
- * @brief : This API is used to broadcast vispr messages.
+ * @brief : This API is used to build a vispr broadcast frame, MAC included, without sending it. visprBroadcast()
+ * sends the frame built here.
  *
  * @params:
  * 1. unsigned char * msg : The message string
  * 2. int len : Length of the message string
+ * 3. char * buff : Buffer where the frame will be stored
+ * 4. int size : Size of the buffer, VISPR_MAX_FRAME_SIZE is always enough
  *
- * @returns: esp_err_t
- * ESP_OK success
- * ESP_FAIL failed
+ * @returns: int
+ * number of bytes in the frame
+ * 0 failed
  */
-esp_err_t visprBroadcast( unsigned char * msg, int len)
+int visprBuildFrame( unsigned char * msg, int len, char * buff, int size)
 {
-	if(talker.socket == -1 || len > 255)
-		return ESP_FAIL;
+	if(talker.socket == -1 || len < 0 || len > 255)
+		return 0;
+
+	uint8_t topicLen = strlen(talker.topic);
+	if( size < 30 + topicLen + len + 1 )
+		return 0;
 
-	// buffer for holding the data
-	char buff[500];
 	unsigned int i = 0;
 
 	// Writing the PREAMBLE byte into buffer
@@ -294,7 +299,6 @@ esp_err_t visprBroadcast( unsigned char * msg, int len)
 	}
 
 	// Writing the lengths
-	uint8_t topicLen = strlen(talker.topic);
 	buff[ i++ ] = topicLen;
 	buff[ i++ ] = len;
 
@@ -308,6 +312,28 @@ esp_err_t visprBroadcast( unsigned char * msg, int len)
 
 	buff[ i++ ] = END_OF_BROADCAST;
 
+	return i;
+}
+
+/**
+ * @brief : This API is used to broadcast vispr messages.
+ *
+ * @params:
+ * 1. unsigned char * msg : The message string
+ * 2. int len : Length of the message string
+ *
+ * @returns: esp_err_t
+ * ESP_OK success
+ * ESP_FAIL failed
+ */
+esp_err_t visprBroadcast( unsigned char * msg, int len)
+{
+	// buffer for holding the data
+	char buff[VISPR_MAX_FRAME_SIZE];
+
+	int i = visprBuildFrame(msg, len, buff, sizeof(buff));
+	if( !i ) return ESP_FAIL;
+
 	int r = (9/RAND_MAX)*rand() + 1;
 
 	talker.counter = talker.counter + r;
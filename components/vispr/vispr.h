@@ -29,12 +29,16 @@
 #define MAX_RTX 10
 #define RTX_DELAY 1
 
+#define VISPR_MAX_FRAME_SIZE 500
+
 typedef struct vispr_talker { char * name; uint16_t uid; uint8_t key[16]; char * topic; uint64_t counter; int socket; struct sockaddr_in destinationAddr; }vispr_talker;
 
 esp_err_t visprTalkerInitialize( char *, uint16_t, char [16], char *, uint64_t );
 
 esp_err_t vispTalkerDestroy();
 
+int visprBuildFrame( unsigned char *, int, char *, int);
+
 esp_err_t visprBroadcast( unsigned char *, int);
 
 char generateKey(unsigned char *, unsigned char *);
@@ -0,0 +1,20 @@
+/*
+ * @file: app_main.c
+ *
+ * @brief: Host shim, the entry point of a host program is the app_main() of the ESP-IDF application.
+ */
+#include <stdio.h>
+
+void app_main(void);
+
+/*
+ * @brief: The host program runs app_main on the main thread and exits when it returns, where the device would keep
+ * the other tasks running.
+ */
+int main(void)
+{
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	app_main();
+	fflush(stdout);
+	return 0;
+}
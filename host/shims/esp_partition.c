@@ -0,0 +1,213 @@
+/*
+ * @file: esp_partition.c
+ *
+ * @brief: Host shim, the partition API over a flash image file mapped into memory.
+ */
+#include <ctype.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "esp_partition.h"
+#include "esp_spi_flash.h"
+
+#ifndef HOST_FLASH_SIZE
+#define HOST_FLASH_SIZE (2*1024*1024)
+#endif
+
+#ifndef HOST_PARTITION_TABLE
+#define HOST_PARTITION_TABLE "partitions.csv"
+#endif
+
+#define HOST_MAX_PARTITIONS 16
+
+static esp_partition_t partitions[HOST_MAX_PARTITIONS];
+static uint8_t partition_count = 0;
+
+static uint8_t * flash = NULL;
+
+static pthread_once_t flash_once = PTHREAD_ONCE_INIT;
+
+typedef struct name_value {
+	const char * name;
+	int value;
+}name_value;
+
+static const name_value partition_types[] = {
+		{"app", ESP_PARTITION_TYPE_APP}, {"data", ESP_PARTITION_TYPE_DATA},
+};
+
+static const name_value partition_subtypes[] = {
+		{"factory", ESP_PARTITION_SUBTYPE_APP_FACTORY}, {"ota", ESP_PARTITION_SUBTYPE_DATA_OTA},
+		{"phy", ESP_PARTITION_SUBTYPE_DATA_PHY}, {"nvs", ESP_PARTITION_SUBTYPE_DATA_NVS},
+		{"coredump", ESP_PARTITION_SUBTYPE_DATA_COREDUMP}, {"nvs_keys", ESP_PARTITION_SUBTYPE_DATA_NVS_KEYS},
+		{"efuse", ESP_PARTITION_SUBTYPE_DATA_EFUSE_EM}, {"fat", ESP_PARTITION_SUBTYPE_DATA_FAT},
+		{"spiffs", ESP_PARTITION_SUBTYPE_DATA_SPIFFS},
+};
+
+static char * trim(char * s)
+{
+	while( isspace((unsigned char)*s) ) s++;
+	char * end = s + strlen(s);
+	while( end > s && isspace((unsigned char)*(end-1)) ) *(--end) = '\0';
+	return s;
+}
+
+/*
+ * @brief: This function parses a number of the partition table, hexadecimal or decimal with an optional K or M suffix.
+ *
+ * @return: long
+ * -1 if the field is empty
+ */
+static long parse_number(const char * s)
+{
+	if( *s == '\0' ) return -1;
+
+	char * end = NULL;
+	long value = strtol(s, &end, 0);
+	if( *end == 'K' || *end == 'k' ) value *= 1024;
+	else if( *end == 'M' || *end == 'm' ) value *= 1024 * 1024;
+	return value;
+}
+
+static int parse_name(const char * s, const name_value * table, size_t count)
+{
+	for( size_t i=0; i<count; i++ )
+		if( !strcmp(s, table[i].name) ) return table[i].value;
+	return (int)strtol(s, NULL, 0);
+}
+
+static void load_partition_table(void)
+{
+	const char * path = getenv("HOST_PARTITION_TABLE");
+	if( path == NULL ) path = HOST_PARTITION_TABLE;
+
+	FILE * f = fopen(path, "r");
+	if( f == NULL )
+	{
+		fprintf(stderr, "host: partition table %s not found\n", path);
+		return;
+	}
+
+	char line[256];
+	uint32_t next = 0x9000;
+	while( fgets(line, sizeof(line), f) != NULL && partition_count < HOST_MAX_PARTITIONS )
+	{
+		char * fields[6] = {0};
+		uint8_t n = 0;
+		char * s = trim(line);
+		if( *s == '#' || *s == '\0' ) continue;
+
+		for( char * field = strtok(s, ","); field != NULL && n < 6; field = strtok(NULL, ",") ) fields[n++] = trim(field);
+		if( n < 5 ) continue;
+
+		esp_partition_t * part = &partitions[partition_count];
+		strncpy(part->label, fields[0], sizeof(part->label) - 1);
+		part->type = (esp_partition_type_t)parse_name(fields[1], partition_types, sizeof(partition_types)/sizeof(partition_types[0]));
+		part->subtype = (esp_partition_subtype_t)parse_name(fields[2], partition_subtypes, sizeof(partition_subtypes)/sizeof(partition_subtypes[0]));
+
+		// an empty offset follows the previous partition, apps are aligned to 64 KB
+		long offset = parse_number(fields[3]);
+		uint32_t align = part->type == ESP_PARTITION_TYPE_APP ? 0x10000 : 0x1000;
+		part->address = offset < 0 ? (next + align - 1) & ~(align - 1) : (uint32_t)offset;
+		part->size = (uint32_t)parse_number(fields[4]);
+
+		if( part->address + part->size > HOST_FLASH_SIZE )
+		{
+			fprintf(stderr, "host: partition %s does not fit the %u byte flash\n", part->label, HOST_FLASH_SIZE);
+			continue;
+		}
+
+		next = part->address + part->size;
+		partition_count++;
+	}
+	fclose(f);
+}
+
+static void flash_open(void)
+{
+	load_partition_table();
+
+	const char * path = getenv("HOST_FLASH_IMAGE");
+	if( path == NULL ) path = "flash.bin";
+
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+	if( fd < 0 )
+	{
+		fprintf(stderr, "host: cannot open flash image %s\n", path);
+		return;
+	}
+
+	struct stat st;
+	uint8_t fresh = fstat(fd, &st) == 0 && st.st_size == 0;
+	if( ftruncate(fd, HOST_FLASH_SIZE) != 0 )
+	{
+		close(fd);
+		return;
+	}
+
+	void * map = mmap(NULL, HOST_FLASH_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if( map == MAP_FAILED ) return;
+
+	flash = (uint8_t *)map;
+	if( fresh ) memset(flash, 0xFF, HOST_FLASH_SIZE);
+}
+
+static esp_err_t flash_check(const esp_partition_t * part, size_t offset, size_t size)
+{
+	pthread_once(&flash_once, flash_open);
+
+	if( part == NULL ) return ESP_ERR_INVALID_ARG;
+	if( flash == NULL ) return ESP_FAIL;
+	if( offset > part->size || size > part->size - offset ) return ESP_ERR_INVALID_SIZE;
+	return ESP_OK;
+}
+
+const esp_partition_t * esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char * label)
+{
+	pthread_once(&flash_once, flash_open);
+
+	for( uint8_t i=0; i<partition_count; i++ )
+	{
+		const esp_partition_t * part = &partitions[i];
+		if( part->type != type ) continue;
+		if( subtype != ESP_PARTITION_SUBTYPE_ANY && part->subtype != subtype ) continue;
+		if( label != NULL && strcmp(label, part->label) ) continue;
+		return part;
+	}
+	return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t * part, size_t offset, void * dst, size_t size)
+{
+	esp_err_t _err = flash_check(part, offset, size);
+	if( _err != ESP_OK ) return _err;
+
+	memcpy(dst, flash + part->address + offset, size);
+	return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t * part, size_t offset, const void * src, size_t size)
+{
+	esp_err_t _err = flash_check(part, offset, size);
+	if( _err != ESP_OK ) return _err;
+
+	// NOR flash only clears bits, writing over data that was not erased corrupts it the same way here
+	uint8_t * dst = flash + part->address + offset;
+	for( size_t i=0; i<size; i++ ) dst[i] &= ((const uint8_t *)src)[i];
+	return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t * part, size_t offset, size_t size)
+{
+	esp_err_t _err = flash_check(part, offset, size);
+	if( _err != ESP_OK ) return _err;
+	if( offset % SPI_FLASH_SEC_SIZE || size % SPI_FLASH_SEC_SIZE ) return ESP_ERR_INVALID_ARG;
+
+	memset(flash + part->address + offset, 0xFF, size);
+	return ESP_OK;
+}
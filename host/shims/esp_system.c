@@ -0,0 +1,239 @@
+/*
+ * @file: esp_system.c
+ *
+ * @brief: Host shim, error names, the time base, the CPU clock and heap accounting.
+ */
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/random.h>
+
+#include "esp_err.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp32/clk.h"
+#include "nvs.h"
+
+/*
+ * @brief: Every allocation made by the program carries this header. It keeps the size for the accounting and a tag
+ * that tells the wrapped free() apart from memory the C library allocated on its own.
+ */
+typedef struct host_heap_header {
+	size_t size;
+	uintptr_t tag;
+}host_heap_header;
+
+#define HOST_HEAP_TAG 0x48454150u
+#define HOST_HEAP_HEADER_SIZE ((sizeof(host_heap_header) + 15) & ~(size_t)15)
+
+static size_t heap_used = 0;
+static size_t heap_peak = 0;
+
+void * __real_malloc(size_t);
+void * __real_realloc(void *, size_t);
+void __real_free(void *);
+
+static void heap_account(size_t add, size_t remove)
+{
+	size_t used = __atomic_add_fetch(&heap_used, add, __ATOMIC_RELAXED);
+	if( remove ) used = __atomic_sub_fetch(&heap_used, remove, __ATOMIC_RELAXED);
+
+	size_t peak = __atomic_load_n(&heap_peak, __ATOMIC_RELAXED);
+	while( used > peak && !__atomic_compare_exchange_n(&heap_peak, &peak, used, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED) );
+}
+
+static void * heap_tag(uint8_t * block, size_t size)
+{
+	host_heap_header * header = (host_heap_header *)block;
+	header->size = size;
+	header->tag = HOST_HEAP_TAG ^ (uintptr_t)block;
+	return block + HOST_HEAP_HEADER_SIZE;
+}
+
+static host_heap_header * heap_header(void * ptr)
+{
+	host_heap_header * header = (host_heap_header *)((uint8_t *)ptr - HOST_HEAP_HEADER_SIZE);
+	return header->tag == (HOST_HEAP_TAG ^ (uintptr_t)header) ? header : NULL;
+}
+
+void * __wrap_malloc(size_t size)
+{
+	if( size > SIZE_MAX - HOST_HEAP_HEADER_SIZE ) return NULL;
+
+	uint8_t * block = (uint8_t *)__real_malloc(size + HOST_HEAP_HEADER_SIZE);
+	if( block == NULL ) return NULL;
+
+	heap_account(size, 0);
+	return heap_tag(block, size);
+}
+
+void * __wrap_calloc(size_t count, size_t size)
+{
+	if( size && count > (SIZE_MAX - HOST_HEAP_HEADER_SIZE) / size ) return NULL;
+
+	void * ptr = __wrap_malloc(count * size);
+	if( ptr != NULL ) memset(ptr, 0, count * size);
+	return ptr;
+}
+
+void __wrap_free(void * ptr)
+{
+	if( ptr == NULL ) return;
+
+	host_heap_header * header = heap_header(ptr);
+	if( header == NULL )
+	{
+		__real_free(ptr);
+		return;
+	}
+
+	heap_account(0, header->size);
+	header->tag = 0;
+	__real_free(header);
+}
+
+void * __wrap_realloc(void * ptr, size_t size)
+{
+	if( ptr == NULL ) return __wrap_malloc(size);
+	if( size == 0 )
+	{
+		__wrap_free(ptr);
+		return NULL;
+	}
+
+	host_heap_header * header = heap_header(ptr);
+	if( header == NULL ) return __real_realloc(ptr, size);
+	if( size > SIZE_MAX - HOST_HEAP_HEADER_SIZE ) return NULL;
+
+	size_t old = header->size;
+	uint8_t * block = (uint8_t *)__real_realloc(header, size + HOST_HEAP_HEADER_SIZE);
+	if( block == NULL ) return NULL;
+
+	heap_account(size, old);
+	return heap_tag(block, size);
+}
+
+size_t heap_caps_get_total_size(uint32_t caps)
+{
+	(void)caps;
+	return HOST_HEAP_SIZE;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+	(void)caps;
+	size_t used = __atomic_load_n(&heap_used, __ATOMIC_RELAXED);
+	return used >= HOST_HEAP_SIZE ? 0 : HOST_HEAP_SIZE - used;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+	(void)caps;
+	size_t peak = __atomic_load_n(&heap_peak, __ATOMIC_RELAXED);
+	return peak >= HOST_HEAP_SIZE ? 0 : HOST_HEAP_SIZE - peak;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+	return heap_caps_get_free_size(caps);
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+	return (uint32_t)heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+	return (uint32_t)heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+}
+
+uint32_t esp_random(void)
+{
+	uint32_t value = 0;
+	if( getrandom(&value, sizeof(value), 0) != sizeof(value) ) value = (uint32_t)rand();
+	return value;
+}
+
+void esp_restart(void)
+{
+	fflush(stdout);
+	exit(0);
+}
+
+int64_t esp_timer_get_time(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+int esp_clk_cpu_freq(void)
+{
+	static int hz = 0;
+	if( hz ) return hz;
+
+	// nominal clock of the first CPU, cpufreq reports kHz
+	long khz = 0;
+	FILE * f = fopen("/sys/devices/system/cpu/cpu0/cpufreq/base_frequency", "r");
+	if( f == NULL ) f = fopen("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq", "r");
+	if( f != NULL )
+	{
+		if( fscanf(f, "%ld", &khz) != 1 ) khz = 0;
+		fclose(f);
+	}
+
+	if( khz <= 0 )
+	{
+		double mhz = 0;
+		char line[256];
+		f = fopen("/proc/cpuinfo", "r");
+		if( f != NULL )
+		{
+			while( fgets(line, sizeof(line), f) != NULL )
+				if( sscanf(line, "cpu MHz : %lf", &mhz) == 1 || sscanf(line, "cpu MHz\t: %lf", &mhz) == 1 ) break;
+			fclose(f);
+		}
+		khz = (long)(mhz * 1000);
+	}
+
+	hz = khz > 0 ? (int)(khz * 1000) : 1000000000;
+	return hz;
+}
+
+const char * esp_err_to_name(esp_err_t code)
+{
+	switch( code )
+	{
+	case ESP_OK: return "ESP_OK";
+	case ESP_FAIL: return "ESP_FAIL";
+	case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+	case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+	case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+	case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+	case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+	case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+	case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+	case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+	case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+	case ESP_ERR_INVALID_VERSION: return "ESP_ERR_INVALID_VERSION";
+	case ESP_ERR_INVALID_MAC: return "ESP_ERR_INVALID_MAC";
+	case ESP_ERR_NVS_NOT_INITIALIZED: return "ESP_ERR_NVS_NOT_INITIALIZED";
+	case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+	case ESP_ERR_NVS_TYPE_MISMATCH: return "ESP_ERR_NVS_TYPE_MISMATCH";
+	case ESP_ERR_NVS_READ_ONLY: return "ESP_ERR_NVS_READ_ONLY";
+	case ESP_ERR_NVS_NOT_ENOUGH_SPACE: return "ESP_ERR_NVS_NOT_ENOUGH_SPACE";
+	case ESP_ERR_NVS_INVALID_NAME: return "ESP_ERR_NVS_INVALID_NAME";
+	case ESP_ERR_NVS_INVALID_HANDLE: return "ESP_ERR_NVS_INVALID_HANDLE";
+	case ESP_ERR_NVS_KEY_TOO_LONG: return "ESP_ERR_NVS_KEY_TOO_LONG";
+	case ESP_ERR_NVS_INVALID_STATE: return "ESP_ERR_NVS_INVALID_STATE";
+	case ESP_ERR_NVS_INVALID_LENGTH: return "ESP_ERR_NVS_INVALID_LENGTH";
+	case ESP_ERR_NVS_NO_FREE_PAGES: return "ESP_ERR_NVS_NO_FREE_PAGES";
+	case ESP_ERR_NVS_VALUE_TOO_LONG: return "ESP_ERR_NVS_VALUE_TOO_LONG";
+	case ESP_ERR_NVS_PART_NOT_FOUND: return "ESP_ERR_NVS_PART_NOT_FOUND";
+	case ESP_ERR_NVS_NEW_VERSION_FOUND: return "ESP_ERR_NVS_NEW_VERSION_FOUND";
+	case ESP_ERR_NVS_KEYS_NOT_INITIALIZED: return "ESP_ERR_NVS_KEYS_NOT_INITIALIZED";
+	default: return "UNKNOWN ERROR";
+	}
+}
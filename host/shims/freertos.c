@@ -0,0 +1,382 @@
+/*
+ * @file: freertos.c
+ *
+ * @brief: Host shim, FreeRTOS tasks, queues, semaphores and critical sections on pthreads.
+ */
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#define HOST_TASK_NAME_LENGTH 16
+
+struct tskTaskControlBlock {
+	pthread_t thread;
+	TaskFunction_t function;
+	void * arg;
+	uint32_t stack_depth;
+	char name[HOST_TASK_NAME_LENGTH];
+};
+
+static __thread struct tskTaskControlBlock * current_task = NULL;
+
+static pthread_mutex_t critical_lock;
+static pthread_once_t critical_once = PTHREAD_ONCE_INIT;
+
+static void critical_lock_init(void)
+{
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&critical_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+void vPortEnterCritical(portMUX_TYPE * mux)
+{
+	(void)mux;
+	pthread_once(&critical_once, critical_lock_init);
+	pthread_mutex_lock(&critical_lock);
+}
+
+void vPortExitCritical(portMUX_TYPE * mux)
+{
+	(void)mux;
+	pthread_mutex_unlock(&critical_lock);
+}
+
+void vPortTicksToDeadline(TickType_t ticks, struct timespec * deadline)
+{
+	clock_gettime(CLOCK_MONOTONIC, deadline);
+	uint64_t ms = (uint64_t)ticks * portTICK_PERIOD_MS;
+	deadline->tv_sec += ms / 1000;
+	deadline->tv_nsec += (ms % 1000) * 1000000L;
+	if( deadline->tv_nsec >= 1000000000L )
+	{
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000L;
+	}
+}
+
+/*
+ * @brief: This function waits on a queue condition until it is signalled or the wait runs out, the queue lock is held.
+ *
+ * @param:
+ * 1. QueueHandle_t queue : the queue.
+ * 2. pthread_cond_t * cond : the condition.
+ * 3. TickType_t wait : ticks to wait, portMAX_DELAY for ever.
+ * 4. const struct timespec * deadline : deadline computed from 'wait'.
+ *
+ * @return: uint8_t
+ * 0 if the wait ran out
+ */
+static uint8_t queue_wait(QueueHandle_t queue, pthread_cond_t * cond, TickType_t wait, const struct timespec * deadline)
+{
+	if( wait == 0 ) return 0;
+	if( wait == portMAX_DELAY )
+	{
+		pthread_cond_wait(cond, &(queue->lock));
+		return 1;
+	}
+	return pthread_cond_timedwait(cond, &(queue->lock), deadline) != ETIMEDOUT;
+}
+
+static void queue_init(QueueHandle_t queue, UBaseType_t length, UBaseType_t item_size, uint8_t * storage)
+{
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+	pthread_mutex_init(&(queue->lock), NULL);
+	pthread_cond_init(&(queue->readable), &attr);
+	pthread_cond_init(&(queue->writable), &attr);
+	pthread_condattr_destroy(&attr);
+
+	queue->storage = storage;
+	queue->length = length;
+	queue->item_size = item_size;
+	queue->head = 0;
+	queue->count = 0;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+	if( !length ) return NULL;
+
+	QueueHandle_t queue = (QueueHandle_t)calloc(1, sizeof(QueueDefinition));
+	if( queue == NULL ) return NULL;
+
+	uint8_t * storage = NULL;
+	if( item_size )
+	{
+		storage = (uint8_t *)malloc((size_t)length * item_size);
+		if( storage == NULL )
+		{
+			free(queue);
+			return NULL;
+		}
+	}
+
+	queue_init(queue, length, item_size, storage);
+	return queue;
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t * storage, StaticQueue_t * buffer)
+{
+	if( !length || buffer == NULL || (item_size && storage == NULL) ) return NULL;
+
+	queue_init(buffer, length, item_size, storage);
+	buffer->is_static = 1;
+	return buffer;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+	if( queue == NULL ) return;
+
+	pthread_mutex_destroy(&(queue->lock));
+	pthread_cond_destroy(&(queue->readable));
+	pthread_cond_destroy(&(queue->writable));
+
+	if( queue->is_static ) return;
+
+	free(queue->storage);
+	free(queue);
+}
+
+static BaseType_t queue_send(QueueHandle_t queue, const void * item, TickType_t wait, uint8_t front)
+{
+	struct timespec deadline;
+	vPortTicksToDeadline(wait, &deadline);
+
+	pthread_mutex_lock(&(queue->lock));
+	while( queue->count == queue->length )
+	{
+		if( !queue_wait(queue, &(queue->writable), wait, &deadline) && queue->count == queue->length )
+		{
+			pthread_mutex_unlock(&(queue->lock));
+			return pdFALSE;
+		}
+	}
+
+	UBaseType_t slot;
+	if( front )
+	{
+		queue->head = (queue->head + queue->length - 1) % queue->length;
+		slot = queue->head;
+	}
+	else slot = (queue->head + queue->count) % queue->length;
+
+	if( queue->item_size && item != NULL ) memcpy(queue->storage + (size_t)slot * queue->item_size, item, queue->item_size);
+	queue->count++;
+
+	pthread_cond_signal(&(queue->readable));
+	pthread_mutex_unlock(&(queue->lock));
+	return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void * item, TickType_t wait)
+{
+	return queue_send(queue, item, wait, 0);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void * item, TickType_t wait)
+{
+	return queue_send(queue, item, wait, 1);
+}
+
+static BaseType_t queue_receive(QueueHandle_t queue, void * item, TickType_t wait, uint8_t peek)
+{
+	struct timespec deadline;
+	vPortTicksToDeadline(wait, &deadline);
+
+	pthread_mutex_lock(&(queue->lock));
+	while( queue->count == 0 )
+	{
+		if( !queue_wait(queue, &(queue->readable), wait, &deadline) && queue->count == 0 )
+		{
+			pthread_mutex_unlock(&(queue->lock));
+			return pdFALSE;
+		}
+	}
+
+	if( queue->item_size && item != NULL ) memcpy(item, queue->storage + (size_t)queue->head * queue->item_size, queue->item_size);
+
+	if( !peek )
+	{
+		queue->head = (queue->head + 1) % queue->length;
+		queue->count--;
+		pthread_cond_signal(&(queue->writable));
+	}
+
+	pthread_mutex_unlock(&(queue->lock));
+	return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void * item, TickType_t wait)
+{
+	return queue_receive(queue, item, wait, 0);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void * item, TickType_t wait)
+{
+	return queue_receive(queue, item, wait, 1);
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+	pthread_mutex_lock(&(queue->lock));
+	queue->head = 0;
+	queue->count = 0;
+	pthread_cond_broadcast(&(queue->writable));
+	pthread_mutex_unlock(&(queue->lock));
+	return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+	pthread_mutex_lock(&(queue->lock));
+	UBaseType_t count = queue->count;
+	pthread_mutex_unlock(&(queue->lock));
+	return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+	pthread_mutex_lock(&(queue->lock));
+	UBaseType_t spaces = queue->length - queue->count;
+	pthread_mutex_unlock(&(queue->lock));
+	return spaces;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+	return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+	SemaphoreHandle_t semaphore = xQueueCreate(max, 0);
+	if( semaphore != NULL ) semaphore->count = initial;
+	return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+	SemaphoreHandle_t mutex = xQueueCreate(1, 0);
+	if( mutex != NULL ) mutex->count = 1;
+	return mutex;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t * buffer)
+{
+	SemaphoreHandle_t mutex = xQueueCreateStatic(1, 0, NULL, buffer);
+	if( mutex != NULL ) mutex->count = 1;
+	return mutex;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+	return xQueueSend(semaphore, NULL, 0);
+}
+
+static void * task_entry(void * arg)
+{
+	current_task = (struct tskTaskControlBlock *)arg;
+	current_task->function(current_task->arg);
+
+	// a FreeRTOS task must not return, the host tolerates it the way vTaskDelete(NULL) does
+	vTaskDelete(NULL);
+	return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char * name, uint32_t stack_depth, void * arg, UBaseType_t priority, TaskHandle_t * handle)
+{
+	(void)priority;
+
+	struct tskTaskControlBlock * task = (struct tskTaskControlBlock *)calloc(1, sizeof(struct tskTaskControlBlock));
+	if( task == NULL ) return pdFAIL;
+
+	task->function = function;
+	task->arg = arg;
+	task->stack_depth = stack_depth;
+	if( name != NULL ) strncpy(task->name, name, HOST_TASK_NAME_LENGTH - 1);
+
+	// the handle is published before the task runs, FreeRTOS does the same
+	if( handle != NULL ) *handle = task;
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	int ret = pthread_create(&(task->thread), &attr, task_entry, task);
+	pthread_attr_destroy(&attr);
+
+	if( ret != 0 )
+	{
+		if( handle != NULL ) *handle = NULL;
+		free(task);
+		return pdFAIL;
+	}
+	return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char * name, uint32_t stack_depth, void * arg, UBaseType_t priority, TaskHandle_t * handle, BaseType_t core)
+{
+	(void)core;
+	return xTaskCreate(function, name, stack_depth, arg, priority, handle);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+	if( task == NULL || task == current_task )
+	{
+		// app_main runs on the process main thread, which has no control block
+		if( current_task == NULL ) pthread_exit(NULL);
+
+		free(current_task);
+		current_task = NULL;
+		pthread_exit(NULL);
+	}
+
+	// deleting another task is only safe while it blocks, the same restriction the components already follow
+	pthread_cancel(task->thread);
+	free(task);
+}
+
+void vTaskDelay(const TickType_t ticks)
+{
+	struct timespec deadline;
+	vPortTicksToDeadline(ticks, &deadline);
+	while( clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR );
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (TickType_t)(((uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000) / portTICK_PERIOD_MS);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+	return current_task;
+}
+
+char * pcTaskGetName(TaskHandle_t task)
+{
+	static char main_name[] = "main";
+	if( task == NULL ) task = current_task;
+	return task == NULL ? main_name : task->name;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+	// host threads get an 8 MB stack, report the depth the task asked for as untouched
+	if( task == NULL ) task = current_task;
+	return task == NULL ? 0 : task->stack_depth;
+}
@@ -0,0 +1,78 @@
+/*
+ * @file: driver/uart.h
+ *
+ * @brief: Host shim, the UART driver on a pseudo terminal. Every installed port owns a pty, bytes written to the far
+ * end arrive in the RX ring buffer with the same events the ESP-IDF driver posts (UART_DATA, UART_PATTERN_DET,
+ * UART_BUFFER_FULL). What the port transmits is discarded unless the far end was taken with host_uart_attach().
+ */
+#ifndef HOST_SHIMS_DRIVER_UART_H_
+#define HOST_SHIMS_DRIVER_UART_H_
+
+#include <stdbool.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+typedef int uart_port_t;
+
+#define UART_NUM_0 0
+#define UART_NUM_1 1
+#define UART_NUM_2 2
+#define UART_NUM_MAX 3
+
+#define UART_PIN_NO_CHANGE (-1)
+#define UART_FIFO_LEN 128
+
+typedef enum { UART_DATA_5_BITS, UART_DATA_6_BITS, UART_DATA_7_BITS, UART_DATA_8_BITS }uart_word_length_t;
+typedef enum { UART_PARITY_DISABLE = 0, UART_PARITY_EVEN = 2, UART_PARITY_ODD = 3 }uart_parity_t;
+typedef enum { UART_STOP_BITS_1 = 1, UART_STOP_BITS_1_5 = 2, UART_STOP_BITS_2 = 3 }uart_stop_bits_t;
+typedef enum { UART_HW_FLOWCTRL_DISABLE, UART_HW_FLOWCTRL_RTS, UART_HW_FLOWCTRL_CTS, UART_HW_FLOWCTRL_CTS_RTS }uart_hw_flowcontrol_t;
+typedef enum { UART_SCLK_APB, UART_SCLK_REF_TICK }uart_sclk_t;
+
+typedef struct uart_config_t {
+	int baud_rate;
+	uart_word_length_t data_bits;
+	uart_parity_t parity;
+	uart_stop_bits_t stop_bits;
+	uart_hw_flowcontrol_t flow_ctrl;
+	uint8_t rx_flow_ctrl_thresh;
+	uart_sclk_t source_clk;
+}uart_config_t;
+
+typedef enum {
+	UART_DATA,
+	UART_BREAK,
+	UART_BUFFER_FULL,
+	UART_FIFO_OVF,
+	UART_FRAME_ERR,
+	UART_PARITY_ERR,
+	UART_DATA_BREAK,
+	UART_PATTERN_DET,
+	UART_EVENT_MAX,
+}uart_event_type_t;
+
+typedef struct uart_event_t {
+	uart_event_type_t type;
+	size_t size;
+	bool timeout_flag;
+}uart_event_t;
+
+esp_err_t uart_driver_install(uart_port_t, int, int, int, QueueHandle_t *, int);
+esp_err_t uart_driver_delete(uart_port_t);
+bool uart_is_driver_installed(uart_port_t);
+esp_err_t uart_param_config(uart_port_t, const uart_config_t *);
+esp_err_t uart_set_pin(uart_port_t, int, int, int, int);
+esp_err_t uart_set_baudrate(uart_port_t, uint32_t);
+int uart_write_bytes(uart_port_t, const void *, size_t);
+int uart_read_bytes(uart_port_t, void *, uint32_t, TickType_t);
+esp_err_t uart_wait_tx_done(uart_port_t, TickType_t);
+esp_err_t uart_flush_input(uart_port_t);
+esp_err_t uart_get_buffered_data_len(uart_port_t, size_t *);
+esp_err_t uart_set_rx_full_threshold(uart_port_t, int);
+esp_err_t uart_enable_pattern_det_baud_intr(uart_port_t, char, uint8_t, int, int, int);
+esp_err_t uart_disable_pattern_det_intr(uart_port_t);
+esp_err_t uart_pattern_queue_reset(uart_port_t, int);
+int uart_pattern_pop_pos(uart_port_t);
+int uart_pattern_get_pos(uart_port_t);
+
+#endif /* HOST_SHIMS_DRIVER_UART_H_ */
@@ -0,0 +1,12 @@
+/*
+ * @file: esp32/clk.h
+ *
+ * @brief: Host shim, esp_clk_cpu_freq() reports the host CPU clock so that cycle counts derived from it mean host
+ * cycles.
+ */
+#ifndef HOST_SHIMS_ESP32_CLK_H_
+#define HOST_SHIMS_ESP32_CLK_H_
+
+int esp_clk_cpu_freq(void);
+
+#endif /* HOST_SHIMS_ESP32_CLK_H_ */
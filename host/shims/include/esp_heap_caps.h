@@ -0,0 +1,28 @@
+/*
+ * @file: esp_heap_caps.h
+ *
+ * @brief: Host shim. The host heap is a virtual region of HOST_HEAP_SIZE bytes, the figures count the bytes the
+ * program holds through malloc/calloc/realloc, which the host build wraps at link time.
+ */
+#ifndef HOST_SHIMS_ESP_HEAP_CAPS_H_
+#define HOST_SHIMS_ESP_HEAP_CAPS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT (1<<2)
+#define MALLOC_CAP_DEFAULT (1<<12)
+
+#ifndef HOST_HEAP_SIZE
+#define HOST_HEAP_SIZE (320*1024)
+#endif
+
+size_t heap_caps_get_total_size(uint32_t);
+
+size_t heap_caps_get_free_size(uint32_t);
+
+size_t heap_caps_get_minimum_free_size(uint32_t);
+
+size_t heap_caps_get_largest_free_block(uint32_t);
+
+#endif /* HOST_SHIMS_ESP_HEAP_CAPS_H_ */
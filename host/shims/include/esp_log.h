@@ -0,0 +1,19 @@
+/*
+ * @file: esp_log.h
+ *
+ * @brief: Host shim, log macros print to stderr so that stdout stays free for program output.
+ */
+#ifndef HOST_SHIMS_ESP_LOG_H_
+#define HOST_SHIMS_ESP_LOG_H_
+
+#include <stdio.h>
+
+#define HOST_LOG(level, tag, format, ...) fprintf(stderr, level " (%s): " format "\n", tag, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, format, ...) HOST_LOG("E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOST_LOG("W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOST_LOG("I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) do { } while(0)
+#define ESP_LOGV(tag, format, ...) do { } while(0)
+
+#endif /* HOST_SHIMS_ESP_LOG_H_ */
@@ -0,0 +1,44 @@
+/*
+ * @file: esp_partition.h
+ *
+ * @brief: Host shim, partitions of an emulated flash chip. The table is read from the project partitions.csv and the
+ * chip is an image file, erased bytes read 0xFF and writes can only clear bits, like NOR flash.
+ */
+#ifndef HOST_SHIMS_ESP_PARTITION_H_
+#define HOST_SHIMS_ESP_PARTITION_H_
+
+#include "esp_err.h"
+
+typedef enum {
+	ESP_PARTITION_TYPE_APP = 0x00,
+	ESP_PARTITION_TYPE_DATA = 0x01,
+}esp_partition_type_t;
+
+typedef enum {
+	ESP_PARTITION_SUBTYPE_APP_FACTORY = 0x00,
+	ESP_PARTITION_SUBTYPE_DATA_OTA = 0x00,
+	ESP_PARTITION_SUBTYPE_DATA_PHY = 0x01,
+	ESP_PARTITION_SUBTYPE_DATA_NVS = 0x02,
+	ESP_PARTITION_SUBTYPE_DATA_COREDUMP = 0x03,
+	ESP_PARTITION_SUBTYPE_DATA_NVS_KEYS = 0x04,
+	ESP_PARTITION_SUBTYPE_DATA_EFUSE_EM = 0x05,
+	ESP_PARTITION_SUBTYPE_DATA_FAT = 0x81,
+	ESP_PARTITION_SUBTYPE_DATA_SPIFFS = 0x82,
+	ESP_PARTITION_SUBTYPE_ANY = 0xff,
+}esp_partition_subtype_t;
+
+typedef struct esp_partition_t {
+	esp_partition_type_t type;
+	esp_partition_subtype_t subtype;
+	uint32_t address;
+	uint32_t size;
+	char label[17];
+	bool encrypted;
+}esp_partition_t;
+
+const esp_partition_t * esp_partition_find_first(esp_partition_type_t, esp_partition_subtype_t, const char *);
+esp_err_t esp_partition_read(const esp_partition_t *, size_t, void *, size_t);
+esp_err_t esp_partition_write(const esp_partition_t *, size_t, const void *, size_t);
+esp_err_t esp_partition_erase_range(const esp_partition_t *, size_t, size_t);
+
+#endif /* HOST_SHIMS_ESP_PARTITION_H_ */
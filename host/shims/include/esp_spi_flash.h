@@ -0,0 +1,11 @@
+/*
+ * @file: esp_spi_flash.h
+ *
+ * @brief: Host shim, flash geometry of the emulated chip.
+ */
+#ifndef HOST_SHIMS_ESP_SPI_FLASH_H_
+#define HOST_SHIMS_ESP_SPI_FLASH_H_
+
+#define SPI_FLASH_SEC_SIZE 4096
+
+#endif /* HOST_SHIMS_ESP_SPI_FLASH_H_ */
@@ -0,0 +1,26 @@
+/*
+ * @file: esp_spiffs.h
+ *
+ * @brief: Host shim. A registered SPIFFS partition is a directory on the host, paths under base_path are redirected
+ * to it by the fopen() wrapper of the host build.
+ */
+#ifndef HOST_SHIMS_ESP_SPIFFS_H_
+#define HOST_SHIMS_ESP_SPIFFS_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+typedef struct esp_vfs_spiffs_conf_t {
+	const char * base_path;
+	const char * partition_label;
+	size_t max_files;
+	bool format_if_mount_failed;
+}esp_vfs_spiffs_conf_t;
+
+esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t *);
+esp_err_t esp_vfs_spiffs_unregister(const char *);
+bool esp_spiffs_mounted(const char *);
+esp_err_t esp_spiffs_info(const char *, size_t *, size_t *);
+
+#endif /* HOST_SHIMS_ESP_SPIFFS_H_ */
@@ -0,0 +1,20 @@
+/*
+ * @file: esp_system.h
+ *
+ * @brief: Host shim, heap figures come from the allocation accounting in heap.c.
+ */
+#ifndef HOST_SHIMS_ESP_SYSTEM_H_
+#define HOST_SHIMS_ESP_SYSTEM_H_
+
+#include <stdint.h>
+#include "esp_err.h"
+
+uint32_t esp_get_free_heap_size(void);
+
+uint32_t esp_get_minimum_free_heap_size(void);
+
+uint32_t esp_random(void);
+
+void esp_restart(void) __attribute__((noreturn));
+
+#endif /* HOST_SHIMS_ESP_SYSTEM_H_ */
@@ -0,0 +1,13 @@
+/*
+ * @file: esp_timer.h
+ *
+ * @brief: Host shim, only the time base, microseconds from CLOCK_MONOTONIC.
+ */
+#ifndef HOST_SHIMS_ESP_TIMER_H_
+#define HOST_SHIMS_ESP_TIMER_H_
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
+
+#endif /* HOST_SHIMS_ESP_TIMER_H_ */
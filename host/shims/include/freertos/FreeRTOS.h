@@ -0,0 +1,65 @@
+/*
+ * @file: freertos/FreeRTOS.h
+ *
+ * @brief: Host shim, FreeRTOS types on top of pthreads. The tick is one millisecond, a critical section is one process
+ * wide recursive mutex, which is as strong as disabling interrupts on a single core.
+ */
+#ifndef HOST_SHIMS_FREERTOS_H_
+#define HOST_SHIMS_FREERTOS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS portTICK_PERIOD_MS
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((TickType_t)(ms) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000))
+
+/*
+ * @brief: A queue, also used for semaphores and mutexes with an item size of 0, the way FreeRTOS does it.
+ */
+typedef struct QueueDefinition {
+	pthread_mutex_t lock;
+	pthread_cond_t readable;
+	pthread_cond_t writable;
+	uint8_t * storage;
+	UBaseType_t length;
+	UBaseType_t item_size;
+	UBaseType_t head;
+	UBaseType_t count;
+	uint8_t is_static;
+}QueueDefinition;
+
+typedef QueueDefinition StaticQueue_t;
+typedef QueueDefinition StaticSemaphore_t;
+
+typedef struct { int unused; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+
+void vPortEnterCritical(portMUX_TYPE *);
+void vPortExitCritical(portMUX_TYPE *);
+
+#define portENTER_CRITICAL(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) vPortExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux) vPortExitCritical(mux)
+#define portYIELD_FROM_ISR() ((void)0)
+
+/*
+ * @brief: Absolute CLOCK_MONOTONIC deadline 'ticks' from now, used by the blocking calls.
+ */
+struct timespec;
+void vPortTicksToDeadline(TickType_t, struct timespec *);
+
+#endif /* HOST_SHIMS_FREERTOS_H_ */
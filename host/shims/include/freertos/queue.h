@@ -0,0 +1,37 @@
+/*
+ * @file: freertos/queue.h
+ *
+ * @brief: Host shim, fixed size copy-in/copy-out queues protected by a mutex and two condition variables.
+ */
+#ifndef HOST_SHIMS_FREERTOS_QUEUE_H_
+#define HOST_SHIMS_FREERTOS_QUEUE_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef QueueDefinition * QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t, UBaseType_t);
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t, UBaseType_t, uint8_t *, StaticQueue_t *);
+
+void vQueueDelete(QueueHandle_t);
+
+BaseType_t xQueueSend(QueueHandle_t, const void *, TickType_t);
+
+BaseType_t xQueueSendToFront(QueueHandle_t, const void *, TickType_t);
+
+BaseType_t xQueueReceive(QueueHandle_t, void *, TickType_t);
+
+BaseType_t xQueuePeek(QueueHandle_t, void *, TickType_t);
+
+BaseType_t xQueueReset(QueueHandle_t);
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t);
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t);
+
+#define xQueueSendToBack(queue, item, wait) xQueueSend(queue, item, wait)
+#define xQueueSendFromISR(queue, item, woken) xQueueSend(queue, item, 0)
+#define xQueueReceiveFromISR(queue, item, woken) xQueueReceive(queue, item, 0)
+
+#endif /* HOST_SHIMS_FREERTOS_QUEUE_H_ */
@@ -0,0 +1,29 @@
+/*
+ * @file: freertos/semphr.h
+ *
+ * @brief: Host shim, semaphores are queues with an item size of 0. A mutex is a binary semaphore that starts given,
+ * there is no priority inheritance and no owner check.
+ */
+#ifndef HOST_SHIMS_FREERTOS_SEMPHR_H_
+#define HOST_SHIMS_FREERTOS_SEMPHR_H_
+
+#include "freertos/queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t, UBaseType_t);
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *);
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t);
+
+#define xSemaphoreTake(semaphore, wait) xQueueReceive(semaphore, NULL, wait)
+#define xSemaphoreGiveFromISR(semaphore, woken) xSemaphoreGive(semaphore)
+#define vSemaphoreDelete(semaphore) vQueueDelete(semaphore)
+#define uxSemaphoreGetCount(semaphore) uxQueueMessagesWaiting(semaphore)
+
+#endif /* HOST_SHIMS_FREERTOS_SEMPHR_H_ */
@@ -0,0 +1,34 @@
+/*
+ * @file: freertos/task.h
+ *
+ * @brief: Host shim, a task is a detached pthread. Priorities and stack sizes are recorded but not applied.
+ */
+#ifndef HOST_SHIMS_FREERTOS_TASK_H_
+#define HOST_SHIMS_FREERTOS_TASK_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void *);
+
+typedef struct tskTaskControlBlock * TaskHandle_t;
+
+#define tskIDLE_PRIORITY 0
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+BaseType_t xTaskCreate(TaskFunction_t, const char *, uint32_t, void *, UBaseType_t, TaskHandle_t *);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t, const char *, uint32_t, void *, UBaseType_t, TaskHandle_t *, BaseType_t);
+
+void vTaskDelete(TaskHandle_t);
+
+void vTaskDelay(const TickType_t);
+
+TickType_t xTaskGetTickCount(void);
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+char * pcTaskGetName(TaskHandle_t);
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t);
+
+#endif /* HOST_SHIMS_FREERTOS_TASK_H_ */
@@ -0,0 +1,39 @@
+/*
+ * @file: host_shims.h
+ *
+ * @brief: Controls of the host build that have no ESP-IDF counterpart. The emulated hardware is configured from the
+ * environment :
+ * HOST_FLASH_IMAGE : flash image file, created erased when missing (default "flash.bin")
+ * HOST_PARTITION_TABLE : partition table CSV (default the project partitions.csv)
+ * HOST_SPIFFS_DIR : directory that stands for the SPIFFS partition (default "spiffs")
+ * HOST_UART_EXTERNAL : when set, transmitted bytes are left in the pty for an outside program instead of discarded
+ */
+#ifndef HOST_SHIMS_HOST_SHIMS_H_
+#define HOST_SHIMS_HOST_SHIMS_H_
+
+#include "driver/uart.h"
+
+/*
+ * @brief: This function returns the path of the pty slave that stands for the far end of a UART port.
+ *
+ * @param:
+ * 1. uart_port_t port : the port.
+ *
+ * @return: const char *
+ * NULL if the driver is not installed on the port
+ */
+const char * host_uart_pty_name(uart_port_t);
+
+/*
+ * @brief: This function hands the far end of a UART port over to the caller. Bytes written to the returned descriptor
+ * are received by the port, the bytes the port transmits can be read from it and are no longer discarded.
+ *
+ * @param:
+ * 1. uart_port_t port : the port.
+ *
+ * @return: int
+ * file descriptor, -1 if the driver is not installed. It stays owned by the shim and is closed by uart_driver_delete()
+ */
+int host_uart_attach(uart_port_t);
+
+#endif /* HOST_SHIMS_HOST_SHIMS_H_ */
@@ -0,0 +1,15 @@
+/*
+ * @file: lwip/err.h
+ *
+ * @brief: Host shim, lwIP error type.
+ */
+#ifndef HOST_SHIMS_LWIP_ERR_H_
+#define HOST_SHIMS_LWIP_ERR_H_
+
+#include <stdint.h>
+
+typedef int8_t err_t;
+
+#define ERR_OK 0
+
+#endif /* HOST_SHIMS_LWIP_ERR_H_ */
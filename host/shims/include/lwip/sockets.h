@@ -0,0 +1,21 @@
+/*
+ * @file: lwip/sockets.h
+ *
+ * @brief: Host shim, lwIP's BSD socket API is the POSIX one.
+ */
+#ifndef HOST_SHIMS_LWIP_SOCKETS_H_
+#define HOST_SHIMS_LWIP_SOCKETS_H_
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#define closesocket(s) close(s)
+
+#endif /* HOST_SHIMS_LWIP_SOCKETS_H_ */
@@ -0,0 +1,11 @@
+/*
+ * @file: lwip/sys.h
+ *
+ * @brief: Host shim, nothing of lwIP's OS layer is used by the components.
+ */
+#ifndef HOST_SHIMS_LWIP_SYS_H_
+#define HOST_SHIMS_LWIP_SYS_H_
+
+#include "freertos/FreeRTOS.h"
+
+#endif /* HOST_SHIMS_LWIP_SYS_H_ */
@@ -0,0 +1,25 @@
+/*
+ * @file: nvs_flash.h
+ *
+ * @brief: Host shim, initialisation of the default NVS partition. NVS encryption is not emulated, the secure calls
+ * return ESP_ERR_NOT_SUPPORTED.
+ */
+#ifndef HOST_SHIMS_NVS_FLASH_H_
+#define HOST_SHIMS_NVS_FLASH_H_
+
+#include "nvs.h"
+#include "esp_partition.h"
+
+typedef struct nvs_sec_cfg_t {
+	uint8_t eky[NVS_KEY_SIZE];
+	uint8_t tky[NVS_KEY_SIZE];
+}nvs_sec_cfg_t;
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_deinit(void);
+esp_err_t nvs_flash_erase(void);
+esp_err_t nvs_flash_secure_init(nvs_sec_cfg_t *);
+esp_err_t nvs_flash_generate_keys(const esp_partition_t *, nvs_sec_cfg_t *);
+esp_err_t nvs_flash_read_security_cfg(const esp_partition_t *, nvs_sec_cfg_t *);
+
+#endif /* HOST_SHIMS_NVS_FLASH_H_ */
@@ -0,0 +1,16 @@
+/*
+ * @file: sdkconfig.h
+ *
+ * @brief: Host shim, the subset of the project sdkconfig the components read. CONFIG_NVS_ENCRYPTION is left out,
+ * there is no flash encryption on the host.
+ */
+#ifndef HOST_SHIMS_SDKCONFIG_H_
+#define HOST_SHIMS_SDKCONFIG_H_
+
+#define CONFIG_IDF_TARGET "linux"
+#define CONFIG_IDF_TARGET_LINUX 1
+#define CONFIG_FREERTOS_HZ 1000
+#define CONFIG_ESPTOOLPY_FLASHSIZE "2MB"
+#define CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ 160
+
+#endif /* HOST_SHIMS_SDKCONFIG_H_ */
@@ -0,0 +1,29 @@
+/*
+ * @file: mbedtls/aes.h
+ *
+ * @brief: Host shim, used when the host has no mbedtls headers. The AES-ECB calls the components make run on
+ * OpenSSL's AES block functions.
+ */
+#ifndef HOST_SHIMS_MBEDTLS_AES_H_
+#define HOST_SHIMS_MBEDTLS_AES_H_
+
+#include <stddef.h>
+#include <openssl/aes.h>
+
+#define MBEDTLS_AES_ENCRYPT 1
+#define MBEDTLS_AES_DECRYPT 0
+
+#define MBEDTLS_ERR_AES_INVALID_KEY_LENGTH -0x0020
+#define MBEDTLS_ERR_AES_BAD_INPUT_DATA -0x0021
+
+typedef struct mbedtls_aes_context {
+	AES_KEY key;
+}mbedtls_aes_context;
+
+void mbedtls_aes_init(mbedtls_aes_context *);
+void mbedtls_aes_free(mbedtls_aes_context *);
+int mbedtls_aes_setkey_enc(mbedtls_aes_context *, const unsigned char *, unsigned int);
+int mbedtls_aes_setkey_dec(mbedtls_aes_context *, const unsigned char *, unsigned int);
+int mbedtls_aes_crypt_ecb(mbedtls_aes_context *, int, const unsigned char[16], unsigned char[16]);
+
+#endif /* HOST_SHIMS_MBEDTLS_AES_H_ */
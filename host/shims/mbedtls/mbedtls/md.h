@@ -0,0 +1,44 @@
+/*
+ * @file: mbedtls/md.h
+ *
+ * @brief: Host shim, used when the host has no mbedtls headers. The generic digest calls run on OpenSSL's EVP digests.
+ */
+#ifndef HOST_SHIMS_MBEDTLS_MD_H_
+#define HOST_SHIMS_MBEDTLS_MD_H_
+
+#include <stddef.h>
+
+#define MBEDTLS_MD_MAX_SIZE 64
+
+#define MBEDTLS_ERR_MD_BAD_INPUT_DATA -0x5100
+#define MBEDTLS_ERR_MD_ALLOC_FAILED -0x5180
+
+typedef enum {
+	MBEDTLS_MD_NONE = 0,
+	MBEDTLS_MD_MD5,
+	MBEDTLS_MD_SHA1,
+	MBEDTLS_MD_SHA224,
+	MBEDTLS_MD_SHA256,
+	MBEDTLS_MD_SHA384,
+	MBEDTLS_MD_SHA512,
+}mbedtls_md_type_t;
+
+typedef struct mbedtls_md_info_t mbedtls_md_info_t;
+
+typedef struct mbedtls_md_context_t {
+	const mbedtls_md_info_t * md_info;
+	void * md_ctx;
+}mbedtls_md_context_t;
+
+const mbedtls_md_info_t * mbedtls_md_info_from_type(mbedtls_md_type_t);
+unsigned char mbedtls_md_get_size(const mbedtls_md_info_t *);
+void mbedtls_md_init(mbedtls_md_context_t *);
+void mbedtls_md_free(mbedtls_md_context_t *);
+int mbedtls_md_setup(mbedtls_md_context_t *, const mbedtls_md_info_t *, int);
+int mbedtls_md_init_ctx(mbedtls_md_context_t *, const mbedtls_md_info_t *);
+int mbedtls_md_starts(mbedtls_md_context_t *);
+int mbedtls_md_update(mbedtls_md_context_t *, const unsigned char *, size_t);
+int mbedtls_md_finish(mbedtls_md_context_t *, unsigned char *);
+int mbedtls_md(const mbedtls_md_info_t *, const unsigned char *, size_t, unsigned char *);
+
+#endif /* HOST_SHIMS_MBEDTLS_MD_H_ */
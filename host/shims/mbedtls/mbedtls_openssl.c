@@ -0,0 +1,129 @@
+/*
+ * @file: mbedtls_openssl.c
+ *
+ * @brief: Host shim, the mbedtls AES and MD calls of the components on OpenSSL. Only built when mbedtls itself is not
+ * installed on the host.
+ */
+#include <string.h>
+#include <openssl/evp.h>
+
+#include "mbedtls/aes.h"
+#include "mbedtls/md.h"
+
+struct mbedtls_md_info_t {
+	mbedtls_md_type_t type;
+	const char * name;
+	unsigned char size;
+};
+
+static const mbedtls_md_info_t md_infos[] = {
+		{ MBEDTLS_MD_MD5, "MD5", 16 },
+		{ MBEDTLS_MD_SHA1, "SHA1", 20 },
+		{ MBEDTLS_MD_SHA224, "SHA224", 28 },
+		{ MBEDTLS_MD_SHA256, "SHA256", 32 },
+		{ MBEDTLS_MD_SHA384, "SHA384", 48 },
+		{ MBEDTLS_MD_SHA512, "SHA512", 64 },
+};
+
+void mbedtls_aes_init(mbedtls_aes_context * ctx)
+{
+	memset(ctx, 0, sizeof(mbedtls_aes_context));
+}
+
+void mbedtls_aes_free(mbedtls_aes_context * ctx)
+{
+	if( ctx != NULL ) memset(ctx, 0, sizeof(mbedtls_aes_context));
+}
+
+int mbedtls_aes_setkey_enc(mbedtls_aes_context * ctx, const unsigned char * key, unsigned int bits)
+{
+	if( bits != 128 && bits != 192 && bits != 256 ) return MBEDTLS_ERR_AES_INVALID_KEY_LENGTH;
+	return AES_set_encrypt_key(key, (int)bits, &(ctx->key)) ? MBEDTLS_ERR_AES_INVALID_KEY_LENGTH : 0;
+}
+
+int mbedtls_aes_setkey_dec(mbedtls_aes_context * ctx, const unsigned char * key, unsigned int bits)
+{
+	if( bits != 128 && bits != 192 && bits != 256 ) return MBEDTLS_ERR_AES_INVALID_KEY_LENGTH;
+	return AES_set_decrypt_key(key, (int)bits, &(ctx->key)) ? MBEDTLS_ERR_AES_INVALID_KEY_LENGTH : 0;
+}
+
+int mbedtls_aes_crypt_ecb(mbedtls_aes_context * ctx, int mode, const unsigned char input[16], unsigned char output[16])
+{
+	if( mode == MBEDTLS_AES_ENCRYPT ) AES_encrypt(input, output, &(ctx->key));
+	else if( mode == MBEDTLS_AES_DECRYPT ) AES_decrypt(input, output, &(ctx->key));
+	else return MBEDTLS_ERR_AES_BAD_INPUT_DATA;
+	return 0;
+}
+
+const mbedtls_md_info_t * mbedtls_md_info_from_type(mbedtls_md_type_t type)
+{
+	for( size_t i=0; i<sizeof(md_infos)/sizeof(md_infos[0]); i++ )
+		if( md_infos[i].type == type ) return &md_infos[i];
+	return NULL;
+}
+
+unsigned char mbedtls_md_get_size(const mbedtls_md_info_t * info)
+{
+	return info == NULL ? 0 : info->size;
+}
+
+void mbedtls_md_init(mbedtls_md_context_t * ctx)
+{
+	memset(ctx, 0, sizeof(mbedtls_md_context_t));
+}
+
+void mbedtls_md_free(mbedtls_md_context_t * ctx)
+{
+	if( ctx == NULL ) return;
+	EVP_MD_CTX_free((EVP_MD_CTX *)ctx->md_ctx);
+	memset(ctx, 0, sizeof(mbedtls_md_context_t));
+}
+
+int mbedtls_md_setup(mbedtls_md_context_t * ctx, const mbedtls_md_info_t * info, int hmac)
+{
+	if( ctx == NULL || info == NULL || hmac ) return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+
+	ctx->md_ctx = EVP_MD_CTX_new();
+	if( ctx->md_ctx == NULL ) return MBEDTLS_ERR_MD_ALLOC_FAILED;
+
+	ctx->md_info = info;
+	return 0;
+}
+
+int mbedtls_md_init_ctx(mbedtls_md_context_t * ctx, const mbedtls_md_info_t * info)
+{
+	return mbedtls_md_setup(ctx, info, 0);
+}
+
+int mbedtls_md_starts(mbedtls_md_context_t * ctx)
+{
+	if( ctx == NULL || ctx->md_info == NULL ) return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+	const EVP_MD * md = EVP_get_digestbyname(ctx->md_info->name);
+	return md != NULL && EVP_DigestInit_ex((EVP_MD_CTX *)ctx->md_ctx, md, NULL) ? 0 : MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+}
+
+int mbedtls_md_update(mbedtls_md_context_t * ctx, const unsigned char * input, size_t length)
+{
+	if( ctx == NULL || ctx->md_info == NULL ) return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+	return EVP_DigestUpdate((EVP_MD_CTX *)ctx->md_ctx, input, length) ? 0 : MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+}
+
+int mbedtls_md_finish(mbedtls_md_context_t * ctx, unsigned char * output)
+{
+	if( ctx == NULL || ctx->md_info == NULL ) return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+	return EVP_DigestFinal_ex((EVP_MD_CTX *)ctx->md_ctx, output, NULL) ? 0 : MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+}
+
+int mbedtls_md(const mbedtls_md_info_t * info, const unsigned char * input, size_t length, unsigned char * output)
+{
+	mbedtls_md_context_t ctx;
+	mbedtls_md_init(&ctx);
+
+	int ret = mbedtls_md_setup(&ctx, info, 0);
+	if( !ret ) ret = mbedtls_md_starts(&ctx);
+	if( !ret ) ret = mbedtls_md_update(&ctx, input, length);
+	if( !ret ) ret = mbedtls_md_finish(&ctx, output);
+
+	mbedtls_md_free(&ctx);
+	return ret;
+}
@@ -0,0 +1,523 @@
+/*
+ * @file: nvs.c
+ *
+ * @brief: Host shim, NVS with the semantics of the ESP-IDF implementation the components rely on : items are looked up
+ * by namespace, key and type, a read only handle cannot create a namespace, the string and blob getters report the
+ * required length, and the space of the partition is accounted the way NVS pages are (32 byte entries, one page kept
+ * free for garbage collection). nvs_commit() writes the whole store to the "nvs" partition of the emulated flash, so
+ * the content survives a restart of the program the way it survives a reboot.
+ */
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "esp_spi_flash.h"
+
+#define HOST_NVS_MAGIC 0x53564E48u
+#define HOST_NVS_VERSION 1u
+#define HOST_NVS_MAX_HANDLES 64
+#define HOST_NVS_ENTRY_SIZE 32
+#define HOST_NVS_ENTRIES_PER_PAGE 126
+#define HOST_NVS_MAX_STRING 4000
+
+/*
+ * @brief: Type of the record that only declares a namespace.
+ */
+#define HOST_NVS_TYPE_NAMESPACE 0x00
+
+typedef struct host_nvs_item {
+	char ns[NVS_KEY_NAME_MAX_SIZE];
+	char key[NVS_KEY_NAME_MAX_SIZE];
+	uint8_t type;
+	uint32_t length;
+	uint8_t * data;
+}host_nvs_item;
+
+typedef struct host_nvs_handle {
+	nvs_handle_t id;
+	char ns[NVS_KEY_NAME_MAX_SIZE];
+	nvs_open_mode_t mode;
+}host_nvs_handle;
+
+typedef struct host_nvs_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t length;
+}host_nvs_header;
+
+typedef struct host_nvs_record {
+	char ns[NVS_KEY_NAME_MAX_SIZE];
+	char key[NVS_KEY_NAME_MAX_SIZE];
+	uint32_t type;
+	uint32_t length;
+}host_nvs_record;
+
+static pthread_mutex_t nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint8_t nvs_initialized = 0;
+
+static host_nvs_item * items = NULL;
+static size_t item_count = 0;
+static size_t item_capacity = 0;
+
+static size_t used_space = 0;
+static size_t capacity = 0;
+
+static host_nvs_handle handles[HOST_NVS_MAX_HANDLES];
+static nvs_handle_t next_handle = 1;
+
+static const esp_partition_t * nvs_partition(void)
+{
+	return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS, NVS_DEFAULT_PART_NAME);
+}
+
+/*
+ * @brief: This function returns the bytes an item takes on the NVS pages, a 32 byte entry plus the data in entries.
+ */
+static size_t item_space(uint8_t type, uint32_t length)
+{
+	if( type == NVS_TYPE_STR || type == NVS_TYPE_BLOB ) return HOST_NVS_ENTRY_SIZE + ((length + HOST_NVS_ENTRY_SIZE - 1) & ~(size_t)(HOST_NVS_ENTRY_SIZE - 1));
+	return HOST_NVS_ENTRY_SIZE;
+}
+
+static void store_clear(void)
+{
+	for( size_t i=0; i<item_count; i++ ) free(items[i].data);
+	free(items);
+	items = NULL;
+	item_count = 0;
+	item_capacity = 0;
+	used_space = 0;
+	memset(handles, 0, sizeof(handles));
+}
+
+static host_nvs_item * store_find(const char * ns, const char * key, uint8_t type)
+{
+	for( size_t i=0; i<item_count; i++ )
+	{
+		host_nvs_item * item = &items[i];
+		if( item->type == type && !strcmp(item->ns, ns) && !strcmp(item->key, key) ) return item;
+	}
+	return NULL;
+}
+
+/*
+ * @brief: This function stores an item, replacing the one with the same namespace, key and type.
+ *
+ * @return: esp_err_t
+ * ESP_ERR_NVS_NOT_ENOUGH_SPACE if the pages cannot take it
+ */
+static esp_err_t store_put(const char * ns, const char * key, uint8_t type, const void * data, uint32_t length)
+{
+	host_nvs_item * item = store_find(ns, key, type);
+	size_t released = item == NULL ? 0 : item_space(type, item->length);
+
+	if( used_space - released + item_space(type, length) > capacity ) return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+
+	uint8_t * copy = NULL;
+	if( length )
+	{
+		copy = (uint8_t *)malloc(length);
+		if( copy == NULL ) return ESP_ERR_NO_MEM;
+		memcpy(copy, data, length);
+	}
+
+	if( item == NULL )
+	{
+		if( item_count == item_capacity )
+		{
+			size_t grown = item_capacity ? item_capacity * 2 : 16;
+			host_nvs_item * resized = (host_nvs_item *)realloc(items, grown * sizeof(host_nvs_item));
+			if( resized == NULL )
+			{
+				free(copy);
+				return ESP_ERR_NO_MEM;
+			}
+			items = resized;
+			item_capacity = grown;
+		}
+		item = &items[item_count++];
+		memset(item, 0, sizeof(host_nvs_item));
+		strncpy(item->ns, ns, NVS_KEY_NAME_MAX_SIZE - 1);
+		strncpy(item->key, key, NVS_KEY_NAME_MAX_SIZE - 1);
+		item->type = type;
+	}
+	else free(item->data);
+
+	item->data = copy;
+	item->length = length;
+	used_space = used_space - released + item_space(type, length);
+	return ESP_OK;
+}
+
+static uint8_t namespace_exists(const char * ns)
+{
+	return store_find(ns, "", HOST_NVS_TYPE_NAMESPACE) != NULL;
+}
+
+/*
+ * @brief: This function loads the store from the partition.
+ *
+ * @return: esp_err_t
+ * ESP_ERR_NVS_NO_FREE_PAGES : the partition holds something else, it has to be erased
+ * ESP_ERR_NVS_NEW_VERSION_FOUND : the partition was written by a newer format
+ */
+static esp_err_t store_load(const esp_partition_t * part)
+{
+	host_nvs_header header;
+	esp_err_t _err = esp_partition_read(part, 0, &header, sizeof(header));
+	if( _err != ESP_OK ) return _err;
+
+	if( header.magic == 0xFFFFFFFFu ) return ESP_OK;
+	if( header.magic != HOST_NVS_MAGIC ) return ESP_ERR_NVS_NO_FREE_PAGES;
+	if( header.version > HOST_NVS_VERSION ) return ESP_ERR_NVS_NEW_VERSION_FOUND;
+	if( header.length > part->size - sizeof(header) ) return ESP_ERR_NVS_NO_FREE_PAGES;
+
+	size_t offset = sizeof(header);
+	size_t end = offset + header.length;
+	for( uint32_t i=0; i<header.count; i++ )
+	{
+		host_nvs_record record;
+		if( offset + sizeof(record) > end ) return ESP_ERR_NVS_NO_FREE_PAGES;
+		esp_partition_read(part, offset, &record, sizeof(record));
+		offset += sizeof(record);
+
+		if( record.length > end - offset ) return ESP_ERR_NVS_NO_FREE_PAGES;
+		record.ns[NVS_KEY_NAME_MAX_SIZE - 1] = '\0';
+		record.key[NVS_KEY_NAME_MAX_SIZE - 1] = '\0';
+
+		uint8_t * data = NULL;
+		if( record.length )
+		{
+			data = (uint8_t *)malloc(record.length);
+			if( data == NULL ) return ESP_ERR_NO_MEM;
+			esp_partition_read(part, offset, data, record.length);
+		}
+		offset += record.length;
+
+		_err = store_put(record.ns, record.key, (uint8_t)record.type, data, record.length);
+		free(data);
+		if( _err != ESP_OK ) return ESP_ERR_NVS_NO_FREE_PAGES;
+	}
+	return ESP_OK;
+}
+
+static esp_err_t store_save(void)
+{
+	const esp_partition_t * part = nvs_partition();
+	if( part == NULL ) return ESP_ERR_NVS_PART_NOT_FOUND;
+
+	size_t length = 0;
+	for( size_t i=0; i<item_count; i++ ) length += sizeof(host_nvs_record) + items[i].length;
+	if( sizeof(host_nvs_header) + length > part->size ) return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+
+	uint8_t * image = (uint8_t *)malloc(sizeof(host_nvs_header) + length);
+	if( image == NULL ) return ESP_ERR_NO_MEM;
+
+	host_nvs_header header = { .magic = HOST_NVS_MAGIC, .version = HOST_NVS_VERSION, .count = (uint32_t)item_count, .length = (uint32_t)length };
+	memcpy(image, &header, sizeof(header));
+
+	size_t offset = sizeof(header);
+	for( size_t i=0; i<item_count; i++ )
+	{
+		host_nvs_record record;
+		memset(&record, 0, sizeof(record));
+		memcpy(record.ns, items[i].ns, NVS_KEY_NAME_MAX_SIZE);
+		memcpy(record.key, items[i].key, NVS_KEY_NAME_MAX_SIZE);
+		record.type = items[i].type;
+		record.length = items[i].length;
+
+		memcpy(image + offset, &record, sizeof(record));
+		offset += sizeof(record);
+		if( items[i].length ) memcpy(image + offset, items[i].data, items[i].length);
+		offset += items[i].length;
+	}
+
+	size_t erase = (offset + SPI_FLASH_SEC_SIZE - 1) & ~(size_t)(SPI_FLASH_SEC_SIZE - 1);
+	esp_err_t _err = esp_partition_erase_range(part, 0, erase);
+	if( _err == ESP_OK ) _err = esp_partition_write(part, 0, image, offset);
+
+	free(image);
+	return _err;
+}
+
+static host_nvs_handle * handle_find(nvs_handle_t id)
+{
+	if( !id ) return NULL;
+	for( uint8_t i=0; i<HOST_NVS_MAX_HANDLES; i++ )
+		if( handles[i].id == id ) return &handles[i];
+	return NULL;
+}
+
+esp_err_t nvs_flash_init(void)
+{
+	pthread_mutex_lock(&nvs_lock);
+
+	esp_err_t _err = ESP_OK;
+	if( !nvs_initialized )
+	{
+		const esp_partition_t * part = nvs_partition();
+		if( part == NULL ) _err = ESP_ERR_NOT_FOUND;
+		else
+		{
+			capacity = (part->size / SPI_FLASH_SEC_SIZE - 1) * HOST_NVS_ENTRIES_PER_PAGE * HOST_NVS_ENTRY_SIZE;
+			_err = store_load(part);
+			if( _err == ESP_OK ) nvs_initialized = 1;
+			else store_clear();
+		}
+	}
+
+	pthread_mutex_unlock(&nvs_lock);
+	return _err;
+}
+
+esp_err_t nvs_flash_deinit(void)
+{
+	pthread_mutex_lock(&nvs_lock);
+
+	esp_err_t _err = nvs_initialized ? ESP_OK : ESP_ERR_NVS_NOT_INITIALIZED;
+	store_clear();
+	nvs_initialized = 0;
+
+	pthread_mutex_unlock(&nvs_lock);
+	return _err;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+	const esp_partition_t * part = nvs_partition();
+	if( part == NULL ) return ESP_ERR_NOT_FOUND;
+
+	pthread_mutex_lock(&nvs_lock);
+	store_clear();
+	nvs_initialized = 0;
+	esp_err_t _err = esp_partition_erase_range(part, 0, part->size);
+	pthread_mutex_unlock(&nvs_lock);
+
+	return _err;
+}
+
+esp_err_t nvs_flash_secure_init(nvs_sec_cfg_t * cfg)
+{
+	(void)cfg;
+	return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t nvs_flash_generate_keys(const esp_partition_t * part, nvs_sec_cfg_t * cfg)
+{
+	(void)part;
+	(void)cfg;
+	return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t nvs_flash_read_security_cfg(const esp_partition_t * part, nvs_sec_cfg_t * cfg)
+{
+	(void)part;
+	(void)cfg;
+	return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t nvs_open(const char * name, nvs_open_mode_t mode, nvs_handle_t * out)
+{
+	if( name == NULL || out == NULL ) return ESP_ERR_INVALID_ARG;
+	if( strlen(name) >= NVS_KEY_NAME_MAX_SIZE ) return ESP_ERR_NVS_KEY_TOO_LONG;
+
+	pthread_mutex_lock(&nvs_lock);
+
+	esp_err_t _err = ESP_OK;
+	host_nvs_handle * handle = NULL;
+	for( uint8_t i=0; i<HOST_NVS_MAX_HANDLES && handle == NULL; i++ )
+		if( !handles[i].id ) handle = &handles[i];
+
+	if( !nvs_initialized ) _err = ESP_ERR_NVS_NOT_INITIALIZED;
+	else if( !namespace_exists(name) )
+	{
+		if( mode == NVS_READONLY ) _err = ESP_ERR_NVS_NOT_FOUND;
+		else _err = store_put(name, "", HOST_NVS_TYPE_NAMESPACE, NULL, 0);
+	}
+	if( _err == ESP_OK && handle == NULL ) _err = ESP_ERR_NO_MEM;
+
+	if( _err == ESP_OK )
+	{
+		memset(handle, 0, sizeof(host_nvs_handle));
+		handle->id = next_handle++;
+		strncpy(handle->ns, name, NVS_KEY_NAME_MAX_SIZE - 1);
+		handle->mode = mode;
+		*out = handle->id;
+	}
+
+	pthread_mutex_unlock(&nvs_lock);
+	return _err;
+}
+
+void nvs_close(nvs_handle_t id)
+{
+	pthread_mutex_lock(&nvs_lock);
+	host_nvs_handle * handle = handle_find(id);
+	if( handle != NULL ) handle->id = 0;
+	pthread_mutex_unlock(&nvs_lock);
+}
+
+esp_err_t nvs_commit(nvs_handle_t id)
+{
+	pthread_mutex_lock(&nvs_lock);
+	esp_err_t _err = handle_find(id) == NULL ? ESP_ERR_NVS_INVALID_HANDLE : store_save();
+	pthread_mutex_unlock(&nvs_lock);
+	return _err;
+}
+
+/*
+ * @brief: This function checks a handle and a key for an access, the NVS lock is held.
+ */
+static esp_err_t access_check(nvs_handle_t id, const char * key, uint8_t write, host_nvs_handle ** out)
+{
+	host_nvs_handle * handle = handle_find(id);
+	if( handle == NULL ) return ESP_ERR_NVS_INVALID_HANDLE;
+	if( key == NULL ) return ESP_ERR_INVALID_ARG;
+	if( !strlen(key) ) return ESP_ERR_NVS_INVALID_NAME;
+	if( strlen(key) >= NVS_KEY_NAME_MAX_SIZE ) return ESP_ERR_NVS_KEY_TOO_LONG;
+	if( write && handle->mode == NVS_READONLY ) return ESP_ERR_NVS_READ_ONLY;
+	*out = handle;
+	return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t id, const char * key)
+{
+	pthread_mutex_lock(&nvs_lock);
+
+	host_nvs_handle * handle = NULL;
+	esp_err_t _err = access_check(id, key, 1, &handle);
+	if( _err == ESP_OK )
+	{
+		// every type stored under the key goes, the way nvs_erase_key() does it
+		_err = ESP_ERR_NVS_NOT_FOUND;
+		for( size_t i=0; i<item_count; )
+		{
+			host_nvs_item * item = &items[i];
+			if( item->type == HOST_NVS_TYPE_NAMESPACE || strcmp(item->ns, handle->ns) || strcmp(item->key, key) )
+			{
+				i++;
+				continue;
+			}
+			used_space -= item_space(item->type, item->length);
+			free(item->data);
+			items[i] = items[--item_count];
+			_err = ESP_OK;
+		}
+	}
+
+	pthread_mutex_unlock(&nvs_lock);
+	return _err;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t id)
+{
+	pthread_mutex_lock(&nvs_lock);
+
+	host_nvs_handle * handle = handle_find(id);
+	esp_err_t _err = handle == NULL ? ESP_ERR_NVS_INVALID_HANDLE : (handle->mode == NVS_READONLY ? ESP_ERR_NVS_READ_ONLY : ESP_OK);
+	for( size_t i=0; _err == ESP_OK && i<item_count; )
+	{
+		host_nvs_item * item = &items[i];
+		if( item->type == HOST_NVS_TYPE_NAMESPACE || strcmp(item->ns, handle->ns) )
+		{
+			i++;
+			continue;
+		}
+		used_space -= item_space(item->type, item->length);
+		free(item->data);
+		items[i] = items[--item_count];
+	}
+
+	pthread_mutex_unlock(&nvs_lock);
+	return _err;
+}
+
+static esp_err_t nvs_set(nvs_handle_t id, const char * key, uint8_t type, const void * data, size_t length)
+{
+	pthread_mutex_lock(&nvs_lock);
+
+	host_nvs_handle * handle = NULL;
+	esp_err_t _err = access_check(id, key, 1, &handle);
+	if( _err == ESP_OK && data == NULL && length ) _err = ESP_ERR_INVALID_ARG;
+	if( _err == ESP_OK && length > capacity ) _err = ESP_ERR_NVS_VALUE_TOO_LONG;
+	if( _err == ESP_OK ) _err = store_put(handle->ns, key, type, data, (uint32_t)length);
+
+	pthread_mutex_unlock(&nvs_lock);
+	return _err;
+}
+
+static esp_err_t nvs_get(nvs_handle_t id, const char * key, uint8_t type, void * out, size_t * length)
+{
+	pthread_mutex_lock(&nvs_lock);
+
+	host_nvs_handle * handle = NULL;
+	esp_err_t _err = access_check(id, key, 0, &handle);
+	host_nvs_item * item = _err == ESP_OK ? store_find(handle->ns, key, type) : NULL;
+	if( _err == ESP_OK && item == NULL ) _err = ESP_ERR_NVS_NOT_FOUND;
+
+	if( _err == ESP_OK )
+	{
+		if( type != NVS_TYPE_STR && type != NVS_TYPE_BLOB ) memcpy(out, item->data, item->length);
+		else if( length == NULL ) _err = ESP_ERR_NVS_INVALID_LENGTH;
+		else if( out == NULL ) *length = item->length;
+		else if( *length < item->length )
+		{
+			*length = item->length;
+			_err = ESP_ERR_NVS_INVALID_LENGTH;
+		}
+		else
+		{
+			memcpy(out, item->data, item->length);
+			*length = item->length;
+		}
+	}
+
+	pthread_mutex_unlock(&nvs_lock);
+	return _err;
+}
+
+#define HOST_NVS_PRIMITIVE(name, ctype, nvs_type) \
+	esp_err_t nvs_set_##name(nvs_handle_t id, const char * key, ctype value) \
+	{ \
+		return nvs_set(id, key, nvs_type, &value, sizeof(value)); \
+	} \
+	esp_err_t nvs_get_##name(nvs_handle_t id, const char * key, ctype * value) \
+	{ \
+		if( value == NULL ) return ESP_ERR_INVALID_ARG; \
+		return nvs_get(id, key, nvs_type, value, NULL); \
+	}
+
+HOST_NVS_PRIMITIVE(i8, int8_t, NVS_TYPE_I8)
+HOST_NVS_PRIMITIVE(u8, uint8_t, NVS_TYPE_U8)
+HOST_NVS_PRIMITIVE(i16, int16_t, NVS_TYPE_I16)
+HOST_NVS_PRIMITIVE(u16, uint16_t, NVS_TYPE_U16)
+HOST_NVS_PRIMITIVE(i32, int32_t, NVS_TYPE_I32)
+HOST_NVS_PRIMITIVE(u32, uint32_t, NVS_TYPE_U32)
+HOST_NVS_PRIMITIVE(i64, int64_t, NVS_TYPE_I64)
+HOST_NVS_PRIMITIVE(u64, uint64_t, NVS_TYPE_U64)
+
+esp_err_t nvs_set_str(nvs_handle_t id, const char * key, const char * value)
+{
+	if( value == NULL ) return ESP_ERR_INVALID_ARG;
+	if( strlen(value) + 1 > HOST_NVS_MAX_STRING ) return ESP_ERR_NVS_VALUE_TOO_LONG;
+	return nvs_set(id, key, NVS_TYPE_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t id, const char * key, char * out, size_t * length)
+{
+	return nvs_get(id, key, NVS_TYPE_STR, out, length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t id, const char * key, const void * value, size_t length)
+{
+	return nvs_set(id, key, NVS_TYPE_BLOB, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t id, const char * key, void * out, size_t * length)
+{
+	return nvs_get(id, key, NVS_TYPE_BLOB, out, length);
+}
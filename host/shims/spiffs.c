@@ -0,0 +1,175 @@
+/*
+ * @file: spiffs.c
+ *
+ * @brief: Host shim, SPIFFS mounts as host directories. SPIFFS has no directories, so a '/' after the mount point is
+ * part of the file name and is stored as "%2F". Names are limited to SPIFFS_OBJ_NAME_LEN like on the device, the
+ * partition size is not enforced on writes.
+ */
+#include <errno.h>
+#include <dirent.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "esp_spiffs.h"
+#include "esp_partition.h"
+
+#define HOST_SPIFFS_MAX_MOUNTS 4
+#define HOST_SPIFFS_PATH_LENGTH 256
+
+/*
+ * @brief: Longest object name SPIFFS stores, the leading '/' and the terminator included.
+ */
+#define SPIFFS_OBJ_NAME_LEN 32
+
+typedef struct host_spiffs_mount {
+	char base_path[HOST_SPIFFS_PATH_LENGTH];
+	char dir[HOST_SPIFFS_PATH_LENGTH];
+	const esp_partition_t * part;
+}host_spiffs_mount;
+
+static host_spiffs_mount mounts[HOST_SPIFFS_MAX_MOUNTS];
+
+static pthread_mutex_t spiffs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+FILE * __real_fopen(const char *, const char *);
+
+static host_spiffs_mount * mount_find(const char * label)
+{
+	for( uint8_t i=0; i<HOST_SPIFFS_MAX_MOUNTS; i++ )
+	{
+		if( mounts[i].part == NULL ) continue;
+		if( label == NULL || !strcmp(mounts[i].part->label, label) ) return &mounts[i];
+	}
+	return NULL;
+}
+
+esp_err_t esp_vfs_spiffs_register(const esp_vfs_spiffs_conf_t * conf)
+{
+	if( conf == NULL || conf->base_path == NULL || strlen(conf->base_path) >= HOST_SPIFFS_PATH_LENGTH ) return ESP_ERR_INVALID_ARG;
+
+	const esp_partition_t * part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, conf->partition_label);
+	if( part == NULL ) return ESP_ERR_NOT_FOUND;
+
+	pthread_mutex_lock(&spiffs_lock);
+
+	esp_err_t _err = ESP_OK;
+	host_spiffs_mount * mount = NULL;
+	for( uint8_t i=0; i<HOST_SPIFFS_MAX_MOUNTS; i++ )
+	{
+		if( mounts[i].part == part ) _err = ESP_ERR_INVALID_STATE;
+		else if( mounts[i].part == NULL && mount == NULL ) mount = &mounts[i];
+	}
+	if( _err == ESP_OK && mount == NULL ) _err = ESP_ERR_NO_MEM;
+
+	if( _err == ESP_OK )
+	{
+		const char * dir = getenv("HOST_SPIFFS_DIR");
+		if( dir == NULL ) dir = "spiffs";
+
+		if( mkdir(dir, 0755) != 0 && errno != EEXIST ) _err = ESP_FAIL;
+		else
+		{
+			strncpy(mount->base_path, conf->base_path, HOST_SPIFFS_PATH_LENGTH - 1);
+			strncpy(mount->dir, dir, HOST_SPIFFS_PATH_LENGTH - 1);
+			mount->part = part;
+		}
+	}
+
+	pthread_mutex_unlock(&spiffs_lock);
+	return _err;
+}
+
+esp_err_t esp_vfs_spiffs_unregister(const char * label)
+{
+	pthread_mutex_lock(&spiffs_lock);
+	host_spiffs_mount * mount = mount_find(label);
+	if( mount != NULL ) memset(mount, 0, sizeof(host_spiffs_mount));
+	pthread_mutex_unlock(&spiffs_lock);
+
+	return mount == NULL ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
+
+bool esp_spiffs_mounted(const char * label)
+{
+	pthread_mutex_lock(&spiffs_lock);
+	bool mounted = mount_find(label) != NULL;
+	pthread_mutex_unlock(&spiffs_lock);
+	return mounted;
+}
+
+esp_err_t esp_spiffs_info(const char * label, size_t * total, size_t * used)
+{
+	pthread_mutex_lock(&spiffs_lock);
+
+	host_spiffs_mount * mount = mount_find(label);
+	if( mount == NULL )
+	{
+		pthread_mutex_unlock(&spiffs_lock);
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	size_t bytes = 0;
+	DIR * dir = opendir(mount->dir);
+	for( struct dirent * entry = dir == NULL ? NULL : readdir(dir); entry != NULL; entry = readdir(dir) )
+	{
+		char path[2 * HOST_SPIFFS_PATH_LENGTH + 2];
+		struct stat st;
+		snprintf(path, sizeof(path), "%s/%s", mount->dir, entry->d_name);
+		if( stat(path, &st) == 0 && S_ISREG(st.st_mode) ) bytes += st.st_size;
+	}
+	if( dir != NULL ) closedir(dir);
+
+	if( total != NULL ) *total = mount->part->size;
+	if( used != NULL ) *used = bytes;
+
+	pthread_mutex_unlock(&spiffs_lock);
+	return ESP_OK;
+}
+
+/*
+ * @brief: fopen() of the host build, a path under a mount point opens the file in the directory of the mount.
+ */
+FILE * __wrap_fopen(const char * path, const char * mode)
+{
+	char host_path[3 * HOST_SPIFFS_PATH_LENGTH];
+	host_spiffs_mount * mount = NULL;
+	size_t base = 0;
+
+	pthread_mutex_lock(&spiffs_lock);
+	for( uint8_t i=0; path != NULL && i<HOST_SPIFFS_MAX_MOUNTS && mount == NULL; i++ )
+	{
+		base = strlen(mounts[i].base_path);
+		if( mounts[i].part != NULL && !strncmp(path, mounts[i].base_path, base) && path[base] == '/' ) mount = &mounts[i];
+	}
+
+	if( mount == NULL )
+	{
+		pthread_mutex_unlock(&spiffs_lock);
+		return __real_fopen(path, mode);
+	}
+
+	const char * name = path + base;
+	if( strlen(name) >= SPIFFS_OBJ_NAME_LEN )
+	{
+		pthread_mutex_unlock(&spiffs_lock);
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+
+	size_t n = (size_t)snprintf(host_path, sizeof(host_path), "%s/", mount->dir);
+	pthread_mutex_unlock(&spiffs_lock);
+
+	for( name++; *name && n < sizeof(host_path) - 4; name++ )
+	{
+		if( *name == '/' )
+		{
+			memcpy(host_path + n, "%2F", 3);
+			n += 3;
+		}
+		else host_path[n++] = *name;
+	}
+	host_path[n] = '\0';
+
+	return __real_fopen(host_path, mode);
+}
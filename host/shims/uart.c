@@ -0,0 +1,578 @@
+/*
+ * @file: uart.c
+ *
+ * @brief: Host shim, the UART driver on pseudo terminals. A reader thread per port moves what arrives on the pty into
+ * the RX ring buffer and posts the driver events : UART_PATTERN_DET for the bytes up to a detected pattern,
+ * UART_DATA for the rest, UART_BUFFER_FULL when the ring buffer has no room, in which case the bytes wait in the
+ * pty the way they wait in the hardware FIFO. Pattern positions are kept as absolute byte counts, so they stay right
+ * while the ring buffer is read.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "driver/uart.h"
+#include "freertos/task.h"
+#include "host_shims.h"
+
+#define HOST_UART_PTY_NAME_LENGTH 64
+#define HOST_UART_POLL_MS 10
+
+typedef struct host_uart {
+	uint8_t installed;
+	int master;
+	int slave;
+	char pty[HOST_UART_PTY_NAME_LENGTH];
+	uint8_t drain;
+	int wake[2];
+	pthread_t thread;
+	volatile uint8_t running;
+	pthread_mutex_t lock;
+	pthread_cond_t readable;
+	QueueHandle_t events;
+	uint8_t * ring;
+	size_t ring_size;
+	size_t ring_head;
+	size_t ring_count;
+	uint8_t pending[UART_FIFO_LEN];
+	size_t pending_length;
+	uint64_t received;
+	uint64_t consumed;
+	uint8_t buffer_full;
+	int rx_full_threshold;
+	uint8_t pattern_enabled;
+	char pattern;
+	uint8_t pattern_length;
+	uint8_t pattern_run;
+	uint64_t * pattern_pos;
+	int pattern_queue_size;
+	int pattern_queue_head;
+	int pattern_queue_count;
+}host_uart;
+
+static host_uart uarts[UART_NUM_MAX];
+
+static host_uart * uart_get(uart_port_t port)
+{
+	if( port < 0 || port >= UART_NUM_MAX || !uarts[port].installed ) return NULL;
+	return &uarts[port];
+}
+
+static void post_event(host_uart * uart, uart_event_type_t type, size_t size)
+{
+	if( uart->events == NULL ) return;
+
+	uart_event_t event = { .type = type, .size = size, .timeout_flag = false };
+
+	// the driver posts from its interrupt handler and loses the event when the queue is full, the shim does the same
+	xQueueSend(uart->events, &event, 0);
+}
+
+static void pattern_record(host_uart * uart, uint64_t position)
+{
+	if( uart->pattern_queue_size <= 0 ) return;
+
+	if( uart->pattern_queue_count == uart->pattern_queue_size )
+	{
+		// the oldest position is overwritten, like the driver's pattern queue
+		uart->pattern_queue_head = (uart->pattern_queue_head + 1) % uart->pattern_queue_size;
+		uart->pattern_queue_count--;
+	}
+
+	int slot = (uart->pattern_queue_head + uart->pattern_queue_count) % uart->pattern_queue_size;
+	uart->pattern_pos[slot] = position;
+	uart->pattern_queue_count++;
+}
+
+static void pattern_clear(host_uart * uart)
+{
+	uart->pattern_queue_head = 0;
+	uart->pattern_queue_count = 0;
+	uart->pattern_run = 0;
+}
+
+/*
+ * @brief: This function moves received bytes into the ring buffer and posts the events, the uart lock is held.
+ *
+ * @param:
+ * 1. host_uart * uart : the port.
+ * 2. const uint8_t * data : received bytes.
+ * 3. size_t length : number of bytes.
+ *
+ * @return: size_t
+ * number of bytes taken, the rest did not fit
+ */
+static size_t rx_store(host_uart * uart, const uint8_t * data, size_t length)
+{
+	size_t taken = 0;
+	size_t unreported = 0;
+
+	while( taken < length && uart->ring_count < uart->ring_size )
+	{
+		uint8_t byte = data[taken++];
+		uart->ring[(uart->ring_head + uart->ring_count) % uart->ring_size] = byte;
+		uart->ring_count++;
+		uart->received++;
+		unreported++;
+
+		if( !uart->pattern_enabled ) continue;
+
+		if( byte != (uint8_t)uart->pattern )
+		{
+			uart->pattern_run = 0;
+			continue;
+		}
+
+		if( ++(uart->pattern_run) < uart->pattern_length ) continue;
+
+		uart->pattern_run = 0;
+		pattern_record(uart, uart->received - uart->pattern_length);
+		post_event(uart, UART_PATTERN_DET, unreported);
+		unreported = 0;
+	}
+
+	// UART_DATA events come at most 'rx_full_threshold' bytes at a time, the interrupt granularity of the driver
+	while( unreported )
+	{
+		size_t size = unreported < (size_t)uart->rx_full_threshold ? unreported : (size_t)uart->rx_full_threshold;
+		post_event(uart, UART_DATA, size);
+		unreported -= size;
+	}
+
+	if( taken < length && !uart->buffer_full )
+	{
+		uart->buffer_full = 1;
+		post_event(uart, UART_BUFFER_FULL, 0);
+	}
+
+	if( taken ) pthread_cond_broadcast(&(uart->readable));
+	return taken;
+}
+
+static void rx_pending(host_uart * uart)
+{
+	if( !uart->pending_length ) return;
+
+	size_t taken = rx_store(uart, uart->pending, uart->pending_length);
+	memmove(uart->pending, uart->pending + taken, uart->pending_length - taken);
+	uart->pending_length -= taken;
+}
+
+static void * uart_thread(void * arg)
+{
+	host_uart * uart = (host_uart *)arg;
+	uint8_t chunk[UART_FIFO_LEN];
+
+	while( uart->running )
+	{
+		pthread_mutex_lock(&(uart->lock));
+		rx_pending(uart);
+		uint8_t receive = uart->pending_length == 0;
+		uint8_t drain = uart->drain;
+		pthread_mutex_unlock(&(uart->lock));
+
+		struct pollfd fds[3] = {
+				{ .fd = uart->wake[0], .events = POLLIN },
+				{ .fd = receive ? uart->master : -1, .events = POLLIN },
+				{ .fd = drain ? uart->slave : -1, .events = POLLIN },
+		};
+
+		if( poll(fds, 3, receive ? -1 : HOST_UART_POLL_MS) <= 0 ) continue;
+
+		if( fds[0].revents & POLLIN )
+		{
+			while( read(uart->wake[0], chunk, sizeof(chunk)) > 0 );
+		}
+
+		if( fds[1].revents & POLLIN )
+		{
+			ssize_t n = read(uart->master, chunk, sizeof(chunk));
+			if( n > 0 )
+			{
+				pthread_mutex_lock(&(uart->lock));
+				size_t taken = rx_store(uart, chunk, (size_t)n);
+				memcpy(uart->pending, chunk + taken, (size_t)n - taken);
+				uart->pending_length = (size_t)n - taken;
+				pthread_mutex_unlock(&(uart->lock));
+			}
+		}
+
+		if( (fds[2].revents & POLLIN) && uart->drain )
+		{
+			// what the port transmits is consumed here unless the far end was handed out
+			if( read(uart->slave, chunk, sizeof(chunk)) < 0 && errno != EAGAIN ) vTaskDelay(pdMS_TO_TICKS(HOST_UART_POLL_MS));
+		}
+	}
+	return NULL;
+}
+
+static void uart_wake(host_uart * uart)
+{
+	uint8_t byte = 0;
+	if( write(uart->wake[1], &byte, 1) < 0 ) return;
+}
+
+/*
+ * @brief: This function opens the pty of a port in raw mode, the far end is kept open so the pty stays usable.
+ */
+static esp_err_t pty_open(host_uart * uart)
+{
+	uart->master = posix_openpt(O_RDWR | O_NOCTTY);
+	if( uart->master < 0 ) return ESP_FAIL;
+
+	if( grantpt(uart->master) || unlockpt(uart->master) || ptsname_r(uart->master, uart->pty, sizeof(uart->pty)) )
+	{
+		close(uart->master);
+		return ESP_FAIL;
+	}
+
+	uart->slave = open(uart->pty, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if( uart->slave < 0 )
+	{
+		close(uart->master);
+		return ESP_FAIL;
+	}
+
+	struct termios tio;
+	tcgetattr(uart->slave, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(uart->slave, TCSANOW, &tio);
+
+	if( pipe2(uart->wake, O_NONBLOCK | O_CLOEXEC) )
+	{
+		close(uart->slave);
+		close(uart->master);
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer_size, int tx_buffer_size, int queue_size, QueueHandle_t * queue, int intr_alloc_flags)
+{
+	(void)intr_alloc_flags;
+
+	if( port < 0 || port >= UART_NUM_MAX ) return ESP_ERR_INVALID_ARG;
+	if( rx_buffer_size <= UART_FIFO_LEN || (tx_buffer_size && tx_buffer_size <= UART_FIFO_LEN) ) return ESP_ERR_INVALID_ARG;
+	if( uarts[port].installed ) return ESP_FAIL;
+
+	host_uart * uart = &uarts[port];
+	memset(uart, 0, sizeof(host_uart));
+
+	uart->ring = (uint8_t *)malloc(rx_buffer_size);
+	if( uart->ring == NULL ) return ESP_ERR_NO_MEM;
+	uart->ring_size = rx_buffer_size;
+	uart->rx_full_threshold = 120;
+
+	if( queue != NULL && queue_size > 0 )
+	{
+		uart->events = xQueueCreate(queue_size, sizeof(uart_event_t));
+		if( uart->events == NULL )
+		{
+			free(uart->ring);
+			return ESP_ERR_NO_MEM;
+		}
+		*queue = uart->events;
+	}
+
+	if( pty_open(uart) != ESP_OK )
+	{
+		if( uart->events != NULL ) vQueueDelete(uart->events);
+		free(uart->ring);
+		return ESP_FAIL;
+	}
+
+	uart->drain = getenv("HOST_UART_EXTERNAL") == NULL;
+	if( !uart->drain ) fprintf(stderr, "host: UART%d is %s\n", port, uart->pty);
+
+	pthread_mutex_init(&(uart->lock), NULL);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&(uart->readable), &attr);
+	pthread_condattr_destroy(&attr);
+
+	uart->running = 1;
+	if( pthread_create(&(uart->thread), NULL, uart_thread, uart) )
+	{
+		close(uart->wake[0]);
+		close(uart->wake[1]);
+		close(uart->slave);
+		close(uart->master);
+		if( uart->events != NULL ) vQueueDelete(uart->events);
+		free(uart->ring);
+		return ESP_FAIL;
+	}
+
+	uart->installed = 1;
+	return ESP_OK;
+}
+
+esp_err_t uart_driver_delete(uart_port_t port)
+{
+	host_uart * uart = uart_get(port);
+	if( uart == NULL ) return ESP_OK;
+
+	uart->running = 0;
+	uart_wake(uart);
+	pthread_join(uart->thread, NULL);
+
+	close(uart->wake[0]);
+	close(uart->wake[1]);
+	close(uart->slave);
+	close(uart->master);
+
+	if( uart->events != NULL ) vQueueDelete(uart->events);
+	free(uart->ring);
+	free(uart->pattern_pos);
+	pthread_cond_destroy(&(uart->readable));
+	pthread_mutex_destroy(&(uart->lock));
+
+	memset(uart, 0, sizeof(host_uart));
+	return ESP_OK;
+}
+
+bool uart_is_driver_installed(uart_port_t port)
+{
+	return uart_get(port) != NULL;
+}
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t * config)
+{
+	if( port < 0 || port >= UART_NUM_MAX || config == NULL || config->baud_rate <= 0 ) return ESP_ERR_INVALID_ARG;
+	return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts)
+{
+	(void)tx;
+	(void)rx;
+	(void)rts;
+	(void)cts;
+	return port < 0 || port >= UART_NUM_MAX ? ESP_ERR_INVALID_ARG : ESP_OK;
+}
+
+esp_err_t uart_set_baudrate(uart_port_t port, uint32_t baud)
+{
+	return port < 0 || port >= UART_NUM_MAX || !baud ? ESP_ERR_INVALID_ARG : ESP_OK;
+}
+
+int uart_write_bytes(uart_port_t port, const void * src, size_t size)
+{
+	host_uart * uart = uart_get(port);
+	if( uart == NULL || (src == NULL && size) ) return -1;
+
+	size_t written = 0;
+	while( written < size )
+	{
+		ssize_t n = write(uart->master, (const uint8_t *)src + written, size - written);
+		if( n < 0 && errno == EINTR ) continue;
+		if( n < 0 ) return -1;
+		written += (size_t)n;
+	}
+	return (int)written;
+}
+
+esp_err_t uart_wait_tx_done(uart_port_t port, TickType_t wait)
+{
+	(void)wait;
+	return uart_get(port) == NULL ? ESP_FAIL : ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t port, void * buf, uint32_t length, TickType_t wait)
+{
+	host_uart * uart = uart_get(port);
+	if( uart == NULL || (buf == NULL && length) ) return -1;
+
+	struct timespec deadline;
+	vPortTicksToDeadline(wait, &deadline);
+
+	uint32_t got = 0;
+	pthread_mutex_lock(&(uart->lock));
+	while( 1 )
+	{
+		while( got < length && uart->ring_count )
+		{
+			size_t run = uart->ring_size - uart->ring_head;
+			if( run > uart->ring_count ) run = uart->ring_count;
+			if( run > length - got ) run = length - got;
+
+			memcpy((uint8_t *)buf + got, uart->ring + uart->ring_head, run);
+			uart->ring_head = (uart->ring_head + run) % uart->ring_size;
+			uart->ring_count -= run;
+			uart->consumed += run;
+			got += run;
+		}
+
+		if( got == length || wait == 0 ) break;
+		if( wait == portMAX_DELAY ) pthread_cond_wait(&(uart->readable), &(uart->lock));
+		else if( pthread_cond_timedwait(&(uart->readable), &(uart->lock), &deadline) == ETIMEDOUT && !uart->ring_count ) break;
+	}
+
+	if( got && uart->buffer_full )
+	{
+		uart->buffer_full = 0;
+		uart_wake(uart);
+	}
+	pthread_mutex_unlock(&(uart->lock));
+
+	return (int)got;
+}
+
+esp_err_t uart_flush_input(uart_port_t port)
+{
+	host_uart * uart = uart_get(port);
+	if( uart == NULL ) return ESP_FAIL;
+
+	pthread_mutex_lock(&(uart->lock));
+	uart->consumed += uart->ring_count;
+	uart->ring_head = 0;
+	uart->ring_count = 0;
+	uart->pending_length = 0;
+	uart->buffer_full = 0;
+	pattern_clear(uart);
+	pthread_mutex_unlock(&(uart->lock));
+
+	uart_wake(uart);
+	return ESP_OK;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t * size)
+{
+	host_uart * uart = uart_get(port);
+	if( uart == NULL || size == NULL ) return ESP_FAIL;
+
+	pthread_mutex_lock(&(uart->lock));
+	*size = uart->ring_count;
+	pthread_mutex_unlock(&(uart->lock));
+	return ESP_OK;
+}
+
+esp_err_t uart_set_rx_full_threshold(uart_port_t port, int threshold)
+{
+	host_uart * uart = uart_get(port);
+	if( uart == NULL || threshold <= 0 || threshold > UART_FIFO_LEN ) return ESP_ERR_INVALID_ARG;
+
+	pthread_mutex_lock(&(uart->lock));
+	uart->rx_full_threshold = threshold;
+	pthread_mutex_unlock(&(uart->lock));
+	return ESP_OK;
+}
+
+esp_err_t uart_enable_pattern_det_baud_intr(uart_port_t port, char pattern, uint8_t count, int chr_tout, int post_idle, int pre_idle)
+{
+	(void)chr_tout;
+	(void)post_idle;
+	(void)pre_idle;
+
+	host_uart * uart = uart_get(port);
+	if( uart == NULL || !count ) return ESP_ERR_INVALID_ARG;
+
+	pthread_mutex_lock(&(uart->lock));
+	uart->pattern = pattern;
+	uart->pattern_length = count;
+	uart->pattern_run = 0;
+	uart->pattern_enabled = 1;
+	pthread_mutex_unlock(&(uart->lock));
+	return ESP_OK;
+}
+
+esp_err_t uart_disable_pattern_det_intr(uart_port_t port)
+{
+	host_uart * uart = uart_get(port);
+	if( uart == NULL ) return ESP_ERR_INVALID_ARG;
+
+	pthread_mutex_lock(&(uart->lock));
+	uart->pattern_enabled = 0;
+	uart->pattern_run = 0;
+	pthread_mutex_unlock(&(uart->lock));
+	return ESP_OK;
+}
+
+esp_err_t uart_pattern_queue_reset(uart_port_t port, int queue_length)
+{
+	host_uart * uart = uart_get(port);
+	if( uart == NULL || queue_length <= 0 ) return ESP_ERR_INVALID_ARG;
+
+	uint64_t * positions = (uint64_t *)malloc(sizeof(uint64_t) * queue_length);
+	if( positions == NULL ) return ESP_ERR_NO_MEM;
+
+	pthread_mutex_lock(&(uart->lock));
+	free(uart->pattern_pos);
+	uart->pattern_pos = positions;
+	uart->pattern_queue_size = queue_length;
+	pattern_clear(uart);
+	pthread_mutex_unlock(&(uart->lock));
+	return ESP_OK;
+}
+
+/*
+ * @brief: This function returns the position of the oldest detected pattern relative to the next byte to read, the
+ * uart lock is held. Positions of bytes that were already read or flushed are dropped.
+ */
+static int pattern_head(host_uart * uart, uint8_t pop)
+{
+	while( uart->pattern_queue_count )
+	{
+		uint64_t position = uart->pattern_pos[uart->pattern_queue_head];
+		if( position >= uart->consumed )
+		{
+			if( pop )
+			{
+				uart->pattern_queue_head = (uart->pattern_queue_head + 1) % uart->pattern_queue_size;
+				uart->pattern_queue_count--;
+			}
+			return (int)(position - uart->consumed);
+		}
+		uart->pattern_queue_head = (uart->pattern_queue_head + 1) % uart->pattern_queue_size;
+		uart->pattern_queue_count--;
+	}
+	return -1;
+}
+
+int uart_pattern_pop_pos(uart_port_t port)
+{
+	host_uart * uart = uart_get(port);
+	if( uart == NULL ) return -1;
+
+	pthread_mutex_lock(&(uart->lock));
+	int position = pattern_head(uart, 1);
+	pthread_mutex_unlock(&(uart->lock));
+	return position;
+}
+
+int uart_pattern_get_pos(uart_port_t port)
+{
+	host_uart * uart = uart_get(port);
+	if( uart == NULL ) return -1;
+
+	pthread_mutex_lock(&(uart->lock));
+	int position = pattern_head(uart, 0);
+	pthread_mutex_unlock(&(uart->lock));
+	return position;
+}
+
+const char * host_uart_pty_name(uart_port_t port)
+{
+	host_uart * uart = uart_get(port);
+	return uart == NULL ? NULL : uart->pty;
+}
+
+int host_uart_attach(uart_port_t port)
+{
+	host_uart * uart = uart_get(port);
+	if( uart == NULL ) return -1;
+
+	pthread_mutex_lock(&(uart->lock));
+	uart->drain = 0;
+	pthread_mutex_unlock(&(uart->lock));
+	uart_wake(uart);
+
+	// the descriptor was opened non blocking for the drain, the caller gets the usual blocking behaviour
+	fcntl(uart->slave, F_SETFL, fcntl(uart->slave, F_GETFL) & ~O_NONBLOCK);
+	return uart->slave;
+}
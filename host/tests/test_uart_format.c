@@ -0,0 +1,180 @@
+/*
+ * @file: test_uart_format.c
+ *
+ * @brief: Host test of uartFormatUnsigned(), uartFormatSigned() and uartFormatHex() against snprintf(). Every value
+ * is formatted with every width from 0 to TEST_MAX_WIDTH and with '0', ' ' and another padding character: the digit
+ * boundaries (0, 9/10, 99/100 and every power of 10 up to UINT64_MAX), the limits of every integer width including
+ * INT64_MIN, then TEST_RANDOM_VALUES values of random magnitude from a fixed seed.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "util_uart.h"
+
+#define TEST_MAX_WIDTH (UART_MAX_INTEGER_DIGITS + 4)
+#define TEST_BUFFER_SIZE (TEST_MAX_WIDTH + UART_MAX_INTEGER_DIGITS + 2)
+#define TEST_RANDOM_VALUES 20000
+#define TEST_RANDOM_SEED 0X9E3779B97F4A7C15ULL
+#define TEST_MAX_REPORTED 20
+
+static const char test_pads[] = { '0', ' ', '*' };
+
+static uint32_t checks = 0;
+static uint32_t failures = 0;
+
+/*
+ * @brief: This function compares one formatted number with the expected text.
+ *
+ * @param:
+ * 1. const char * what : the function and arguments, for the report.
+ * 2. const char * got : the formatted text.
+ * 3. uint8_t len : the length the formatter returned.
+ * 4. const char * expected : the text of snprintf.
+ *
+ * @return: nothing
+ */
+static void test_check(const char * what, const char * got, uint8_t len, const char * expected)
+{
+	checks++;
+	if( len == strlen(expected) && strcmp(got, expected) == 0 ) return;
+
+	if( failures++ < TEST_MAX_REPORTED ) printf("FAIL %s: \"%s\" (%u), expected \"%s\"\n", what, got, len, expected);
+}
+
+/*
+ * @brief: This function replaces the leading spaces of a number padded by snprintf with another padding character.
+ *
+ * @param:
+ * 1. char * text : the number.
+ * 2. char pad : the padding character.
+ *
+ * @return: nothing
+ */
+static void test_repad(char * text, char pad)
+{
+	for( ; *text == ' '; text++ ) *text = pad;
+}
+
+/*
+ * @brief: This function checks the unsigned decimal and hex formats of a value with every width and padding.
+ *
+ * @param:
+ * 1. uint64_t value : the value.
+ *
+ * @return: nothing
+ */
+static void test_unsigned(uint64_t value)
+{
+	char got[TEST_BUFFER_SIZE], expected[TEST_BUFFER_SIZE], what[80];
+
+	for( uint8_t width=0; width<=TEST_MAX_WIDTH; width++ )
+	{
+		for( size_t i=0; i<sizeof(test_pads); i++ )
+		{
+			char pad = test_pads[i];
+			snprintf(expected, sizeof(expected), pad == '0' ? "%0*" PRIu64 : "%*" PRIu64, width, value);
+			test_repad(expected, pad);
+			snprintf(what, sizeof(what), "uartFormatUnsigned(%" PRIu64 ", %u, '%c')", value, width, pad);
+			test_check(what, got, uartFormatUnsigned(got, value, width, pad), expected);
+		}
+
+		snprintf(expected, sizeof(expected), "%0*" PRIX64, width, value);
+		snprintf(what, sizeof(what), "uartFormatHex(%" PRIX64 ", %u)", value, width);
+		test_check(what, got, uartFormatHex(got, value, width), expected);
+	}
+}
+
+/*
+ * @brief: This function checks the signed decimal format of a value with every width and padding.
+ *
+ * @param:
+ * 1. int64_t value : the value.
+ *
+ * @return: nothing
+ */
+static void test_signed(int64_t value)
+{
+	char got[TEST_BUFFER_SIZE], expected[TEST_BUFFER_SIZE], what[80];
+
+	for( uint8_t width=0; width<=TEST_MAX_WIDTH; width++ )
+	{
+		for( size_t i=0; i<sizeof(test_pads); i++ )
+		{
+			char pad = test_pads[i];
+			snprintf(expected, sizeof(expected), pad == '0' ? "%0*" PRId64 : "%*" PRId64, width, value);
+			test_repad(expected, pad);
+			snprintf(what, sizeof(what), "uartFormatSigned(%" PRId64 ", %u, '%c')", value, width, pad);
+			test_check(what, got, uartFormatSigned(got, value, width, pad), expected);
+		}
+	}
+}
+
+/*
+ * @brief: This function checks a value and its negation, unsigned and signed.
+ *
+ * @param:
+ * 1. uint64_t value : the value.
+ *
+ * @return: nothing
+ */
+static void test_value(uint64_t value)
+{
+	test_unsigned(value);
+	test_signed((int64_t)value);
+	test_signed((int64_t)(0 - value));
+}
+
+/*
+ * @brief: This function returns the next number of a xorshift64 sequence.
+ *
+ * @param:
+ * 1. uint64_t * state : the generator state, not 0.
+ *
+ * @return: uint64_t
+ * the number
+ */
+static uint64_t test_random(uint64_t * state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
+
+int main(void)
+{
+	uint64_t power = 1;
+
+	// every number of digits, and the numbers just below and above it
+	test_value(0);
+	for( uint8_t digits=1; digits<UART_MAX_INTEGER_DIGITS; digits++ )
+	{
+		power *= 10;
+		test_value(power - 1);
+		test_value(power);
+		test_value(power + 1);
+	}
+	test_value(UINT64_MAX);
+
+	// limits of the narrower types, which callers pass widened
+	const uint64_t limits[] = { INT8_MAX, UINT8_MAX, INT16_MAX, UINT16_MAX, INT32_MAX, UINT32_MAX, INT64_MAX,
+			(uint64_t)INT64_MIN, 0XF, 0X10, 0XFFFFFFFFFFFFFFF, 0X1000000000000000 };
+	for( size_t i=0; i<sizeof(limits)/sizeof(limits[0]); i++ )
+	{
+		test_value(limits[i]);
+		test_value(limits[i] + 1);
+	}
+	test_signed(INT64_MIN);
+	test_signed(INT64_MAX);
+
+	uint64_t state = TEST_RANDOM_SEED;
+	for( uint32_t i=0; i<TEST_RANDOM_VALUES; i++ )
+	{
+		// a random magnitude, uniform values would nearly all have 19 or 20 digits
+		uint64_t value = test_random(&state);
+		test_value(value >> (value % 64));
+	}
+
+	printf("%u checks, %u failures\n", (unsigned)checks, (unsigned)failures);
+	return failures ? 1 : 0;
+}
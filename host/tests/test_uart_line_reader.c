@@ -0,0 +1,231 @@
+/*
+ * @file: test_uart_line_reader.c
+ *
+ * @brief: Host test of the util_uart line reader on the pty of UART1. The far end of the port is written in pieces
+ * to check that lines split across reads are put back together, that only the delimiter ends a line (a CR before
+ * the LF is kept in the line, a lone CR does not end it), that a line longer than the line buffer is cut, counted
+ * as truncated and does not corrupt the next line, and that the reader stops cleanly, stays stopped, and can be
+ * started again, queueing lines or with a callback.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "util_uart.h"
+#include "host_shims.h"
+
+#define TEST_PORT UART_NUM_1
+#define TEST_BAUD 115200
+#define TEST_WAIT pdMS_TO_TICKS(1000)
+#define TEST_GAP_MS 20
+#define TEST_LONG_LINE 450
+
+static util_uart_t * uart = NULL;
+static int far_end = -1;
+static uint32_t failures = 0;
+
+static char callback_text[UART_LINE_MAX_LENGTH];
+static volatile uint32_t callback_lines = 0;
+
+#define TEST_CHECK(cond, ...) do { if( !(cond) ) { failures++; printf("FAIL line %d: ", __LINE__); printf(__VA_ARGS__); printf("\n"); } } while( 0 )
+
+/*
+ * @brief: This function writes text to the far end of the port, as one read of the pty.
+ *
+ * @param:
+ * 1. const char * text : the bytes.
+ *
+ * @return: nothing
+ */
+static void test_send(const char * text)
+{
+	size_t len = strlen(text);
+	if( write(far_end, text, len) != (ssize_t)len ) printf("write to the pty failed\n");
+}
+
+/*
+ * @brief: This function writes text to the far end of the port in pieces, pausing between them so that every piece
+ * is a separate read of the pty and a separate UART_DATA event.
+ *
+ * @param:
+ * 1. const char * pieces[] : the pieces, NULL terminated.
+ *
+ * @return: nothing
+ */
+static void test_send_pieces(const char * pieces[])
+{
+	for( size_t i=0; pieces[i] != NULL; i++ )
+	{
+		test_send(pieces[i]);
+		vTaskDelay(pdMS_TO_TICKS(TEST_GAP_MS));
+	}
+}
+
+/*
+ * @brief: This function checks that the next queued line is the expected one.
+ *
+ * @param:
+ * 1. const char * expected : the text of the line, without the delimiter.
+ * 2. int at : the line of the test, for the report.
+ *
+ * @return: nothing
+ */
+static void test_expect_line(const char * expected, int at)
+{
+	uart_line line;
+
+	if( !uartReadLine(uart, &line, TEST_WAIT) )
+	{
+		failures++;
+		printf("FAIL line %d: no line, expected \"%s\"\n", at, expected);
+		return;
+	}
+	if( line.len != strlen(expected) || strcmp(line.text, expected) != 0 )
+	{
+		failures++;
+		printf("FAIL line %d: \"%s\" (%u), expected \"%s\"\n", at, line.text, line.len, expected);
+	}
+}
+
+/*
+ * @brief: This function is the line callback of the callback reader.
+ *
+ * @param:
+ * 1. uart_port_t port : the port.
+ * 2. char * text : the line.
+ * 3. uint16_t len : its length.
+ *
+ * @return: nothing
+ */
+static void test_line_callback(uart_port_t port, char * text, uint16_t len)
+{
+	memcpy(callback_text, text, len + 1);
+	callback_lines++;
+}
+
+static void test_split_lines(void)
+{
+	const char * pieces[] = { "hel", "lo\nwor", "ld", "\n", "", "a\nb\nc", "\n", NULL };
+
+	test_send_pieces(pieces);
+	test_expect_line("hello", __LINE__);
+	test_expect_line("world", __LINE__);
+	test_expect_line("a", __LINE__);
+	test_expect_line("b", __LINE__);
+	test_expect_line("c", __LINE__);
+}
+
+static void test_line_endings(void)
+{
+	const char * pieces[] = { "crlf\r", "\n", "lone\rcr\n", "\n", "last\r\n", NULL };
+
+	test_send_pieces(pieces);
+	test_expect_line("crlf\r", __LINE__);
+	test_expect_line("lone\rcr", __LINE__);
+	test_expect_line("", __LINE__);
+	test_expect_line("last\r", __LINE__);
+}
+
+static void test_burst(void)
+{
+	char expected[16];
+
+	// as many lines as the queue holds, in one write
+	test_send("line 0\nline 1\nline 2\nline 3\nline 4\nline 5\nline 6\nline 7\n");
+	for( int i=0; i<UART_LINE_QUEUE_SIZE; i++ )
+	{
+		snprintf(expected, sizeof(expected), "line %d", i);
+		test_expect_line(expected, __LINE__);
+	}
+}
+
+static void test_long_line(void)
+{
+	char text[TEST_LONG_LINE + 2];
+	uart_port_stats before, after;
+	uart_line line;
+	uint32_t received = 0;
+
+	uartGetStats(uart, &before);
+
+	memset(text, 'x', TEST_LONG_LINE);
+	strcpy(text + TEST_LONG_LINE, "\n");
+	test_send(text);
+	vTaskDelay(pdMS_TO_TICKS(TEST_GAP_MS));
+	test_send("after\n");
+
+	// the long line arrives cut in one or more pieces of 'x', depending on how the pty delivered it
+	while( uartReadLine(uart, &line, TEST_WAIT) && strcmp(line.text, "after") != 0 )
+	{
+		TEST_CHECK(line.len > 0 && line.len < uart->config.line_size, "piece of %u bytes", line.len);
+		TEST_CHECK(strspn(line.text, "x") == line.len, "piece \"%s\" is not part of the long line", line.text);
+		received += line.len;
+	}
+	TEST_CHECK(strcmp(line.text, "after") == 0, "the line after the long one is \"%s\"", line.text);
+	TEST_CHECK(received > 0 && received <= TEST_LONG_LINE, "%u bytes of the long line", (unsigned)received);
+
+	uartGetStats(uart, &after);
+	TEST_CHECK(after.truncated_lines > before.truncated_lines, "the long line is not counted as truncated");
+}
+
+static void test_stop_start(void)
+{
+	uart_line line;
+
+	uartStopLineReader(uart);
+	TEST_CHECK(uart->reader.task == NULL, "the reader task is still running");
+
+	// a stopped reader leaves the bytes in the driver
+	test_send("while stopped\n");
+	vTaskDelay(pdMS_TO_TICKS(TEST_GAP_MS));
+	TEST_CHECK(!uartReadLine(uart, &line, pdMS_TO_TICKS(200)), "line \"%s\" read while stopped", line.text);
+
+	// stopping twice is harmless
+	uartStopLineReader(uart);
+
+	uart_flush_input(TEST_PORT);
+	TEST_CHECK(uartStartLineReader(uart, '\n', NULL) == ESP_OK, "restart failed");
+	TEST_CHECK(uartStartLineReader(uart, '\n', NULL) == ESP_ERR_INVALID_STATE, "second reader started");
+	test_send("restarted\n");
+	test_expect_line("restarted", __LINE__);
+	uartStopLineReader(uart);
+
+	TEST_CHECK(uartStartLineReader(uart, ';', test_line_callback) == ESP_OK, "callback reader failed");
+	test_send("first;sec");
+	vTaskDelay(pdMS_TO_TICKS(TEST_GAP_MS));
+	test_send("ond;");
+	for( uint32_t waited=0; callback_lines < 2 && waited < 1000; waited += 10 ) vTaskDelay(pdMS_TO_TICKS(10));
+	TEST_CHECK(callback_lines == 2, "%u callback lines", (unsigned)callback_lines);
+	TEST_CHECK(strcmp(callback_text, "second") == 0, "callback line \"%s\"", callback_text);
+	uartStopLineReader(uart);
+	TEST_CHECK(uart->reader.task == NULL, "the callback reader task is still running");
+}
+
+int main(void)
+{
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	uart = uartBegin(&(util_uart_config)UTIL_UART_DEFAULT_CONFIG(TEST_PORT, TEST_BAUD));
+	if( uart == NULL )
+	{
+		printf("FAIL: uartBegin\n");
+		return 1;
+	}
+	far_end = host_uart_attach(TEST_PORT);
+
+	if( uartStartLineReader(uart, '\n', NULL) != ESP_OK )
+	{
+		printf("FAIL: uartStartLineReader\n");
+		return 1;
+	}
+
+	test_split_lines();
+	test_line_endings();
+	test_burst();
+	test_long_line();
+	test_stop_start();
+
+	uartEnd(uart);
+
+	printf("%u failures\n", (unsigned)failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,545 @@
+/*
+ * @file: bench.c
+ *
+ * @brief: Micro-benchmarks of the hot paths of the components. Every benchmark prints one JSON record on its own line,
+ * for example :
+ * {"bench":"md5","size":256,"ops":131072,"runs":5,"us_per_op":1.444,"cycles_per_op":2887,"ops_per_sec":692737,
+ * "heap_hwm_bytes":18,"heap_delta_bytes":0,"nvs_commits_per_op":0.00,"errors":0,
+ * "target":"linux","cpu_mhz":2000}
+ *
+ * Each benchmark is warmed up, the number of operations per run is doubled until a run takes BENCH_MIN_RUN_US, then
+ * BENCH_RUNS runs are timed with esp_timer and the fastest one is reported. cycles_per_op is the time per operation
+ * at the CPU clock. heap_hwm_bytes is the heap high-water mark since boot (total heap minus the minimum free heap)
+ * and heap_delta_bytes is the heap a benchmark did not give back. nvs_commits_per_op counts the nvs_commit() calls
+ * per operation. errors counts the operations that failed, a record with errors does not time the operation it names.
+ *
+ * nvs_boot_read reads one of 'size' keys per operation and re-initializes the storage before the first one, as a boot
+ * sequence does, so its ops_per_sec is the keys/sec of a boot including nvs_flash_init() and the namespace open.
+ * nvs_save_fields and nvs_save_fields_txn save a configuration of 'size' integers, with one NVSStoreInteger32() per
+ * field and with one transaction.
+ *
+ * Built with CONFIG_NVS_ENCRYPTION, the NVS benchmarks run a second time on an encrypted storage and their records
+ * are named with an "_encrypted" suffix, to be compared with the plaintext ones. This needs flash encryption and an
+ * 'nvs_keys' partition, which the project partition table does not have, and the NVS partition is erased before and
+ * after. The host NVS shim has no encryption, host records are plaintext only.
+ *
+ * The UART bulk receive benchmark streams BENCH_BULK_BYTES through UART1 and prints one record per buffer size with
+ * the throughput and the counters of uartBulkGetStats(), errors being the breaks in the received byte sequence :
+ * {"bench":"uart_bulk_rx","size":1024,"consumer_us":0,"bytes":65536,"buffers":64,"bytes_per_sec":91022,"stalls":0,
+ * "ring_overflows":0,"fifo_overflows":0,"dropped_bytes":0,"errors":0,"target":"esp32","cpu_mhz":240}
+ * On the target the port is looped back internally at BENCH_BULK_BAUD. On the host the bytes are written to the pty
+ * of the port, which is not paced to a baud rate, so the record measures the receive path alone.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp32/clk.h"
+#ifdef CONFIG_IDF_TARGET_LINUX
+#include <unistd.h>
+#include "host_shims.h"
+#endif
+#include "util_uart.h"
+#include "util_nvs.h"
+#include "file_manager.h"
+#include "cryptography.h"
+#include "vispr.h"
+
+#define BENCH_WARMUP_OPS 3
+#define BENCH_RUNS 5
+#define BENCH_MIN_RUN_US 100000
+#define BENCH_MAX_OPS (1u << 20)
+
+/*
+ * @brief : Operations per run of the benchmarks that write flash, which wears it.
+ */
+#define BENCH_FLASH_MAX_OPS 64
+
+#define BENCH_MAX_SIZE 4096
+
+#define BENCH_KEY "0123456789abcdef"
+#define BENCH_NAMESPACE "bench"
+#define BENCH_MOUNT "/spiffs"
+#define BENCH_FILE BENCH_MOUNT "/bench.txt"
+
+#define BENCH_BOOT_NAMESPACE "bench_boot"
+#define BENCH_BOOT_KEYS 40
+#define BENCH_CONFIG_NAMESPACE "bench_cfg"
+#define BENCH_CONFIG_FIELDS 20
+#define BENCH_ENCRYPTED_SUFFIX "_encrypted"
+
+#define BENCH_BULK_PORT UART_NUM_1
+#define BENCH_BULK_BAUD 921600
+#define BENCH_BULK_BYTES 65536
+#define BENCH_BULK_CHUNK 256
+#define BENCH_BULK_RX_RING 4096
+#define BENCH_BULK_IDLE_MS 5
+#define BENCH_BULK_TIMEOUT_MS 2000
+#define BENCH_BULK_SENDER_STACK_SIZE 3072
+
+/*
+ * @brief : The received bytes repeat 0..BENCH_BULK_PERIOD-1, a prime period so that no buffer size aligns with it.
+ */
+#define BENCH_BULK_PERIOD 251
+
+/*
+ * @brief : One operation of a benchmark, 'size' is the payload size of the benchmark. Returns 0 if the operation
+ * failed, the record counts the failures so that a fast error path is not taken for a fast operation.
+ */
+typedef uint8_t (*bench_op)(uint32_t size);
+
+typedef struct bench_case { const char * name; uint32_t size; bench_op op; uint32_t max_ops; }bench_case;
+
+/*
+ * @brief : One bulk receive run, 'consumer_us' is the processing time the application spends on every buffer, a slow
+ * consumer shows up as stalls and, once the driver ring is full, as overflows.
+ */
+typedef struct bench_bulk_case { uint32_t buffer_size; uint32_t consumer_us; }bench_bulk_case;
+
+static char input[BENCH_MAX_SIZE + 16];
+static char output[BENCH_MAX_SIZE + 16];
+static uint32_t sequence = 0;
+
+/*
+ * @brief : Results are written here, the compiler cannot drop an operation whose result ends up in it.
+ */
+static volatile uint32_t sink = 0;
+
+static char boot_keys[BENCH_BOOT_KEYS][NVS_KEY_NAME_MAX_SIZE];
+static uint32_t boot_reads = 0;
+
+static util_uart_t * bulk_uart = NULL;
+static volatile uint8_t bulk_sent = 0;
+
+static uint32_t errors = 0;
+static uint32_t timed_ops = 0;
+
+/*
+ * @brief : Appended to the name of the benchmarks run on the encrypted NVS storage.
+ */
+static const char * bench_suffix = "";
+
+static uint8_t bench_vispr_frame(uint32_t size)
+{
+	int len = visprBuildFrame((unsigned char *)input, size, output, sizeof(output));
+	sink += len;
+	return len > 0;
+}
+
+static uint8_t bench_aes_encrypt(uint32_t size)
+{
+	uint32_t len = sizeof(output);
+	return encryptAES_ECB(BENCH_KEY, input, size, output, &len);
+}
+
+static uint8_t bench_aes_decrypt(uint32_t size)
+{
+	return decryptAES_ECB(BENCH_KEY, input, size, output, sizeof(output));
+}
+
+static uint8_t bench_md5(uint32_t size)
+{
+	input[size] = '\0';
+	uint8_t ok = hashMD5((const unsigned char *)input, (unsigned char *)output);
+	input[size] = 'a';
+	return ok;
+}
+
+static uint8_t bench_file_write(uint32_t size)
+{
+	input[size] = '\0';
+	esp_err_t _err = write_to_file(BENCH_FILE, input);
+	input[size] = 'a';
+	return _err == ESP_OK;
+}
+
+static uint8_t bench_file_read(uint32_t size)
+{
+	(void)size;
+	char * text = read_file(BENCH_FILE);
+	if( text == NULL ) return 0;
+	sink += text[0];
+	free(text);
+	return 1;
+}
+
+static uint8_t bench_nvs_store_i32(uint32_t size)
+{
+	(void)size;
+	return NVSStoreInteger32(BENCH_NAMESPACE, "i32", (int32_t)(sequence++)) == ESP_OK;
+}
+
+static uint8_t bench_nvs_read_i32(uint32_t size)
+{
+	(void)size;
+	int32_t value = 0;
+	esp_err_t _err = NVSReadInteger32(BENCH_NAMESPACE, "i32", &value);
+	sink += value;
+	return _err == ESP_OK;
+}
+
+static uint8_t bench_nvs_store_string(uint32_t size)
+{
+	// the first character changes, NVS skips writes of an unchanged value
+	input[0] = 'a' + (sequence++ % 26);
+	input[size] = '\0';
+	esp_err_t _err = NVSStoreString(BENCH_NAMESPACE, "str", input);
+	input[size] = 'a';
+	input[0] = 'a';
+	return _err == ESP_OK;
+}
+
+static uint8_t bench_nvs_read_string(uint32_t size)
+{
+	size_t len = size + 1;
+	return NVSReadString(BENCH_NAMESPACE, "str", output, &len) == ESP_OK;
+}
+
+static uint8_t bench_nvs_store_blob(uint32_t size)
+{
+	input[0] = (char)(sequence++);
+	esp_err_t _err = NVSStoreBlob(BENCH_NAMESPACE, "blob", input, size);
+	input[0] = 'a';
+	return _err == ESP_OK;
+}
+
+static uint8_t bench_nvs_read_blob(uint32_t size)
+{
+	size_t len = size;
+	return NVSReadBlob(BENCH_NAMESPACE, "blob", output, &len) == ESP_OK;
+}
+
+static uint8_t bench_nvs_boot_read(uint32_t size)
+{
+	uint32_t index = boot_reads++ % size;
+	int32_t value = 0;
+
+	if( index == 0 )
+	{
+		uint8_t encrypted = NVSIsEncrypted();
+		DeinitializeNVS();
+		if( encrypted ) InitializeSecureNVS(NULL);
+		else InitializeNVS();
+	}
+	esp_err_t _err = NVSReadInteger32(BENCH_BOOT_NAMESPACE, boot_keys[index], &value);
+	sink += value;
+	return _err == ESP_OK;
+}
+
+static uint8_t bench_nvs_save_fields(uint32_t size)
+{
+	int32_t value = (int32_t)(sequence++);
+
+	for( uint32_t i=0; i<size; i++ ) if( NVSStoreInteger32(BENCH_CONFIG_NAMESPACE, boot_keys[i], value) != ESP_OK ) return 0;
+	return 1;
+}
+
+static uint8_t bench_nvs_save_fields_txn(uint32_t size)
+{
+	static nvs_transaction txn;
+	int32_t value = (int32_t)(sequence++);
+
+	if( NVSTransactionBegin(&txn, BENCH_CONFIG_NAMESPACE) != ESP_OK ) return 0;
+	for( uint32_t i=0; i<size; i++ )
+	{
+		if( NVSTransactionSetInteger32(&txn, boot_keys[i], value) != ESP_OK )
+		{
+			NVSTransactionAbort(&txn);
+			return 0;
+		}
+	}
+	return NVSTransactionCommit(&txn) == ESP_OK;
+}
+
+static uint8_t bench_format_unsigned(uint32_t size)
+{
+	(void)size;
+	sink += uartFormatUnsigned(output, 18446744073709551615ULL - (sequence++), 0, ' ');
+	return 1;
+}
+
+static uint8_t bench_format_signed(uint32_t size)
+{
+	(void)size;
+	sink += uartFormatSigned(output, -1234567890123LL - (sequence++), 16, '0');
+	return 1;
+}
+
+static uint8_t bench_format_hex(uint32_t size)
+{
+	(void)size;
+	sink += uartFormatHex(output, 0xDEADBEEFCAFEULL + (sequence++), 16);
+	return 1;
+}
+
+static const bench_case cases[] = {
+		{ "vispr_frame", 16, bench_vispr_frame, 0 },
+		{ "vispr_frame", 64, bench_vispr_frame, 0 },
+		{ "vispr_frame", 255, bench_vispr_frame, 0 },
+		{ "aes_ecb_encrypt", 16, bench_aes_encrypt, 0 },
+		{ "aes_ecb_encrypt", 256, bench_aes_encrypt, 0 },
+		{ "aes_ecb_encrypt", 4096, bench_aes_encrypt, 0 },
+		{ "aes_ecb_decrypt", 16, bench_aes_decrypt, 0 },
+		{ "aes_ecb_decrypt", 256, bench_aes_decrypt, 0 },
+		{ "aes_ecb_decrypt", 4096, bench_aes_decrypt, 0 },
+		{ "md5", 16, bench_md5, 0 },
+		{ "md5", 256, bench_md5, 0 },
+		{ "md5", 4096, bench_md5, 0 },
+		{ "file_write", 64, bench_file_write, BENCH_FLASH_MAX_OPS },
+		{ "file_read", 64, bench_file_read, 0 },
+		{ "file_write", 4096, bench_file_write, BENCH_FLASH_MAX_OPS },
+		{ "file_read", 4096, bench_file_read, 0 },
+		{ "nvs_store_i32", 4, bench_nvs_store_i32, BENCH_FLASH_MAX_OPS },
+		{ "nvs_read_i32", 4, bench_nvs_read_i32, 0 },
+		{ "nvs_store_string", 32, bench_nvs_store_string, BENCH_FLASH_MAX_OPS },
+		{ "nvs_read_string", 32, bench_nvs_read_string, 0 },
+		{ "nvs_store_blob", 256, bench_nvs_store_blob, BENCH_FLASH_MAX_OPS },
+		{ "nvs_read_blob", 256, bench_nvs_read_blob, 0 },
+		{ "nvs_boot_read", BENCH_BOOT_KEYS, bench_nvs_boot_read, 0 },
+		{ "nvs_save_fields", BENCH_CONFIG_FIELDS, bench_nvs_save_fields, BENCH_FLASH_MAX_OPS },
+		{ "nvs_save_fields_txn", BENCH_CONFIG_FIELDS, bench_nvs_save_fields_txn, BENCH_FLASH_MAX_OPS },
+		{ "uart_format_unsigned", 8, bench_format_unsigned, 0 },
+		{ "uart_format_signed", 8, bench_format_signed, 0 },
+		{ "uart_format_hex", 8, bench_format_hex, 0 },
+};
+
+static const bench_bulk_case bulk_cases[] = {
+		{ 256, 0 },
+		{ 1024, 0 },
+		{ 4096, 0 },
+		{ 1024, 2000 },
+};
+
+/*
+ * @brief: This function times 'ops' operations of a benchmark.
+ *
+ * @param:
+ * 1. const bench_case * bench : the benchmark.
+ * 2. uint32_t ops : number of operations.
+ *
+ * @return: int64_t
+ * elapsed time in microseconds
+ */
+static int64_t bench_time(const bench_case * bench, uint32_t ops)
+{
+	int64_t start = esp_timer_get_time();
+	for( uint32_t i=0; i<ops; i++ ) if( !bench->op(bench->size) ) errors++;
+	timed_ops += ops;
+	return esp_timer_get_time() - start;
+}
+
+/*
+ * @brief: This function runs one benchmark and prints its record.
+ *
+ * @param:
+ * 1. const bench_case * bench : the benchmark.
+ *
+ * @return: nothing
+ */
+static void bench_run(const bench_case * bench)
+{
+	uint32_t max_ops = bench->max_ops ? bench->max_ops : BENCH_MAX_OPS;
+
+	// allocations made once, such as cached handles, are done by the warm up and not counted as kept
+	bench_time(bench, BENCH_WARMUP_OPS);
+
+	size_t free_before = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+	nvs_handle_cache_stats nvs_before, nvs_after;
+	NVSGetHandleCacheStats(&nvs_before);
+	errors = 0;
+	timed_ops = 0;
+
+	uint32_t ops = 1;
+	int64_t elapsed = bench_time(bench, ops);
+	while( elapsed < BENCH_MIN_RUN_US && ops < max_ops )
+	{
+		ops *= 2;
+		if( ops > max_ops ) ops = max_ops;
+		elapsed = bench_time(bench, ops);
+	}
+
+	int64_t best = elapsed;
+	for( uint8_t run=1; run<BENCH_RUNS; run++ )
+	{
+		// lets the idle task run, it feeds the task watchdog
+		vTaskDelay(1);
+
+		elapsed = bench_time(bench, ops);
+		if( elapsed < best ) best = elapsed;
+	}
+
+	size_t free_after = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+	NVSGetHandleCacheStats(&nvs_after);
+	size_t hwm = heap_caps_get_total_size(MALLOC_CAP_DEFAULT) - heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+
+	double us_per_op = (double)best / ops;
+	double cpu_mhz = esp_clk_cpu_freq() / 1000000.0;
+
+	printf("{\"bench\":\"%s%s\",\"size\":%u,\"ops\":%u,\"runs\":%u,\"us_per_op\":%.3f,\"cycles_per_op\":%.0f,"
+			"\"ops_per_sec\":%.0f,\"heap_hwm_bytes\":%u,\"heap_delta_bytes\":%d,\"nvs_commits_per_op\":%.2f,\"errors\":%u,"
+			"\"target\":\"%s\",\"cpu_mhz\":%.0f}\n",
+			bench->name, bench_suffix, (unsigned)bench->size, (unsigned)ops, BENCH_RUNS, us_per_op, us_per_op * cpu_mhz,
+			best > 0 ? 1000000.0 / us_per_op : 0.0, (unsigned)hwm, (int)(free_before - free_after),
+			(double)(nvs_after.commits - nvs_before.commits) / timed_ops, (unsigned)errors, CONFIG_IDF_TARGET, cpu_mhz);
+}
+
+/*
+ * @brief: This function stores the keys nvs_boot_read reads.
+ *
+ * @param:
+ * none
+ *
+ * @return: nothing
+ */
+static void bench_nvs_boot_setup(void)
+{
+	for( uint32_t i=0; i<BENCH_BOOT_KEYS; i++ )
+	{
+		snprintf(boot_keys[i], sizeof(boot_keys[i]), "key%02u", (unsigned)(i % 100));
+		if( NVSStoreInteger32(BENCH_BOOT_NAMESPACE, boot_keys[i], (int32_t)i) != ESP_OK ) printf("bench: storing %s failed\n", boot_keys[i]);
+	}
+}
+
+/*
+ * @brief: This function is the task that transmits the bulk receive benchmark data, in chunks of BENCH_BULK_CHUNK.
+ *
+ * @param:
+ * 1. void * arg : unused.
+ *
+ * @return: nothing
+ */
+static void bench_bulk_sender(void * arg)
+{
+	uint8_t chunk[BENCH_BULK_CHUNK];
+#ifdef CONFIG_IDF_TARGET_LINUX
+	int far_end = host_uart_attach(BENCH_BULK_PORT);
+#endif
+
+	for( uint32_t sent=0; sent<BENCH_BULK_BYTES; sent+=BENCH_BULK_CHUNK )
+	{
+		for( uint32_t i=0; i<BENCH_BULK_CHUNK; i++ ) chunk[i] = (uint8_t)((sent + i) % BENCH_BULK_PERIOD);
+#ifdef CONFIG_IDF_TARGET_LINUX
+		if( write(far_end, chunk, BENCH_BULK_CHUNK) != BENCH_BULK_CHUNK ) break;
+#else
+		uartSendBytes(bulk_uart, (const char *)chunk, BENCH_BULK_CHUNK);
+#endif
+	}
+
+	bulk_sent = 1;
+	vTaskDelete(NULL);
+}
+
+/*
+ * @brief: This function receives BENCH_BULK_BYTES in bulk mode and prints the record of the run.
+ *
+ * @param:
+ * 1. const bench_bulk_case * bench : the buffer size and consumer time.
+ *
+ * @return: nothing
+ */
+static void bench_uart_bulk(const bench_bulk_case * bench)
+{
+	util_uart_config config = UTIL_UART_DEFAULT_CONFIG(BENCH_BULK_PORT, BENCH_BULK_BAUD);
+	config.rx_ring_size = BENCH_BULK_RX_RING;
+	uart_bulk_stats stats = { 0 };
+	uart_bulk_buffer buffer;
+	uint64_t received = 0;
+	uint32_t breaks = 0;
+	uint8_t next = 0;
+
+	bulk_uart = uartBegin(&config);
+	if( bulk_uart == NULL )
+	{
+		printf("bench: UART%d failed, bulk receive not measured\n", BENCH_BULK_PORT);
+		return;
+	}
+#ifndef CONFIG_IDF_TARGET_LINUX
+	uart_set_loop_back(BENCH_BULK_PORT, true);
+#endif
+
+	bulk_sent = 0;
+	if( uartBulkBegin(bulk_uart, bench->buffer_size, pdMS_TO_TICKS(BENCH_BULK_IDLE_MS)) != ESP_OK ||
+			xTaskCreate(bench_bulk_sender, "bench_bulk_sender", BENCH_BULK_SENDER_STACK_SIZE, NULL, 5, NULL) != pdPASS )
+	{
+		printf("bench: bulk mode failed, bulk receive not measured\n");
+		uartBulkEnd(bulk_uart);
+		uartEnd(bulk_uart);
+		return;
+	}
+
+	while( received < BENCH_BULK_BYTES && uartBulkReceive(bulk_uart, &buffer, pdMS_TO_TICKS(BENCH_BULK_TIMEOUT_MS)) )
+	{
+		// a lost or corrupted byte breaks the sequence, it is counted once and the check restarts after it
+		for( size_t i=0; i<buffer.len; i++ )
+		{
+			if( buffer.data[i] != next ) breaks++;
+			next = (uint8_t)((buffer.data[i] + 1) % BENCH_BULK_PERIOD);
+		}
+		received += buffer.len;
+
+		int64_t busy = esp_timer_get_time();
+		while( esp_timer_get_time() - busy < bench->consumer_us );
+
+		uartBulkRelease(bulk_uart, &buffer);
+	}
+	uartBulkGetStats(bulk_uart, &stats);
+
+	for( uint32_t waited=0; !bulk_sent && waited<BENCH_BULK_TIMEOUT_MS; waited++ ) vTaskDelay(pdMS_TO_TICKS(1));
+	uartBulkEnd(bulk_uart);
+#ifndef CONFIG_IDF_TARGET_LINUX
+	uart_set_loop_back(BENCH_BULK_PORT, false);
+#endif
+	uartEnd(bulk_uart);
+	bulk_uart = NULL;
+
+	if( received < BENCH_BULK_BYTES ) breaks++;
+
+	printf("{\"bench\":\"uart_bulk_rx\",\"size\":%u,\"consumer_us\":%u,\"bytes\":%llu,\"buffers\":%u,\"bytes_per_sec\":%u,"
+			"\"stalls\":%u,\"ring_overflows\":%u,\"fifo_overflows\":%u,\"dropped_bytes\":%u,\"errors\":%u,\"target\":\"%s\","
+			"\"cpu_mhz\":%.0f}\n", (unsigned)bench->buffer_size, (unsigned)bench->consumer_us, (unsigned long long)received,
+			(unsigned)stats.buffers, (unsigned)stats.bytes_per_second, (unsigned)stats.stalls, (unsigned)stats.ring_overflows,
+			(unsigned)stats.fifo_overflows, (unsigned)stats.dropped_bytes, (unsigned)breaks, CONFIG_IDF_TARGET,
+			esp_clk_cpu_freq() / 1000000.0);
+}
+
+void app_main(void)
+{
+	char key[16];
+	memcpy(key, BENCH_KEY, 16);
+	memset(input, 'a', sizeof(input));
+
+	InitializeNVS();
+	bench_nvs_boot_setup();
+
+	if( mount_spiffs(BENCH_MOUNT) != ESP_OK ) printf("bench: SPIFFS mount failed, file benchmarks will fail\n");
+
+	if( visprTalkerInitialize("bench", 1, key, "bench/topic", 0) != ESP_OK ) printf("bench: vispr talker failed\n");
+
+	// the read benchmarks read what the store benchmarks wrote
+	for( size_t i=0; i<sizeof(cases)/sizeof(cases[0]); i++ ) bench_run(&cases[i]);
+
+	for( size_t i=0; i<sizeof(bulk_cases)/sizeof(bulk_cases[0]); i++ ) bench_uart_bulk(&bulk_cases[i]);
+
+#ifdef CONFIG_NVS_ENCRYPTION
+	// plaintext entries do not decrypt, the encrypted storage starts erased and is erased again for the next boot
+	DeinitializeNVS();
+	EraseNVS();
+	if( InitializeSecureNVS(NULL) == ESP_OK )
+	{
+		bench_suffix = BENCH_ENCRYPTED_SUFFIX;
+		bench_nvs_boot_setup();
+		for( size_t i=0; i<sizeof(cases)/sizeof(cases[0]); i++ ) if( strncmp(cases[i].name, "nvs_", 4) == 0 ) bench_run(&cases[i]);
+		bench_suffix = "";
+	}
+	else printf("bench: encrypted NVS failed, is there an nvs_keys partition?\n");
+	DeinitializeNVS();
+	EraseNVS();
+	InitializeNVS();
+#endif
+
+	vispTalkerDestroy();
+	NVSCloseAll();
+}
@@ -0,0 +1,10 @@
+import socket
+
+# echo server for wifi_measure_udp_rtt(), every packet is sent back unchanged
+echo = socket.socket(family=socket.AF_INET, type=socket.SOCK_DGRAM)
+
+echo.bind(("0.0.0.0", 55668))
+
+while True:
+	data, address = echo.recvfrom(1024)
+	echo.sendto(data, address)
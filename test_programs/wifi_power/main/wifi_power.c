@@ -0,0 +1,93 @@
+/*
+ * @file: wifi_power.c
+ *
+ * @brief: Round trip time and packet loss of util_wifi in each modem sleep mode. The station joins POWER_STA_SSID,
+ * runs wifi_benchmark_power_modes() against test_programs/udp_echo.py on POWER_ECHO_HOST POWER_ROUNDS times and
+ * prints one JSON record per mode and round, in the format of test_programs/bench :
+ * {"bench":"wifi_rtt","mode":"max_modem","listen_interval":3,"round":1,"sent":100,"received":99,"loss_percent":1.0,
+ * "min_us":2410,"avg_us":148032,"max_us":301764,"errors":0,"target":"esp32","cpu_mhz":240}
+ *
+ * errors is 1 when the mode got no reply at all. The supply current of each mode has to be measured externally, a
+ * mode runs for about POWER_PACKETS * 0.5 s.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "util_wifi.h"
+#include "util_nvs.h"
+#include "esp32/clk.h"
+
+#define POWER_STA_SSID "your_network"
+#define POWER_STA_PASSWORD "your_password"
+
+/*
+ * @brief : Address of the host running udp_echo.py and the port it listens on.
+ */
+#define POWER_ECHO_HOST "192.168.1.10"
+#define POWER_ECHO_PORT 55668
+
+#define POWER_PACKETS 100
+#define POWER_ROUNDS 3
+#define POWER_LISTEN_INTERVAL WIFI_DEFAULT_LISTEN_INTERVAL
+#define POWER_CONNECT_TIMEOUT_MS 30000
+
+#define POWER_MODES 3
+
+/*
+ * @brief : Names of the modes in the records, in the order of the results of wifi_benchmark_power_modes().
+ */
+static const char * power_mode_names[POWER_MODES] = { "none", "min_modem", "max_modem" };
+
+/*
+ * @brief: This function prints the record of one mode.
+ *
+ * @param:
+ * 1. const wifi_rtt_result * result : the result of the mode.
+ * 2. uint8_t mode : index of the mode in the results.
+ * 3. uint32_t round : the round number.
+ *
+ * @return: nothing
+ */
+static void power_print(const wifi_rtt_result * result, uint8_t mode, uint32_t round)
+{
+	double loss = result->sent ? 100.0 * (result->sent - result->received) / result->sent : 100.0;
+
+	printf("{\"bench\":\"wifi_rtt\",\"mode\":\"%s\",\"listen_interval\":%u,\"round\":%u,\"sent\":%u,\"received\":%u,"
+			"\"loss_percent\":%.1f,\"min_us\":%u,\"avg_us\":%u,\"max_us\":%u,\"errors\":%u,\"target\":\"%s\",\"cpu_mhz\":%.0f}\n",
+			power_mode_names[mode], result->listen_interval, (unsigned)round, result->sent, result->received, loss,
+			(unsigned)result->min_us, (unsigned)result->avg_us, (unsigned)result->max_us, result->received == 0,
+			CONFIG_IDF_TARGET, esp_clk_cpu_freq() / 1000000.0);
+}
+
+void app_main(void)
+{
+	wifi_rtt_result results[POWER_MODES];
+
+	InitializeNVS();
+	set_sta_ssid(POWER_STA_SSID);
+	set_sta_password(POWER_STA_PASSWORD);
+
+	esp_err_t _err = begin_wifi_sta();
+	if( _err == ESP_OK ) _err = wifi_wait_for_ip(pdMS_TO_TICKS(POWER_CONNECT_TIMEOUT_MS));
+	if( _err != ESP_OK )
+	{
+		printf("wifi_power: no connection to %s (%s)\n", POWER_STA_SSID, esp_err_to_name(_err));
+		stop_wifi();
+		return;
+	}
+
+	for( uint32_t round=1; round<=POWER_ROUNDS; round++ )
+	{
+		memset(results, 0, sizeof(results));
+		_err = wifi_benchmark_power_modes(POWER_ECHO_HOST, POWER_ECHO_PORT, POWER_PACKETS, POWER_LISTEN_INTERVAL, results);
+		if( _err == ESP_ERR_INVALID_STATE )
+		{
+			printf("wifi_power: the station is not running\n");
+			break;
+		}
+
+		for( uint8_t i=0; i<POWER_MODES; i++ ) power_print(&results[i], i, round);
+	}
+
+	stop_wifi();
+}
@@ -0,0 +1,237 @@
+/*
+ * @file: wifi_soak.c
+ *
+ * @brief: Soak test for util_wifi. WiFi is started and stopped SOAK_CYCLES times in turn as softAP, station,
+ * AP+STA and with hot mode switches, checking after every cycle that no event handler is left registered and that
+ * the free heap stays flat. The station joins SOAK_STA_SSID, which should not exist: it starts, fails to connect and
+ * arms its reconnect timer, so no access point is needed around the board.
+ *
+ * Handlers are counted twice: util_wifi's own registrations, and every handler of the event loops as listed by
+ * esp_event_dump(), which also catches a registration util_wifi lost track of. The second count needs
+ * CONFIG_ESP_EVENT_LOOP_PROFILING, set in sdkconfig.defaults.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "util_wifi.h"
+#include "util_nvs.h"
+#include "esp_heap_caps.h"
+#include "esp_event.h"
+
+#define SOAK_CYCLES 10000
+
+/*
+ * @brief : Number of cycles run before the heap and handler references are taken, the first start of every mode
+ * allocates buffers that are kept.
+ */
+#define SOAK_WARMUP_CYCLES 12
+
+/*
+ * @brief : Free heap the test tolerates losing over all cycles, allocator fragmentation moves it a little.
+ */
+#define SOAK_HEAP_SLACK 1024
+
+#define SOAK_REPORT_EVERY 500
+
+#define SOAK_STA_SSID "util_wifi_soak_none"
+
+/*
+ * @brief : Every SOAK_STA_FAIL_EVERY station cycles wait up to SOAK_STA_FAIL_TIMEOUT_MS for the failed connect, so
+ * the stop also runs with the reconnect timer armed. The other cycles stop the station while it connects.
+ */
+#define SOAK_STA_FAIL_EVERY 50
+#define SOAK_STA_FAIL_TIMEOUT_MS 15000
+
+typedef enum soak_kind { SOAK_AP, SOAK_STA, SOAK_APSTA, SOAK_SWITCH, SOAK_KINDS }soak_kind;
+
+static const char * soak_kind_names[SOAK_KINDS] = { "ap", "sta", "apsta", "switch" };
+
+/*
+ * @brief : Modes switch_wifi_mode() goes through in a SOAK_SWITCH cycle, which starts as a station.
+ */
+static const wifi_mode_t soak_switch_modes[] = { WIFI_MODE_AP, WIFI_MODE_APSTA, WIFI_MODE_STA, WIFI_MODE_APSTA, WIFI_MODE_AP };
+
+/*
+ * @brief: This function counts the handlers registered on all event loops.
+ *
+ * @param:
+ * none
+ *
+ * @return: int
+ * Number of handlers, -1 if the event loops can not be listed.
+ */
+static int soak_loop_handler_count(void)
+{
+#ifdef CONFIG_ESP_EVENT_LOOP_PROFILING
+	char * dump = NULL;
+	size_t size = 0;
+	int count = 0;
+
+	FILE * stream = open_memstream(&dump, &size);
+	if( stream == NULL ) return -1;
+	esp_err_t _err = esp_event_dump(stream);
+	fclose(stream);
+
+	// one "handler @<address> ev:<base>,<id> ..." line per registration
+	for( char * line = dump; _err == ESP_OK && line != NULL && ( line = strstr(line, "handler @") ) != NULL; line++ ) count++;
+	free(dump);
+
+	return ( _err == ESP_OK ) ? count : -1;
+#else
+	return -1;
+#endif
+}
+
+/*
+ * @brief: This function waits until the station has failed to connect at least once more.
+ *
+ * @param:
+ * 1. uint32_t disconnects : the disconnect count when the station started.
+ *
+ * @return: uint8_t
+ * 1 the station failed and its reconnect timer is armed
+ * 0 timed out
+ */
+static uint8_t soak_wait_sta_failure(uint32_t disconnects)
+{
+	wifi_reconnect_stats stats;
+
+	for( uint32_t waited=0; waited<SOAK_STA_FAIL_TIMEOUT_MS; waited+=100 )
+	{
+		get_wifi_reconnect_stats(&stats);
+		if( stats.disconnects > disconnects ) return 1;
+		vTaskDelay(pdMS_TO_TICKS(100));
+	}
+	return 0;
+}
+
+/*
+ * @brief: This function starts WiFi for one cycle.
+ *
+ * @param:
+ * 1. soak_kind kind : the modes the cycle runs.
+ * 2. uint32_t cycle : the cycle number.
+ *
+ * @return: esp_err_t
+ * Error code of the util_wifi API that failed, ESP_OK otherwise.
+ */
+static esp_err_t soak_start(soak_kind kind, uint32_t cycle)
+{
+	wifi_reconnect_stats stats;
+	esp_err_t _err;
+
+	switch(kind)
+	{
+	case SOAK_AP:
+		return begin_wifi_ap();
+
+	case SOAK_APSTA:
+		return begin_wifi_apsta();
+
+	case SOAK_STA:
+		get_wifi_reconnect_stats(&stats);
+		_err = begin_wifi_sta();
+		if( _err == ESP_OK && ( cycle / SOAK_KINDS ) % SOAK_STA_FAIL_EVERY == 0 && !soak_wait_sta_failure(stats.disconnects) )
+			printf("cycle %u: station did not report its failed connect\n", (unsigned)cycle);
+		return _err;
+
+	case SOAK_SWITCH:
+		// the first switch runs while WIFI_EVENT_STA_START of the station may still be queued
+		_err = begin_wifi_sta();
+		for( size_t i=0; _err == ESP_OK && i<sizeof(soak_switch_modes)/sizeof(soak_switch_modes[0]); i++ )
+		{
+			_err = switch_wifi_mode(soak_switch_modes[i]);
+			if( _err == ESP_OK && get_wifi_mode() != soak_switch_modes[i] ) _err = ESP_ERR_INVALID_STATE;
+		}
+		return _err;
+
+	default:
+		return ESP_ERR_INVALID_ARG;
+	}
+}
+
+/*
+ * @brief: This function runs one start/stop cycle.
+ *
+ * @param:
+ * 1. uint32_t cycle : the cycle number, it selects the modes and is used in error messages.
+ * 2. int loop_reference : handlers on the event loops while WiFi is stopped, -1 before it is known.
+ *
+ * @return: uint8_t
+ * 1 success
+ * 0 failed
+ */
+static uint8_t soak_cycle(uint32_t cycle, int loop_reference)
+{
+	soak_kind kind = (soak_kind)(cycle % SOAK_KINDS);
+
+	esp_err_t _err = soak_start(kind, cycle);
+	if( _err != ESP_OK )
+	{
+		printf("cycle %u: %s start failed (%s)\n", (unsigned)cycle, soak_kind_names[kind], esp_err_to_name(_err));
+		stop_wifi();
+		return 0;
+	}
+
+	uint8_t running = get_wifi_event_handler_count();
+
+	stop_wifi();
+
+	uint8_t stopped = get_wifi_event_handler_count();
+	int loop_handlers = soak_loop_handler_count();
+
+	if( running != 3 || stopped != 0 )
+	{
+		printf("cycle %u: %s, %u handlers while running, %u after stop\n", (unsigned)cycle, soak_kind_names[kind], running, stopped);
+		return 0;
+	}
+	if( loop_reference >= 0 && loop_handlers != loop_reference )
+	{
+		printf("cycle %u: %s, %d handlers on the event loops after stop, %d expected\n", (unsigned)cycle,
+				soak_kind_names[kind], loop_handlers, loop_reference);
+		return 0;
+	}
+	return 1;
+}
+
+void app_main(void)
+{
+	uint32_t reference = 0;
+	uint32_t lowest = UINT32_MAX;
+	int loop_reference = -1;
+
+	InitializeNVS();
+	set_ap_ssid("util_wifi_soak");
+	set_ap_password("soak_test");
+	set_sta_ssid(SOAK_STA_SSID);
+	set_sta_password("soak_test");
+
+	if( soak_loop_handler_count() < 0 ) printf("event loop handlers not checked, CONFIG_ESP_EVENT_LOOP_PROFILING is off\n");
+
+	for( uint32_t cycle=1; cycle<=SOAK_CYCLES; cycle++ )
+	{
+		if( !soak_cycle(cycle, loop_reference) )
+		{
+			printf("SOAK FAILED\n");
+			return;
+		}
+
+		uint32_t heap = esp_get_free_heap_size();
+		if( cycle == SOAK_WARMUP_CYCLES )
+		{
+			reference = heap;
+			loop_reference = soak_loop_handler_count();
+		}
+		if( cycle >= SOAK_WARMUP_CYCLES && heap < lowest ) lowest = heap;
+
+		if( cycle % SOAK_REPORT_EVERY == 0 )
+			printf("cycle %u: free heap %u, reference %u, lowest %u, event loop handlers %d\n", (unsigned)cycle,
+					(unsigned)heap, (unsigned)reference, (unsigned)lowest, loop_reference);
+	}
+
+	uint32_t heap = esp_get_free_heap_size();
+	printf("%u cycles, free heap %u, reference %u, lowest %u, largest block %u\n", SOAK_CYCLES, (unsigned)heap,
+			(unsigned)reference, (unsigned)lowest, (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT));
+
+	if( heap + SOAK_HEAP_SLACK < reference ) printf("SOAK FAILED: heap dropped by %u bytes\n", (unsigned)(reference - heap));
+	else printf("SOAK PASSED\n");
+}